@@ -0,0 +1,101 @@
+"""
+Stress benchmark of concurrent scoring from Python threads.
+
+All the threads score the same recordings, with turn lists shared between them,
+and each result is checked against a sequential run. On a free-threaded Python
+build (e.g. python3.13t) the module runs without the GIL, and the throughput
+should grow almost linearly with the number of threads, up to the number of
+cores. On a regular build the GIL is released while scoring, but the Python
+parts of each call are serialized.
+
+Usage:
+    python benchmarks/thread_scaling.py --max-threads 16
+"""
+import os
+import sys
+import threading
+import time
+
+import click
+import numpy as np
+
+from _spyder import Turn, TurnList, compute_der
+
+
+def make_recording(rng, num_turns, num_speakers, length):
+    def turns(num_speakers):
+        starts = rng.uniform(0, length, num_turns)
+        ends = starts + rng.uniform(0.2, 10.0, num_turns)
+        speakers = rng.integers(0, num_speakers, num_turns)
+        return TurnList(
+            [
+                Turn(f"spk{s}", float(a), float(b))
+                for s, a, b in zip(speakers, starts, ends)
+            ]
+        )
+
+    uem = TurnList([Turn("dummy", 0.0, length + 10.0)])
+    return turns(num_speakers), turns(num_speakers + 2), uem
+
+
+def run(recordings, expected, num_threads, calls_per_thread, collar):
+    barrier = threading.Barrier(num_threads + 1)
+    errors = []
+
+    def work(index):
+        barrier.wait()
+        for k in range(calls_per_thread):
+            i = (index + k) % len(recordings)
+            metrics = compute_der(*recordings[i], collar=collar)
+            if metrics.der != expected[i].der or metrics.ref_map != expected[i].ref_map:
+                errors.append(i)
+
+    threads = [threading.Thread(target=work, args=(t,)) for t in range(num_threads)]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+    if errors:
+        raise RuntimeError(f"{len(errors)} results differ from the sequential run")
+    return elapsed
+
+
+@click.command()
+@click.option("--recordings", default=16, help="Number of distinct recordings.")
+@click.option("--turns", default=2000, help="Number of turns per speaker list.")
+@click.option("--calls", default=32, help="Number of calls per thread.")
+@click.option(
+    "--max-threads", default=os.cpu_count(), help="Largest number of threads."
+)
+@click.option("--collar", default=0.25, help="Collar size in seconds.")
+@click.option("--seed", default=0, help="Random seed.")
+def main(recordings, turns, calls, max_threads, collar, seed):
+    rng = np.random.default_rng(seed)
+    data = [make_recording(rng, turns, 8, 3600.0) for _ in range(recordings)]
+    expected = [compute_der(*recording, collar=collar) for recording in data]
+    gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+    print(f"Python {sys.version.split()[0]}, GIL {'enabled' if gil else 'disabled'}")
+
+    # Each thread makes the same number of calls, so with perfect scaling the
+    # elapsed time stays flat as threads are added.
+    thread_counts = sorted(
+        {1, max_threads} | {2**k for k in range(8) if 2**k < max_threads}
+    )
+    base = None
+    print(f"{'threads':>8} {'calls/s':>10} {'speedup':>8} {'efficiency':>10}")
+    for num_threads in thread_counts:
+        elapsed = run(data, expected, num_threads, calls, collar)
+        throughput = num_threads * calls / elapsed
+        base = base or throughput
+        speedup = throughput / base
+        print(
+            f"{num_threads:>8} {throughput:>10.1f} {speedup:>8.2f} "
+            f"{speedup / num_threads:>10.0%}"
+        )
+
+
+if __name__ == "__main__":
+    main()
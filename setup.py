@@ -1,3 +1,4 @@
+import os
 import sys
 from glob import glob
 
@@ -18,12 +19,24 @@ __version__ = "0.4.0"
 #   Sort input source files if you glob sources to ensure bit-for-bit
 #   reproducible builds (https://github.com/pybind/python_example/pull/53)
 
+# zlib is used to read gzip-compressed RTTM and UEM files. zstd-compressed files
+# are supported if SPYDER_WITH_ZSTD=1 is set (requires the zstd headers).
+define_macros = [("VERSION_INFO", __version__)]
+libraries = ["z"]
+if os.environ.get("SPYDER_WITH_ZSTD", "0") == "1":
+    define_macros.append(("SPYDER_HAVE_ZSTD", None))
+    libraries.append("zstd")
+
 ext_modules = [
     Pybind11Extension(
         "_spyder",
         sorted(glob("src/spyder/*.cc")),
         # Example: passing in the version to the compiled code
-        define_macros=[("VERSION_INFO", __version__)],
+        define_macros=define_macros,
+        libraries=libraries,
+        # std::thread is used to solve independent assignment problems in parallel
+        extra_compile_args=["-pthread"],
+        extra_link_args=["-pthread"],
     ),
 ]
 
@@ -60,5 +73,11 @@ setup(
     zip_safe=False,
     install_requires=install_requires,
     extras_require={"tests": tests_require, "all": install_requires + tests_require},
-    entry_points={"console_scripts": ["spyder=spyder.der:compute_der_from_rttm"]},
+    entry_points={
+        "console_scripts": [
+            "spyder=spyder.der:compute_der_from_rttm",
+            "spyder-convert=spyder.der:convert_segment_file",
+            "spyder-daemon=spyder.daemon:run_daemon",
+        ]
+    },
 )
@@ -1,2 +1,19 @@
-from .der import DER
-from _spyder import Turn, TurnList, compute_der
+from .aio import DER_async
+from .labels import frame_labels
+from .der import (
+    DER,
+    SAD,
+    DER_approx,
+    DER_matrix,
+    DER_multi_reference,
+    DERSession,
+    DERStream,
+)
+from _spyder import (
+    SegmentFile,
+    Turn,
+    TurnList,
+    compute_der,
+    rttm_to_segment_file,
+    segment_file_to_rttm,
+)
@@ -0,0 +1,232 @@
+"""
+Non-blocking scoring for asyncio code.
+
+Recordings are scored on a native pool of worker threads (ScoringPool), which
+runs without the GIL. The pool signals completed recordings on a pipe that the
+event loop watches, so no thread is blocked waiting on results, and the event
+loop stays free to serve other requests while a corpus is being scored. A
+single pool is shared by all the requests of an event loop.
+"""
+import asyncio
+import os
+import weakref
+
+from .der import (
+    DERMetrics,
+    _summarize,
+    get_uem_turns,
+    read_rttm_turns,
+    read_uem_turns,
+)
+from _spyder import ScoringPool, Turn, TurnList
+
+__all__ = ["AsyncScorer", "DER_async", "DER_as_completed"]
+
+# Number of recordings submitted between two yields to the event loop.
+_SUBMIT_BATCH = 64
+
+
+class AsyncScorer:
+    """
+    Scores recordings on a native thread pool, and resolves asyncio futures as
+    they complete. The scorer is bound to the event loop it is first used from,
+    and only keeps a weak reference to it, so that the default scorer of a loop
+    (and its threads) are released with the loop.
+
+    Args:
+        num_threads (int): Number of worker threads (0 means all available cores).
+    """
+
+    def __init__(self, num_threads=0):
+        self._pool = ScoringPool(num_threads)
+        self._futures = {}
+        self._loop_ref = None
+
+    @property
+    def _loop(self):
+        return None if self._loop_ref is None else self._loop_ref()
+
+    def _attach(self):
+        loop = asyncio.get_running_loop()
+        if self._loop is None:
+            loop.add_reader(self._pool.notify_fd, self._on_ready)
+            self._loop_ref = weakref.ref(loop)
+        elif self._loop is not loop:
+            raise RuntimeError("AsyncScorer is bound to another event loop")
+        return loop
+
+    def _on_ready(self):
+        try:
+            while os.read(self._pool.notify_fd, 4096):
+                pass
+        except BlockingIOError:
+            pass
+        for job, metrics, error in self._pool.pop_results():
+            future = self._futures.pop(job, None)
+            if future is None or future.done():
+                continue
+            if error is not None:
+                future.set_exception(RuntimeError(error))
+            else:
+                future.set_result(DERMetrics(metrics))
+
+    def submit(self, ref, hyp, uem=None, regions="all", collar=0.0):
+        """
+        Queue a recording for scoring, and return an asyncio future of its
+        DERMetrics. Cancelling the future removes the recording from the queue if
+        it has not started yet.
+        """
+        loop = self._attach()
+        if uem is None:
+            uem = get_uem_turns(list(ref), list(hyp))
+        job = self._pool.submit(
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref]),
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem]),
+            regions=regions,
+            collar=collar,
+        )
+        future = loop.create_future()
+        future.add_done_callback(lambda f: f.cancelled() and self._cancel(job))
+        self._futures[job] = future
+        return future
+
+    def _cancel(self, job):
+        self._futures.pop(job, None)
+        self._pool.cancel(job)
+
+    @property
+    def num_pending(self):
+        return self._pool.num_pending
+
+    def close(self):
+        """
+        Stop watching the pool. Pending futures are cancelled.
+        """
+        loop = self._loop
+        if loop is not None and not loop.is_closed():
+            loop.remove_reader(self._pool.notify_fd)
+        for future in list(self._futures.values()):
+            future.cancel()
+        self._futures.clear()
+        self._loop_ref = None
+
+
+# Default scorer of each event loop, dropped when the loop is collected.
+_default_scorers = weakref.WeakKeyDictionary()
+
+
+def _default_scorer():
+    loop = asyncio.get_running_loop()
+    scorer = _default_scorers.get(loop)
+    if scorer is None:
+        scorer = _default_scorers[loop] = AsyncScorer()
+    return scorer
+
+
+def _load_inputs(ref, hyp, uem):
+    if isinstance(ref, str):
+        ref = read_rttm_turns(ref)
+    if isinstance(hyp, str):
+        hyp = read_rttm_turns(hyp)
+    if isinstance(uem, str):
+        uem = read_uem_turns(uem)
+    return ref, hyp, uem
+
+
+async def DER_as_completed(
+    ref,
+    hyp,
+    uem=None,
+    skip_missing=False,
+    regions="all",
+    collar=0.0,
+    scorer=None,
+):
+    """
+    Score the recordings of `ref` and `hyp` (dicts of recording id to turns, or
+    paths of RTTM files) without blocking the event loop, and yield
+    `(recording_id, DERMetrics)` pairs in the order in which the recordings
+    complete. If the iteration is stopped early, the recordings that have not
+    started yet are dropped.
+
+    Example:
+        async for reco_id, metrics in DER_as_completed(ref, hyp):
+            print(reco_id, metrics.der)
+    """
+    ref, hyp, uem = _load_inputs(ref, hyp, uem)
+    scorer = scorer or _default_scorer()
+    futures = {}
+    try:
+        for i, reco_id in enumerate(ref):
+            if reco_id not in hyp and skip_missing:
+                continue
+            hyp_turns = hyp.get(reco_id, [])
+            uem_turns = None if uem is None else uem[reco_id]
+            future = scorer.submit(ref[reco_id], hyp_turns, uem_turns, regions, collar)
+            futures[future] = reco_id
+            # Converting the turns holds the event loop, so let other tasks run
+            # between batches of recordings.
+            if (i + 1) % _SUBMIT_BATCH == 0:
+                await asyncio.sleep(0)
+        pending = set(futures)
+        while pending:
+            done, pending = await asyncio.wait(
+                pending, return_when=asyncio.FIRST_COMPLETED
+            )
+            for future in done:
+                yield futures[future], future.result()
+    finally:
+        for future in futures:
+            future.cancel()
+
+
+async def DER_async(
+    ref,
+    hyp,
+    uem=None,
+    per_file=False,
+    skip_missing=False,
+    regions="all",
+    collar=0.0,
+    progress=None,
+    scorer=None,
+):
+    """
+    Compute DER between ref and hyp without blocking the event loop. This is the
+    asyncio counterpart of DER(), and many calls can be awaited concurrently; the
+    recordings of all of them are scored on a shared native thread pool.
+
+    Args:
+        ref (dict or list or str): Reference turns (see DER).
+        hyp (dict or list or str): Hypothesis turns.
+        uem (dict or list or str): UEM turns. If None, we will use the union of ref
+            and hyp.
+        per_file (bool): If True, return DER for each file as well.
+        skip_missing (bool): If True, skip recordings missing in the hypothesis.
+        regions (str): Regions to evaluate (see DER).
+        collar (float): Collar size in seconds.
+        progress (callable): Called as `progress(reco_id, metrics, num_done,
+            num_total)` on the event loop as each recording completes.
+        scorer (AsyncScorer): Scorer to use. By default, a scorer shared by all
+            the calls on the running event loop.
+
+    Returns:
+        DERMetrics for a single recording, otherwise a dict as returned by DER().
+    """
+    ref, hyp, uem = _load_inputs(ref, hyp, uem)
+    scorer = scorer or _default_scorer()
+    if not isinstance(ref, dict):
+        return await scorer.submit(ref, hyp, uem, regions, collar)
+
+    num_total = sum(1 for reco_id in ref if reco_id in hyp or not skip_missing)
+    results = {}
+    async for reco_id, metrics in DER_as_completed(
+        ref, hyp, uem, skip_missing, regions, collar, scorer
+    ):
+        results[reco_id] = metrics
+        if progress is not None:
+            progress(reco_id, metrics, len(results), num_total)
+    # Keep the recordings in input order, as DER() does.
+    results = {reco_id: results[reco_id] for reco_id in ref if reco_id in results}
+    return _summarize(results, per_file, regions, False, False)
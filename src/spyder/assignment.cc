@@ -0,0 +1,320 @@
+// spyder/assignment.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_ASSIGNMENT_CC
+#define SPYDER_ASSIGNMENT_CC
+
+#include "assignment.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hungarian.h"
+#include "parallel.h"
+
+namespace spyder {
+
+void CostAccumulator::add(const CostAccumulator &other) {
+  for (auto &it : other.costs) costs[it.first] += it.second;
+}
+
+std::vector<CostEntry> CostAccumulator::entries() const {
+  std::vector<CostEntry> cost;
+  cost.reserve(costs.size());
+  for (auto &it : costs)
+    cost.push_back(CostEntry(it.first / num_hyp, it.first % num_hyp, it.second));
+  std::sort(cost.begin(), cost.end(), [](const CostEntry &a, const CostEntry &b) {
+    return (a.ref != b.ref) ? (a.ref < b.ref) : (a.hyp < b.hyp);
+  });
+  return cost;
+}
+
+std::vector<int> solve_assignment(std::vector<std::vector<double>> &cost_matrix) {
+  std::vector<int> assignment;
+  if (cost_matrix.empty() || cost_matrix[0].empty()) {
+    assignment.assign(cost_matrix.size(), -1);
+    return assignment;
+  }
+  HungarianAlgorithm hungarian_solver;
+  hungarian_solver.Solve(cost_matrix, assignment);
+  return assignment;
+}
+
+// Find the root of a node in a union-find forest, with path halving.
+static int find_root(std::vector<int> &parent, int x) {
+  while (parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+std::vector<int> solve_sparse_assignment(int num_ref, int num_hyp,
+                                         const std::vector<CostEntry> &cost, int num_threads) {
+  std::vector<int> assignment(num_ref, -1);
+
+  // Nodes 0..num_ref-1 are reference speakers, and num_ref..num_ref+num_hyp-1
+  // are hypothesis speakers. Every entry connects a ref and a hyp node.
+  std::vector<int> parent(num_ref + num_hyp);
+  std::iota(parent.begin(), parent.end(), 0);
+  for (auto &entry : cost) {
+    int a = find_root(parent, entry.ref), b = find_root(parent, num_ref + entry.hyp);
+    if (a != b) parent[std::max(a, b)] = std::min(a, b);
+  }
+
+  // Group the entries by component. Since the entries are sorted by ref, each
+  // component's entries are also sorted by ref.
+  std::unordered_map<int, int> component_index;
+  std::vector<std::vector<const CostEntry *>> components;
+  for (auto &entry : cost) {
+    int root = find_root(parent, entry.ref);
+    auto it = component_index.find(root);
+    if (it == component_index.end()) {
+      it = component_index.insert(std::make_pair(root, (int)components.size())).first;
+      components.push_back(std::vector<const CostEntry *>());
+    }
+    components[it->second].push_back(&entry);
+  }
+
+  // Solve each component with the Hungarian algorithm. Components are disjoint
+  // in both reference and hypothesis speakers, so they can be solved in parallel.
+  parallel_for(components.size(), num_threads, [&](size_t c) {
+    auto &entries = components[c];
+    if (entries.size() == 1) {
+      assignment[entries[0]->ref] = entries[0]->hyp;
+      return;
+    }
+
+    // Build a dense cost matrix over the speakers of the component.
+    std::vector<int> refs, hyps;
+    for (auto entry : entries) {
+      if (refs.empty() || refs.back() != entry->ref) refs.push_back(entry->ref);
+      hyps.push_back(entry->hyp);
+    }
+    std::sort(hyps.begin(), hyps.end());
+    hyps.erase(std::unique(hyps.begin(), hyps.end()), hyps.end());
+    std::vector<std::vector<double>> cost_matrix(refs.size(), std::vector<double>(hyps.size()));
+    size_t i = 0;
+    for (auto entry : entries) {
+      while (refs[i] != entry->ref) ++i;
+      size_t j = std::lower_bound(hyps.begin(), hyps.end(), entry->hyp) - hyps.begin();
+      cost_matrix[i][j] = entry->cost;
+    }
+
+    std::vector<int> local_assignment = solve_assignment(cost_matrix);
+    for (size_t i = 0; i < refs.size(); ++i) {
+      // Speakers of the same component may still be paired with zero overlap
+      // when the component is not complete; such pairs are not assigned.
+      int j = local_assignment[i];
+      if (j != -1 && cost_matrix[i][j] != 0) assignment[refs[i]] = hyps[j];
+    }
+  });
+  return assignment;
+}
+
+std::vector<int> solve_greedy_assignment(int num_ref, int num_hyp,
+                                         const std::vector<CostEntry> &cost) {
+  // Visit the entries from the largest overlap to the smallest. Ties are
+  // broken by (ref, hyp), the order of the entries.
+  std::vector<const CostEntry *> order;
+  order.reserve(cost.size());
+  for (auto &entry : cost) order.push_back(&entry);
+  std::stable_sort(order.begin(), order.end(),
+                   [](const CostEntry *a, const CostEntry *b) { return a->cost < b->cost; });
+
+  std::vector<int> assignment(num_ref, -1);
+  std::vector<bool> hyp_assigned(num_hyp, false);
+  for (auto entry : order) {
+    if (entry->cost >= 0) break;
+    if (assignment[entry->ref] != -1 || hyp_assigned[entry->hyp]) continue;
+    assignment[entry->ref] = entry->hyp;
+    hyp_assigned[entry->hyp] = true;
+  }
+  return assignment;
+}
+
+std::vector<int> solve_auction_assignment(int num_ref, int num_hyp,
+                                          const std::vector<CostEntry> &cost, double epsilon,
+                                          std::vector<double> &prices) {
+  if (!(epsilon > 0)) throw std::invalid_argument("Auction epsilon must be positive");
+  // Index the entries of each reference speaker.
+  std::vector<size_t> row_start(num_ref + 1, 0);
+  for (auto &entry : cost) row_start[entry.ref + 1] += 1;
+  for (int i = 0; i < num_ref; ++i) row_start[i + 1] += row_start[i];
+
+  prices.assign(num_hyp, 0);
+  std::vector<int> assignment(num_ref, -1), owner(num_hyp, -1);
+  std::vector<int> unassigned;
+  for (int i = num_ref - 1; i >= 0; --i)
+    if (row_start[i + 1] > row_start[i]) unassigned.push_back(i);
+  while (!unassigned.empty()) {
+    int i = unassigned.back();
+    unassigned.pop_back();
+    // Find the best and second best values (overlap minus price). Staying
+    // unassigned is always worth 0.
+    int best = -1;
+    double best_value = 0, second_value = 0;
+    for (size_t k = row_start[i]; k < row_start[i + 1]; ++k) {
+      double value = -cost[k].cost - prices[cost[k].hyp];
+      if (value > best_value) {
+        second_value = best_value;
+        best_value = value;
+        best = cost[k].hyp;
+      } else if (value > second_value) {
+        second_value = value;
+      }
+    }
+    if (best == -1) continue;
+
+    // Bid for the best hypothesis speaker, and outbid its current owner. Once
+    // bid for, a hypothesis speaker stays assigned, so only assigned speakers
+    // have a positive price.
+    prices[best] += best_value - second_value + epsilon;
+    if (owner[best] != -1) {
+      assignment[owner[best]] = -1;
+      unassigned.push_back(owner[best]);
+    }
+    owner[best] = i;
+    assignment[i] = best;
+  }
+  return assignment;
+}
+
+double assignment_gap(int num_ref, const std::vector<CostEntry> &cost,
+                      const std::vector<int> &assignment, const std::vector<double> &prices) {
+  // With overlaps w = -cost, the prices p and the profits
+  // u_i = max(0, max_j (w_ij - p_j)) satisfy u_i + p_j >= w_ij for all pairs,
+  // so by duality sum(u) + sum(p) bounds the overlap of any assignment.
+  std::vector<double> profit(num_ref, 0);
+  double overlap = 0;
+  for (auto &entry : cost) {
+    profit[entry.ref] = std::max(profit[entry.ref], -entry.cost - prices[entry.hyp]);
+    if (assignment[entry.ref] == entry.hyp) overlap -= entry.cost;
+  }
+  double bound = std::accumulate(profit.begin(), profit.end(), 0.0) +
+                 std::accumulate(prices.begin(), prices.end(), 0.0);
+  return std::max(0.0, bound - overlap);
+}
+
+// Price increments below this many seconds are ignored when solving for the
+// prices, so that rounding errors cannot make the longest paths cycle.
+static const double PRICE_TOLERANCE = 1e-9;
+
+std::vector<double> assignment_prices(int num_ref, int num_hyp,
+                                      const std::vector<CostEntry> &cost,
+                                      const std::vector<int> &assignment) {
+  std::vector<double> prices(num_hyp, 0);
+  std::vector<int> owner(num_hyp, -1);
+  std::vector<double> matched(num_ref, 0);
+  std::vector<size_t> row_begin(num_ref + 1, 0);
+  for (int i = 0; i < num_ref; ++i)
+    if (assignment[i] != -1) owner[assignment[i]] = i;
+  for (auto &entry : cost) {
+    row_begin[entry.ref + 1] += 1;
+    if (assignment[entry.ref] == -1)
+      prices[entry.hyp] = std::max(prices[entry.hyp], -entry.cost);
+    else if (assignment[entry.ref] == entry.hyp)
+      matched[entry.ref] = -entry.cost;
+  }
+  std::partial_sum(row_begin.begin(), row_begin.end(), row_begin.begin());
+
+  // Raising the price of an assigned hypothesis speaker a lowers the profit of
+  // its reference speaker i, which may in turn raise the prices of the other
+  // speakers that i overlaps with. Propagate the increments until they settle.
+  std::deque<int> queue;
+  std::vector<bool> queued(num_hyp, false);
+  std::vector<int> num_updates(num_hyp, 0);
+  for (int j = 0; j < num_hyp; ++j) {
+    if (owner[j] == -1) continue;
+    queue.push_back(j);
+    queued[j] = true;
+  }
+  while (!queue.empty()) {
+    int a = queue.front(), i = owner[a];
+    queue.pop_front();
+    queued[a] = false;
+    for (size_t k = row_begin[i]; k < row_begin[i + 1]; ++k) {
+      int j = cost[k].hyp;
+      double price = prices[a] - matched[i] - cost[k].cost;
+      if (j == a || price <= prices[j] + PRICE_TOLERANCE) continue;
+      prices[j] = price;
+      // A price raised this often lies on an increasing cycle, so the
+      // assignment is not optimal. Fall back to the largest overlap of each
+      // hypothesis speaker, which bounds the gap from above.
+      if (++num_updates[j] > num_hyp) {
+        std::fill(prices.begin(), prices.end(), 0.0);
+        for (auto &entry : cost) prices[entry.hyp] = std::max(prices[entry.hyp], -entry.cost);
+        return prices;
+      }
+      if (owner[j] != -1 && !queued[j]) {
+        queue.push_back(j);
+        queued[j] = true;
+      }
+    }
+  }
+  return prices;
+}
+
+// The price increment of the auction, relative to the largest overlap. It
+// bounds the number of bids for each hypothesis speaker to about its inverse.
+static const double AUCTION_EPSILON = 1e-4;
+
+std::vector<int> solve_mapping(int num_ref, int num_hyp, const std::vector<CostEntry> &cost,
+                               const std::string &mapper, double &gap, int num_threads) {
+  std::vector<int> assignment;
+  if (mapper == HUNGARIAN) {
+    gap = 0;
+    return solve_sparse_assignment(num_ref, num_hyp, cost, num_threads);
+  } else if (mapper == GREEDY) {
+    assignment = solve_greedy_assignment(num_ref, num_hyp, cost);
+    // Bound the optimal overlap by the largest overlap of each reference
+    // speaker (zero prices), or of each hypothesis speaker (zero profits).
+    std::vector<double> prices(num_hyp, 0);
+    gap = assignment_gap(num_ref, cost, assignment, prices);
+    for (auto &entry : cost) prices[entry.hyp] = std::max(prices[entry.hyp], -entry.cost);
+    gap = std::min(gap, assignment_gap(num_ref, cost, assignment, prices));
+  } else if (mapper == AUCTION) {
+    double max_overlap = 0;
+    for (auto &entry : cost) max_overlap = std::max(max_overlap, -entry.cost);
+    if (max_overlap == 0) {
+      gap = 0;
+      return std::vector<int>(num_ref, -1);
+    }
+    std::vector<double> prices;
+    assignment =
+        solve_auction_assignment(num_ref, num_hyp, cost, AUCTION_EPSILON * max_overlap, prices);
+    gap = assignment_gap(num_ref, cost, assignment, prices);
+  } else {
+    throw std::invalid_argument("Unknown mapper: " + mapper);
+  }
+  return assignment;
+}
+
+}  // end namespace spyder
+
+#endif
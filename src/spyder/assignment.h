@@ -0,0 +1,169 @@
+// spyder/assignment.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_ASSIGNMENT_H
+#define SPYDER_ASSIGNMENT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "containers.h"
+
+namespace spyder {
+
+// A non-zero entry of a sparse (num_ref x num_hyp) cost matrix, i.e., the
+// negated overlap between a reference and a hypothesis speaker.
+class CostEntry {
+ public:
+  int ref;
+  int hyp;
+  double cost;
+  CostEntry(int ref, int hyp, double cost) : ref(ref), hyp(hyp), cost(cost) {}
+};
+
+// Accumulates a sparse cost matrix region by region, so that the regions can
+// be fed to it as they are swept instead of being stored.
+class CostAccumulator {
+ public:
+  // \param num_hyp: number of hypothesis speakers
+  explicit CostAccumulator(int num_hyp) : num_hyp(num_hyp) {}
+
+  // Add the overlaps of the speakers active in a region.
+  // \param duration: the region duration
+  // \param ref_spk: the reference speakers active in the region
+  // \param hyp_spk: the hypothesis speakers active in the region
+  void add(double duration, const std::vector<int>& ref_spk, const std::vector<int>& hyp_spk) {
+    for (auto& i : ref_spk)
+      for (auto& j : hyp_spk) costs[(int64_t)i * num_hyp + j] -= duration;
+  }
+
+  // Add a cost to a single entry.
+  void add(int ref, int hyp, double cost) { costs[(int64_t)ref * num_hyp + hyp] += cost; }
+
+  // Add the entries of another accumulator of the same size.
+  void add(const CostAccumulator& other);
+
+  // Returns the non-zero entries, sorted by (ref, hyp)
+  std::vector<CostEntry> entries() const;
+
+ private:
+  int num_hyp;
+  std::unordered_map<int64_t, double> costs;
+};
+
+// Solve the speaker assignment problem for a dense cost matrix with the
+// Hungarian algorithm. Unlike HungarianAlgorithm::Solve, this also handles
+// empty matrices.
+// \param cost_matrix: the (num_ref x num_hyp) cost matrix
+// \return the hypothesis speaker assigned to each reference speaker (-1 if none)
+std::vector<int> solve_assignment(std::vector<std::vector<double>>& cost_matrix);
+
+// Solve the speaker assignment problem for a sparse cost matrix. The bipartite
+// co-occurrence graph is split into connected components, and each component
+// is solved independently with the Hungarian algorithm, so one large cubic
+// problem becomes many small ones. Speakers that never co-occur with any
+// speaker of the other side are left unassigned.
+// \param num_ref: number of reference speakers
+// \param num_hyp: number of hypothesis speakers
+// \param cost: the non-zero entries of the cost matrix
+// \param num_threads: number of threads used to solve the components (<= 0
+//   means all hardware threads)
+// \return the hypothesis speaker assigned to each reference speaker (-1 if none)
+std::vector<int> solve_sparse_assignment(int num_ref, int num_hyp,
+                                         const std::vector<CostEntry>& cost,
+                                         int num_threads = 1);
+
+// Solve the speaker assignment problem for a sparse cost matrix greedily: the
+// pairs of speakers are visited from the largest overlap to the smallest, and
+// each pair is assigned if neither speaker is assigned yet. This takes
+// O(E log E) time for E non-zero entries, and finds at least half of the
+// optimal overlap.
+// \param num_ref: number of reference speakers
+// \param num_hyp: number of hypothesis speakers
+// \param cost: the non-zero entries of the cost matrix
+// \return the hypothesis speaker assigned to each reference speaker (-1 if none)
+std::vector<int> solve_greedy_assignment(int num_ref, int num_hyp,
+                                         const std::vector<CostEntry>& cost);
+
+// Solve the speaker assignment problem for a sparse cost matrix with the
+// forward auction algorithm. Unassigned reference speakers bid for the
+// hypothesis speaker of largest overlap net of its price, raising the price by
+// the margin over their second best choice plus `epsilon`, and may also stay
+// unassigned at no cost. The result is within (number of assigned speakers) x
+// epsilon of the optimal overlap, and each bid only visits the entries of one
+// reference speaker.
+// \param num_ref: number of reference speakers
+// \param num_hyp: number of hypothesis speakers
+// \param cost: the non-zero entries of the cost matrix, sorted by ref
+// \param epsilon: the minimum price increment, in seconds (> 0)
+// \param prices: set to the final price of each hypothesis speaker
+// \return the hypothesis speaker assigned to each reference speaker (-1 if none)
+std::vector<int> solve_auction_assignment(int num_ref, int num_hyp,
+                                          const std::vector<CostEntry>& cost, double epsilon,
+                                          std::vector<double>& prices);
+
+// Returns an upper bound on the overlap that an assignment misses with respect
+// to the optimal one, from a feasible solution of the dual problem built on the
+// given hypothesis speaker prices (with all-zero prices, the bound is the sum
+// of the largest overlap of each reference speaker).
+// \param num_ref: number of reference speakers
+// \param cost: the non-zero entries of the cost matrix
+// \param assignment: the hypothesis speaker assigned to each reference speaker
+// \param prices: the price of each hypothesis speaker (>= 0)
+double assignment_gap(int num_ref, const std::vector<CostEntry>& cost,
+                      const std::vector<int>& assignment, const std::vector<double>& prices);
+
+// Returns hypothesis speaker prices for which assignment_gap() of an optimal
+// assignment is 0, i.e., a certificate of its optimality. The prices are the
+// least ones that satisfy complementary slackness: w_ij - p_j <= w_ia - p_a for
+// each reference speaker i assigned to a, and w_ij <= p_j for the unassigned
+// ones (with overlaps w = -cost). These are difference constraints, solved as a
+// longest path problem. For an assignment that is not optimal, the prices
+// still give a valid (but positive) gap.
+// \param num_ref: number of reference speakers
+// \param num_hyp: number of hypothesis speakers
+// \param cost: the non-zero entries of the cost matrix, sorted by ref
+// \param assignment: the hypothesis speaker assigned to each reference speaker
+// \return the price of each hypothesis speaker (>= 0)
+std::vector<double> assignment_prices(int num_ref, int num_hyp,
+                                      const std::vector<CostEntry>& cost,
+                                      const std::vector<int>& assignment);
+
+// Solve the speaker assignment problem for a sparse cost matrix with the given
+// mapping algorithm: HUNGARIAN (exact, see solve_sparse_assignment), GREEDY or
+// AUCTION (approximate, see above).
+// \param num_ref: number of reference speakers
+// \param num_hyp: number of hypothesis speakers
+// \param cost: the non-zero entries of the cost matrix, sorted by (ref, hyp)
+// \param mapper: the mapping algorithm
+// \param gap: set to an upper bound, in seconds, on the overlap missed with
+//   respect to the optimal assignment (0 for the Hungarian algorithm)
+// \param num_threads: number of threads used by the Hungarian algorithm
+// \return the hypothesis speaker assigned to each reference speaker (-1 if none)
+std::vector<int> solve_mapping(int num_ref, int num_hyp, const std::vector<CostEntry>& cost,
+                               const std::string& mapper, double& gap, int num_threads = 1);
+
+}  // end namespace spyder
+
+#endif
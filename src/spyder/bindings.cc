@@ -20,15 +20,123 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "assignment.h"
 #include "containers.h"
 #include "der.h"
+#include "frame_grid.h"
+#include "io.h"
+#include "segment_file.h"
+#include "stream.h"
+#include "timeline.h"
 
 namespace py = pybind11;
 
-PYBIND11_MODULE(_spyder, m) {
+// Wrap a vector of a Metrics object as a read-only NumPy array without copying.
+// The array holds a reference to the Python object owning the vector, which may
+// still reallocate it, so writes must go through the property setters.
+static py::array_t<double> as_array(const std::vector<double> &values,
+                                    std::vector<py::ssize_t> shape, py::handle owner) {
+  py::ssize_t size = 1;
+  for (auto dim : shape) size *= dim;
+  if (size != (py::ssize_t)values.size())
+    throw std::runtime_error("Speaker breakdown does not match the number of speakers");
+  py::array_t<double> array(shape, values.data(), owner);
+  array.attr("flags").attr("writeable") = false;
+  return array;
+}
+
+// Move a vector into a NumPy array without copying its data. The array owns
+// the vector from then on.
+static py::array_t<double> to_array(std::vector<double> &&values) {
+  auto *owner = new std::vector<double>(std::move(values));
+  py::capsule free_owner(owner,
+                         [](void *p) { delete reinterpret_cast<std::vector<double> *>(p); });
+  return py::array_t<double>(owner->size(), owner->data(), free_owner);
+}
+
+// Move the frame-level labels of a recording into a (frames x bytes per frame)
+// uint8 NumPy array without copying, paired with the speaker labels.
+static py::tuple labels_to_tuple(spyder::FrameLabels &&labels) {
+  auto *owner = new std::vector<uint8_t>(std::move(labels.data));
+  py::capsule free_owner(owner,
+                         [](void *p) { delete reinterpret_cast<std::vector<uint8_t> *>(p); });
+  py::array_t<uint8_t> array({(py::ssize_t)labels.num_frames, (py::ssize_t)labels.row_bytes()},
+                             owner->data(), free_owner);
+  return py::make_tuple(array, labels.speakers);
+}
+
+// Convert error totals (in seconds) over a window to DER metrics.
+static spyder::Metrics window_metrics(double duration, double miss, double falarm, double conf) {
+  if (duration == 0) return spyder::Metrics(0, 0, 0, 0);
+  return spyder::Metrics(duration, miss / duration, falarm / duration, conf / duration);
+}
+
+// Getter and setter of a per-speaker vector of Metrics.
+template <std::vector<double> spyder::Metrics::*values,
+          std::vector<std::string> spyder::Metrics::*speakers>
+static py::array_t<double> get_speaker_array(py::object self) {
+  auto &m = self.cast<spyder::Metrics &>();
+  return as_array(m.*values, {(py::ssize_t)(m.*speakers).size()}, self);
+}
+
+// Getter of an overlap degree matrix of Metrics (see Metrics::degree_time).
+template <std::vector<double> spyder::Metrics::*values>
+static py::array_t<double> get_degree_array(py::object self) {
+  auto &m = self.cast<spyder::Metrics &>();
+  return as_array(m.*values, {spyder::MAX_DEGREE + 1, spyder::MAX_DEGREE + 1}, self);
+}
+
+// Getter of a per-recording column of BatchMetrics.
+template <std::vector<double> spyder::BatchMetrics::*values>
+static py::array_t<double> get_batch_array(py::object self) {
+  auto &b = self.cast<spyder::BatchMetrics &>();
+  return as_array(b.*values, {(py::ssize_t)b.size()}, self);
+}
+
+// Getter of a DER matrix of PairwiseMetrics, overall (K x K) or per recording
+// (R x K x K, None unless it was requested).
+template <std::vector<double> spyder::PairwiseMetrics::*values, bool per_recording>
+static py::object get_pairwise_array(py::object self) {
+  auto &p = self.cast<spyder::PairwiseMetrics &>();
+  py::ssize_t k = p.num_systems;
+  if (!per_recording) return as_array(p.*values, {k, k}, self);
+  if ((p.*values).empty()) return py::none();
+  return as_array(p.*values, {(py::ssize_t)p.reco_ids.size(), k, k}, self);
+}
+
+// Number of values of the speaker-level and overlap degree breakdowns of Metrics.
+static size_t num_overlaps(const spyder::Metrics &m) {
+  return m.ref_speakers.size() * m.hyp_speakers.size();
+}
+static size_t num_ref_speakers(const spyder::Metrics &m) { return m.ref_speakers.size(); }
+static size_t num_hyp_speakers(const spyder::Metrics &m) { return m.hyp_speakers.size(); }
+static size_t num_degree_bins(const spyder::Metrics &) { return spyder::DEGREE_BINS; }
+
+// Setter of a breakdown of Metrics. The values must match the speakers (or
+// overlap degrees), so that the breakdowns stay consistent with each other.
+template <std::vector<double> spyder::Metrics::*values,
+          size_t (*expected_size)(const spyder::Metrics &)>
+static void set_speaker_array(spyder::Metrics &m,
+                              py::array_t<double, py::array::c_style | py::array::forcecast> a) {
+  if ((size_t)a.size() != expected_size(m))
+    throw std::invalid_argument("Expected " + std::to_string(expected_size(m)) + " values, got " +
+                                std::to_string(a.size()));
+  (m.*values).assign(a.data(), a.data() + a.size());
+}
+
+// The module keeps no global state, the scoring functions do not modify their
+// arguments, and the scoring sessions, streams and pools lock their own state,
+// so the module declares itself safe to run without the GIL on free-threaded
+// Python builds.
+PYBIND11_MODULE(_spyder, m, py::mod_gil_not_used()) {
   m.doc() = R"doc(
         Python module
         -----------------------
@@ -37,6 +145,23 @@ PYBIND11_MODULE(_spyder, m) {
            :toctree: _generate
 
            compute_der
+           compute_der_approx
+           compute_der_global
+           compute_der_batch
+           compute_der_multi_ref
+           compute_der_pairwise
+           compute_der_segment_files
+           compute_sad
+           rasterize_rttm
+           rasterize_turns
+           solve_assignment
+           ScoringPool
+           ScoringSession
+           ScoringStream
+           read_rttm
+           read_uem
+           rttm_to_segment_file
+           segment_file_to_rttm
     )doc";
 
   py::class_<spyder::Turn>(m, "Turn").def(py::init<std::string, double, double>());
@@ -48,6 +173,62 @@ PYBIND11_MODULE(_spyder, m) {
     return new spyder::TurnList(turns);
   }));
 
+  PYBIND11_NUMPY_DTYPE(spyder::ScoredRegion, start, end, num_ref, num_hyp, num_correct, miss,
+                       falarm, conf);
+
+  py::class_<spyder::Timeline, std::shared_ptr<spyder::Timeline>>(m, "Timeline")
+      .def("__len__", &spyder::Timeline::size)
+      .def_property_readonly(
+          "regions",
+          [](py::object self) {
+            // The array views the regions in place and keeps the timeline alive. It
+            // is read-only, since the windows are searched on the regions.
+            auto &t = self.cast<spyder::Timeline &>();
+            py::array_t<spyder::ScoredRegion> array(t.regions.size(), t.regions.data(), self);
+            array.attr("flags").attr("writeable") = false;
+            return array;
+          },
+          R"doc(The scored regions, as a NumPy structured array)doc")
+      .def(
+          "window",
+          [](const spyder::Timeline &t, double t0, double t1) {
+            double totals[4];
+            t.window(t0, t1, totals);
+            return window_metrics(totals[0], totals[1], totals[2], totals[3]);
+          },
+          py::arg("t0"), py::arg("t1"), R"doc(DER metrics of the window [t0, t1))doc")
+      .def(
+          "sliding_window",
+          [](const spyder::Timeline &t, double length, double hop, py::object t0,
+             py::object t1) {
+            double begin =
+                t0.is_none() ? (t.size() ? t.regions.front().start : 0) : t0.cast<double>();
+            double end = t1.is_none() ? (t.size() ? t.regions.back().end : 0) : t1.cast<double>();
+            std::vector<double> start, duration, miss, falarm, conf, der;
+            {
+              py::gil_scoped_release release;
+              t.sliding_window(length, hop, begin, end, start, duration, miss, falarm, conf);
+              for (size_t i = 0; i < start.size(); ++i) {
+                spyder::Metrics w = window_metrics(duration[i], miss[i], falarm[i], conf[i]);
+                miss[i] = w.miss;
+                falarm[i] = w.falarm;
+                conf[i] = w.conf;
+                der.push_back(w.der);
+              }
+            }
+            py::dict curve;
+            curve["start"] = to_array(std::move(start));
+            curve["duration"] = to_array(std::move(duration));
+            curve["miss"] = to_array(std::move(miss));
+            curve["falarm"] = to_array(std::move(falarm));
+            curve["conf"] = to_array(std::move(conf));
+            curve["der"] = to_array(std::move(der));
+            return curve;
+          },
+          py::arg("length"), py::arg("hop"), py::arg("t0") = py::none(),
+          py::arg("t1") = py::none(),
+          R"doc(DER curve over sliding windows [t, t + length), as a dict of NumPy arrays)doc");
+
   py::class_<spyder::Metrics>(m, "Metrics")
       .def(py::init<double, double, double, double>())
       .def_readwrite("duration", &spyder::Metrics::duration, py::return_value_policy::copy)
@@ -55,10 +236,368 @@ PYBIND11_MODULE(_spyder, m) {
       .def_readwrite("falarm", &spyder::Metrics::falarm, py::return_value_policy::copy)
       .def_readwrite("conf", &spyder::Metrics::conf, py::return_value_policy::copy)
       .def_readwrite("der", &spyder::Metrics::der, py::return_value_policy::copy)
+      .def_readwrite("jer", &spyder::Metrics::jer, py::return_value_policy::copy)
       .def_readwrite("ref_map", &spyder::Metrics::ref_map, py::return_value_policy::copy)
-      .def_readwrite("hyp_map", &spyder::Metrics::hyp_map, py::return_value_policy::copy);
+      .def_readwrite("hyp_map", &spyder::Metrics::hyp_map, py::return_value_policy::copy)
+      .def_readwrite("ref_speakers", &spyder::Metrics::ref_speakers, py::return_value_policy::copy)
+      .def_readwrite("hyp_speakers", &spyder::Metrics::hyp_speakers, py::return_value_policy::copy)
+      .def_property(
+          "overlap",
+          [](py::object self) {
+            auto &m = self.cast<spyder::Metrics &>();
+            return as_array(
+                m.overlap,
+                {(py::ssize_t)m.ref_speakers.size(), (py::ssize_t)m.hyp_speakers.size()}, self);
+          },
+          &set_speaker_array<&spyder::Metrics::overlap, &num_overlaps>)
+      .def_property("ref_duration",
+                    &get_speaker_array<&spyder::Metrics::ref_duration,
+                                       &spyder::Metrics::ref_speakers>,
+                    &set_speaker_array<&spyder::Metrics::ref_duration, &num_ref_speakers>)
+      .def_property("ref_miss",
+                    &get_speaker_array<&spyder::Metrics::ref_miss, &spyder::Metrics::ref_speakers>,
+                    &set_speaker_array<&spyder::Metrics::ref_miss, &num_ref_speakers>)
+      .def_property("ref_conf",
+                    &get_speaker_array<&spyder::Metrics::ref_conf, &spyder::Metrics::ref_speakers>,
+                    &set_speaker_array<&spyder::Metrics::ref_conf, &num_ref_speakers>)
+      .def_property("ref_jaccard",
+                    &get_speaker_array<&spyder::Metrics::ref_jaccard,
+                                       &spyder::Metrics::ref_speakers>,
+                    &set_speaker_array<&spyder::Metrics::ref_jaccard, &num_ref_speakers>)
+      .def_property("hyp_duration",
+                    &get_speaker_array<&spyder::Metrics::hyp_duration,
+                                       &spyder::Metrics::hyp_speakers>,
+                    &set_speaker_array<&spyder::Metrics::hyp_duration, &num_hyp_speakers>)
+      .def_property("hyp_falarm",
+                    &get_speaker_array<&spyder::Metrics::hyp_falarm,
+                                       &spyder::Metrics::hyp_speakers>,
+                    &set_speaker_array<&spyder::Metrics::hyp_falarm, &num_hyp_speakers>)
+      .def_property("degree_time", &get_degree_array<&spyder::Metrics::degree_time>,
+                    &set_speaker_array<&spyder::Metrics::degree_time, &num_degree_bins>)
+      .def_property("degree_duration", &get_degree_array<&spyder::Metrics::degree_duration>,
+                    &set_speaker_array<&spyder::Metrics::degree_duration, &num_degree_bins>)
+      .def_property("degree_miss", &get_degree_array<&spyder::Metrics::degree_miss>,
+                    &set_speaker_array<&spyder::Metrics::degree_miss, &num_degree_bins>)
+      .def_property("degree_falarm", &get_degree_array<&spyder::Metrics::degree_falarm>,
+                    &set_speaker_array<&spyder::Metrics::degree_falarm, &num_degree_bins>)
+      .def_property("degree_conf", &get_degree_array<&spyder::Metrics::degree_conf>,
+                    &set_speaker_array<&spyder::Metrics::degree_conf, &num_degree_bins>)
+      .def_readonly("timeline", &spyder::Metrics::timeline)
+      .def_readwrite("error_bound", &spyder::Metrics::error_bound)
+      .def_readwrite("duration_bound", &spyder::Metrics::duration_bound)
+      .def_property_readonly("der_lower", &spyder::Metrics::der_lower)
+      .def_property_readonly("der_upper", &spyder::Metrics::der_upper)
+      .def_readwrite("sad_speech", &spyder::Metrics::sad_speech)
+      .def_readwrite("sad_miss", &spyder::Metrics::sad_miss)
+      .def_readwrite("sad_falarm", &spyder::Metrics::sad_falarm)
+      .def_property_readonly("sad_error", &spyder::Metrics::sad_error)
+      .def_readwrite("mapper", &spyder::Metrics::mapper)
+      .def_readwrite("mapping_gap", &spyder::Metrics::mapping_gap);
+
+  m.def("compute_der",
+        py::overload_cast<const spyder::TurnList &, const spyder::TurnList &,
+                          const spyder::TurnList &, std::string, float, bool, int,
+                          std::string>(&spyder::compute_der),
+        py::return_value_policy::reference, py::arg("ref"), py::arg("hyp"), py::arg("uem"),
+        py::pos_only(), py::arg("regions") = "all", py::arg("collar") = 0.0,
+        py::arg("timeline") = false, py::arg("num_threads") = 1, py::arg("mapper") = "hungarian",
+        py::call_guard<py::gil_scoped_release>(), R"doc(Compute DER metrics)doc");
+
+  m.def("compute_der_approx",
+        py::overload_cast<const spyder::TurnList &, const spyder::TurnList &,
+                          const spyder::TurnList &, std::string, float,
+                          double>(&spyder::compute_der_approx),
+        py::arg("ref"), py::arg("hyp"), py::arg("uem"), py::pos_only(), py::arg("regions") = "all",
+        py::arg("collar") = 0.0, py::arg("frame_shift") = 0.1,
+        py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute approximate DER metrics on a frame grid, with bounds on the exact DER)doc");
+
+  m.def("compute_sad",
+        py::overload_cast<const spyder::TurnList &, const spyder::TurnList &,
+                          const spyder::TurnList &, std::string,
+                          float>(&spyder::compute_sad),
+        py::arg("ref"), py::arg("hyp"), py::arg("uem"), py::pos_only(), py::arg("regions") = "all",
+        py::arg("collar") = 0.0, py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute speech activity (SAD) errors only, without a speaker mapping)doc");
+
+  m.def("compute_der_global",
+        py::overload_cast<const std::vector<const spyder::TurnList *> &,
+                          const std::vector<const spyder::TurnList *> &,
+                          const std::vector<const spyder::TurnList *> &, std::string, float, int,
+                          bool, std::string>(&spyder::compute_der_global),
+        py::arg("refs"), py::arg("hyps"), py::arg("uems"), py::arg("regions") = "all",
+        py::arg("collar") = 0.0, py::arg("num_threads") = 0, py::arg("timeline") = false,
+        py::arg("mapper") = "hungarian",
+        py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute DER metrics of a set of recordings with a single speaker mapping)doc");
+
+  m.def("compute_der_multi_ref", &spyder::compute_der_multi_ref, py::arg("refs"), py::arg("hyp"),
+        py::arg("uem"), py::arg("regions") = "all", py::arg("collar") = 0.0,
+        py::arg("num_threads") = 1, py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute DER metrics of a hypothesis against several references)doc");
+
+  py::class_<spyder::BatchMetrics>(m, "BatchMetrics")
+      .def("__len__", &spyder::BatchMetrics::size)
+      .def_readonly("reco_ids", &spyder::BatchMetrics::reco_ids)
+      .def_property_readonly("duration", &get_batch_array<&spyder::BatchMetrics::duration>)
+      .def_property_readonly("miss", &get_batch_array<&spyder::BatchMetrics::miss>)
+      .def_property_readonly("falarm", &get_batch_array<&spyder::BatchMetrics::falarm>)
+      .def_property_readonly("conf", &get_batch_array<&spyder::BatchMetrics::conf>)
+      .def_property_readonly("der", &get_batch_array<&spyder::BatchMetrics::der>)
+      .def_property_readonly("jer", &get_batch_array<&spyder::BatchMetrics::jer>)
+      .def_property_readonly("overall", &spyder::BatchMetrics::overall,
+                             R"doc(Overall metrics of the recordings)doc")
+      .def(
+          "__getitem__",
+          [](const spyder::BatchMetrics &b, py::object key) {
+            // Look up by position, or by recording id.
+            if (py::isinstance<py::str>(key)) {
+              int i = b.find(key.cast<std::string>());
+              if (i == -1) throw py::key_error(key.cast<std::string>());
+              return b.metrics[i];
+            }
+            py::ssize_t i = key.cast<py::ssize_t>();
+            if (i < 0) i += b.size();
+            if (i < 0 || i >= (py::ssize_t)b.size()) throw py::index_error();
+            return b.metrics[i];
+          },
+          py::arg("key"),
+          R"doc(Full metrics (with speaker maps) of a recording, by position or id)doc");
+
+  m.def("compute_der_batch", &spyder::compute_der_batch, py::arg("reco_ids"), py::arg("refs"),
+        py::arg("hyps"), py::arg("uems"), py::arg("regions") = "all", py::arg("collar") = 0.0,
+        py::arg("global_mapping") = false, py::arg("num_threads") = 0,
+        py::arg("mapper") = "hungarian", py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute DER metrics of a set of recordings as a BatchMetrics)doc");
+
+  py::class_<spyder::PairwiseMetrics>(m, "PairwiseMetrics")
+      .def_readonly("reco_ids", &spyder::PairwiseMetrics::reco_ids)
+      .def_readonly("num_systems", &spyder::PairwiseMetrics::num_systems)
+      .def_property_readonly("duration",
+                             &get_pairwise_array<&spyder::PairwiseMetrics::duration, false>)
+      .def_property_readonly("der", &get_pairwise_array<&spyder::PairwiseMetrics::der, false>)
+      .def_property_readonly(
+          "reco_duration", &get_pairwise_array<&spyder::PairwiseMetrics::reco_duration, true>)
+      .def_property_readonly("reco_der",
+                             &get_pairwise_array<&spyder::PairwiseMetrics::reco_der, true>);
+
+  m.def("compute_der_pairwise", &spyder::compute_der_pairwise, py::arg("reco_ids"),
+        py::arg("systems"), py::arg("uems"), py::arg("regions") = "all", py::arg("collar") = 0.0,
+        py::arg("num_threads") = 0, py::arg("per_recording") = false,
+        py::call_guard<py::gil_scoped_release>(),
+        R"doc(Compute the DER between every pair of systems as a PairwiseMetrics)doc");
+
+  // The speaker mapping of the scorers, for a cost matrix given directly. With
+  // `sparse`, only the non-zero costs are kept, and the connected components of
+  // the co-occurrence graph are solved separately, as when scoring.
+  m.def(
+      "solve_assignment",
+      [](py::array_t<double, py::array::c_style | py::array::forcecast> cost, bool sparse,
+         int num_threads) {
+        if (cost.ndim() != 2) throw std::invalid_argument("cost must be a 2-d array");
+        int num_ref = cost.shape(0), num_hyp = cost.shape(1);
+        auto values = cost.unchecked<2>();
+        py::gil_scoped_release release;
+        if (!sparse) {
+          std::vector<std::vector<double>> dense(num_ref, std::vector<double>(num_hyp));
+          for (int i = 0; i < num_ref; ++i)
+            for (int j = 0; j < num_hyp; ++j) dense[i][j] = values(i, j);
+          return spyder::solve_assignment(dense);
+        }
+        std::vector<spyder::CostEntry> entries;
+        for (int i = 0; i < num_ref; ++i)
+          for (int j = 0; j < num_hyp; ++j)
+            if (values(i, j) != 0) entries.push_back(spyder::CostEntry(i, j, values(i, j)));
+        return spyder::solve_sparse_assignment(num_ref, num_hyp, entries, num_threads);
+      },
+      py::arg("cost"), py::arg("sparse") = true, py::arg("num_threads") = 1,
+      R"doc(Minimum-cost assignment of the rows of a cost matrix to its columns (-1 if none))doc");
+
+  py::class_<spyder::ScoringStream>(m, "ScoringStream")
+      .def(py::init<std::string, float, int, int, bool>(), py::arg("regions") = "all",
+           py::arg("collar") = 0.0, py::arg("num_threads") = 0, py::arg("max_pending") = 0,
+           py::arg("keep_results") = false)
+      .def("push", &spyder::ScoringStream::push, py::arg("reco_id"), py::arg("ref"),
+           py::arg("hyp"), py::arg("uem"), py::call_guard<py::gil_scoped_release>(),
+           R"doc(Queue a recording for scoring, blocking while the queue is full)doc")
+      .def("stats", &spyder::ScoringStream::stats,
+           R"doc(Running corpus metrics over the recordings scored so far)doc")
+      .def_property_readonly("num_scored", &spyder::ScoringStream::num_scored)
+      .def_property_readonly("num_pending", &spyder::ScoringStream::num_pending)
+      .def("pop_results", &spyder::ScoringStream::pop_results,
+           R"doc(Results of the recordings scored since the last call)doc")
+      .def("close", &spyder::ScoringStream::close, py::call_guard<py::gil_scoped_release>(),
+           R"doc(Wait until all queued recordings are scored)doc");
+
+  py::class_<spyder::ScoringPool>(m, "ScoringPool")
+      .def(py::init<int>(), py::arg("num_threads") = 0)
+      .def("submit", &spyder::ScoringPool::submit, py::arg("ref"), py::arg("hyp"), py::arg("uem"),
+           py::arg("regions") = "all", py::arg("collar") = 0.0,
+           py::call_guard<py::gil_scoped_release>(),
+           R"doc(Queue a recording for scoring, and return its job id)doc")
+      .def("cancel", &spyder::ScoringPool::cancel, py::arg("job"),
+           R"doc(Remove a job from the queue if it has not started yet)doc")
+      .def(
+          "pop_results",
+          [](spyder::ScoringPool &pool) {
+            py::list results;
+            for (auto &result : pool.pop_results()) {
+              if (result.error.empty())
+                results.append(py::make_tuple(result.job, std::move(result.metrics), py::none()));
+              else
+                results.append(py::make_tuple(result.job, py::none(), result.error));
+            }
+            return results;
+          },
+          R"doc(Results of the jobs completed since the last call, as (job, metrics, error))doc")
+      .def_property_readonly("notify_fd", &spyder::ScoringPool::notify_fd)
+      .def_property_readonly("num_pending", &spyder::ScoringPool::num_pending);
+
+  py::class_<spyder::ScoringSession>(m, "ScoringSession")
+      .def(py::init<const spyder::TurnList &, const spyder::TurnList &, const spyder::TurnList &,
+                    std::string, float>(),
+           py::arg("ref"), py::arg("hyp"), py::arg("uem"), py::arg("regions") = "all",
+           py::arg("collar") = 0.0, py::call_guard<py::gil_scoped_release>())
+      .def("insert", &spyder::ScoringSession::insert, py::arg("is_ref"), py::arg("spk"),
+           py::arg("start"), py::arg("end"), R"doc(Add a turn, and return its id)doc")
+      .def("remove", &spyder::ScoringSession::remove, py::arg("id"), R"doc(Remove a turn)doc")
+      .def("move", &spyder::ScoringSession::move, py::arg("id"), py::arg("start"),
+           py::arg("end"), R"doc(Change the start and end times of a turn)doc")
+      .def("relabel", &spyder::ScoringSession::relabel, py::arg("id"), py::arg("spk"),
+           R"doc(Change the speaker label of a turn)doc")
+      .def(
+          "turn",
+          [](const spyder::ScoringSession &session, size_t id) {
+            spyder::Turn turn = session.turn(id);
+            return py::make_tuple(turn.spk, turn.start, turn.end);
+          },
+          py::arg("id"), R"doc(A turn, as (speaker, start, end))doc")
+      .def("metrics", &spyder::ScoringSession::metrics,
+           R"doc(Current metrics of the edited recording)doc")
+      .def_property_readonly("num_solves", &spyder::ScoringSession::num_solves);
+
+  py::class_<spyder::SegmentFile>(m, "SegmentFile")
+      .def(py::init<std::string>(), py::arg("path"))
+      .def("__len__", &spyder::SegmentFile::size)
+      .def_property_readonly("recordings", &spyder::SegmentFile::recordings)
+      .def_property_readonly("num_segments", &spyder::SegmentFile::num_segments)
+      .def_property_readonly("merged", &spyder::SegmentFile::merged);
+
+  m.def("is_segment_file", &spyder::is_segment_file, py::arg("path"),
+        R"doc(Check whether a file is a binary segment file)doc");
+
+  m.def(
+      "read_rttm",
+      [](const std::string &path) {
+        spyder::Corpus corpus;
+        {
+          py::gil_scoped_release release;
+          corpus = spyder::read_rttm(path);
+        }
+        py::dict turns;
+        for (size_t i = 0; i < corpus.size(); ++i) {
+          py::list reco_turns;
+          for (auto &turn : corpus.turns[i])
+            reco_turns.append(py::make_tuple(turn.spk, turn.start, turn.end));
+          turns[py::str(corpus.recordings[i])] = reco_turns;
+        }
+        return turns;
+      },
+      py::arg("path"),
+      R"doc(Read an RTTM file (possibly gzip or zstd compressed) into a dict of turns)doc");
+
+  m.def(
+      "read_uem",
+      [](const std::string &path) {
+        spyder::Corpus corpus;
+        {
+          py::gil_scoped_release release;
+          corpus = spyder::read_uem(path);
+        }
+        py::dict turns;
+        for (size_t i = 0; i < corpus.size(); ++i) {
+          py::list reco_turns;
+          for (auto &turn : corpus.turns[i])
+            reco_turns.append(py::make_tuple(turn.start, turn.end));
+          turns[py::str(corpus.recordings[i])] = reco_turns;
+        }
+        return turns;
+      },
+      py::arg("path"),
+      R"doc(Read a UEM file (possibly gzip or zstd compressed) into a dict of segments)doc");
+
+  m.def(
+      "rasterize_turns",
+      [](const std::vector<const spyder::TurnList *> &turns, double frame_shift,
+         const std::vector<double> &durations, bool packed, int num_threads) {
+        std::vector<spyder::FrameLabels> labels;
+        {
+          py::gil_scoped_release release;
+          labels = spyder::rasterize_turns(turns, frame_shift, durations, packed, num_threads);
+        }
+        py::list result;
+        for (auto &reco_labels : labels) result.append(labels_to_tuple(std::move(reco_labels)));
+        return result;
+      },
+      py::arg("turns"), py::arg("frame_shift"), py::arg("durations") = std::vector<double>(),
+      py::arg("packed") = false, py::arg("num_threads") = 0,
+      R"doc(Rasterize the turns of each recording into frame-level speaker labels)doc");
+
+  m.def(
+      "rasterize_rttm",
+      [](const std::string &path, double frame_shift,
+         const std::unordered_map<std::string, double> &durations, bool packed,
+         int num_threads) {
+        spyder::Corpus corpus;
+        std::vector<spyder::FrameLabels> labels;
+        {
+          // The turns are parsed and rasterized without going through Python.
+          py::gil_scoped_release release;
+          corpus = spyder::read_rttm(path);
+          std::vector<spyder::TurnList> lists;
+          std::vector<const spyder::TurnList *> turns;
+          std::vector<double> reco_durations;
+          lists.reserve(corpus.size());
+          for (size_t i = 0; i < corpus.size(); ++i) {
+            lists.emplace_back(std::move(corpus.turns[i]));
+            turns.push_back(&lists.back());
+            auto it = durations.find(corpus.recordings[i]);
+            reco_durations.push_back(it == durations.end() ? 0.0 : it->second);
+          }
+          labels = spyder::rasterize_turns(turns, frame_shift, reco_durations, packed, num_threads);
+        }
+        py::dict result;
+        for (size_t i = 0; i < corpus.size(); ++i)
+          result[py::str(corpus.recordings[i])] = labels_to_tuple(std::move(labels[i]));
+        return result;
+      },
+      py::arg("path"), py::arg("frame_shift"),
+      py::arg("durations") = std::unordered_map<std::string, double>(), py::arg("packed") = false,
+      py::arg("num_threads") = 0,
+      R"doc(Read an RTTM file and rasterize each recording into frame-level speaker labels)doc");
+
+  m.def("rttm_to_segment_file", &spyder::rttm_to_segment_file, py::arg("rttm_path"),
+        py::arg("path"), py::arg("merge") = true,
+        py::call_guard<py::gil_scoped_release>(),
+        R"doc(Convert an RTTM file to a binary segment file)doc");
+
+  m.def("segment_file_to_rttm", &spyder::segment_file_to_rttm, py::arg("path"),
+        py::arg("rttm_path"), py::call_guard<py::gil_scoped_release>(),
+        R"doc(Convert a binary segment file to an RTTM file)doc");
 
-  m.def("compute_der", &spyder::compute_der, py::return_value_policy::reference, py::arg("ref"),
-        py::arg("hyp"), py::arg("uem"), py::pos_only(), py::arg("regions") = "all",
-        py::arg("collar") = 0.0, R"doc(Compute DER metrics)doc");
+  m.def(
+      "compute_der_segment_files",
+      [](const spyder::SegmentFile &ref, const spyder::SegmentFile &hyp, py::object uem,
+         bool skip_missing, std::string regions, float collar, bool global_mapping,
+         int num_threads) {
+        spyder::Corpus uem_turns;
+        if (!uem.is_none()) uem_turns = spyder::read_uem(uem.cast<std::string>());
+        py::gil_scoped_release release;
+        return spyder::compute_der(ref, hyp, uem_turns, skip_missing, regions, collar,
+                                   global_mapping, num_threads);
+      },
+      py::arg("ref"), py::arg("hyp"), py::arg("uem") = py::none(), py::arg("skip_missing") = false,
+      py::arg("regions") = "all", py::arg("collar") = 0.0, py::arg("global_mapping") = false,
+      py::arg("num_threads") = 0,
+      R"doc(Compute per-recording DER metrics between two segment files)doc");
 }
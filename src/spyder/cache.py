@@ -0,0 +1,176 @@
+"""
+On-disk cache of per-recording DER results.
+
+Results are keyed on a hash of the reference, hypothesis and UEM turns of a
+recording together with the scoring options (regions and collar), so that a
+recording is only rescored when one of them changes. Entries are stored in a
+SQLite database inside the cache directory, and the least recently used
+entries are evicted once the cache grows beyond its size cap.
+"""
+import hashlib
+import json
+import os
+import sqlite3
+import time
+
+import numpy as np
+
+from _spyder import Metrics
+
+__all__ = ["ResultCache", "encode_metrics", "decode_metrics"]
+
+# Speaker-level breakdown stored with the scalar metrics.
+_SPEAKER_FIELDS = (
+    "ref_speakers",
+    "hyp_speakers",
+    "overlap",
+    "ref_duration",
+    "ref_miss",
+    "ref_conf",
+    "ref_jaccard",
+    "hyp_duration",
+    "hyp_falarm",
+)
+
+# Breakdown of the errors by overlap degree, stored as flat lists.
+_DEGREE_FIELDS = (
+    "degree_time",
+    "degree_duration",
+    "degree_miss",
+    "degree_falarm",
+    "degree_conf",
+)
+
+# Speaker-agnostic speech activity errors, in seconds.
+_SAD_FIELDS = ("sad_speech", "sad_miss", "sad_falarm")
+
+# Bump this whenever a change to the scoring invalidates cached results.
+CACHE_VERSION = 5
+
+
+def encode_metrics(metrics):
+    """
+    Convert metrics (a Metrics or DERMetrics object) to a JSON-serializable dict.
+    """
+    value = {
+        "duration": metrics.duration,
+        "miss": metrics.miss,
+        "falarm": metrics.falarm,
+        "conf": metrics.conf,
+        "jer": metrics.jer,
+        "ref_map": metrics.ref_map,
+        "hyp_map": metrics.hyp_map,
+    }
+    for field in _SAD_FIELDS:
+        value[field] = getattr(metrics, field)
+    for field in _SPEAKER_FIELDS + _DEGREE_FIELDS:
+        value[field] = np.asarray(getattr(metrics, field)).ravel().tolist()
+    return value
+
+
+def decode_metrics(value):
+    """
+    Convert a dict built by encode_metrics back to a Metrics object.
+    """
+    metrics = Metrics(value["duration"], value["miss"], value["falarm"], value["conf"])
+    metrics.ref_map = value["ref_map"]
+    metrics.hyp_map = value["hyp_map"]
+    metrics.jer = value["jer"]
+    for field in _SAD_FIELDS:
+        setattr(metrics, field, value[field])
+    for field in _SPEAKER_FIELDS + _DEGREE_FIELDS:
+        setattr(metrics, field, value[field])
+    return metrics
+
+
+class ResultCache:
+    """
+    Persistent content-addressed cache of DER metrics.
+
+    Args:
+        cache_dir (str): Directory holding the cache. Created if it does not exist.
+        max_size (int): Size cap of the cache in bytes. Least recently used entries
+            are evicted when the cache is closed and exceeds this size.
+    """
+
+    def __init__(self, cache_dir, max_size=1 << 30):
+        os.makedirs(cache_dir, exist_ok=True)
+        self.max_size = max_size
+        self.db = sqlite3.connect(os.path.join(cache_dir, "results.db"), timeout=60)
+        self.db.execute(
+            "CREATE TABLE IF NOT EXISTS results ("
+            "key TEXT PRIMARY KEY, value TEXT NOT NULL, "
+            "size INTEGER NOT NULL, last_access REAL NOT NULL)"
+        )
+        self.db.execute(
+            "CREATE INDEX IF NOT EXISTS results_last_access ON results (last_access)"
+        )
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    @staticmethod
+    def key(ref, hyp, uem, regions="all", collar=0.0):
+        """
+        Compute the cache key of a recording from its turns and scoring options.
+        """
+        h = hashlib.blake2b(digest_size=20)
+        h.update(repr((CACHE_VERSION, regions, float(collar))).encode())
+        for turns in (ref, hyp, uem):
+            h.update(b"\0")
+            for turn in turns:
+                h.update(repr(tuple(turn)).encode())
+        return h.hexdigest()
+
+    def get(self, key):
+        """
+        Return the cached metrics for a key, or None if it is not in the cache.
+        """
+        row = self.db.execute(
+            "SELECT value FROM results WHERE key = ?", (key,)
+        ).fetchone()
+        if row is None:
+            return None
+        self.db.execute(
+            "UPDATE results SET last_access = ? WHERE key = ?", (time.time(), key)
+        )
+        return decode_metrics(json.loads(row[0]))
+
+    def put(self, key, metrics):
+        """
+        Store the metrics (a Metrics or DERMetrics object) for a key.
+        """
+        value = json.dumps(encode_metrics(metrics))
+        self.db.execute(
+            "INSERT OR REPLACE INTO results VALUES (?, ?, ?, ?)",
+            (key, value, len(key) + len(value), time.time()),
+        )
+
+    def evict(self):
+        """
+        Evict least recently used entries until the cache fits in its size cap.
+        """
+        total = self.db.execute(
+            "SELECT COALESCE(SUM(size), 0) FROM results"
+        ).fetchone()[0]
+        if total <= self.max_size:
+            return
+        rows = self.db.execute("SELECT key, size FROM results ORDER BY last_access")
+        evicted = []
+        for key, size in rows:
+            if total <= self.max_size:
+                break
+            evicted.append((key,))
+            total -= size
+        self.db.executemany("DELETE FROM results WHERE key = ?", evicted)
+
+    def close(self):
+        """
+        Evict entries over the size cap and write all changes to disk.
+        """
+        self.evict()
+        self.db.commit()
+        self.db.close()
@@ -29,12 +29,12 @@
 #include <cmath>
 #include <iostream>
 #include <map>
+#include <numeric>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
-#include "GroupBy.h"
 #include "float.h"
 
 namespace spyder {
@@ -63,36 +63,24 @@ TurnList::~TurnList() {
 }
 
 void TurnList::merge_same_speaker_turns() {
-  std::vector<Turn> new_turns;
-  // Group the list of turns by speaker
-  std::map<std::string, std::vector<Turn>> const turns_by_speaker =
-      groupBy(turns.begin(), turns.end(), [](Turn const &t) { return t.spk; });
-  for (auto &it : turns_by_speaker) {
-    std::vector<Turn> spk_turns = it.second;
-    // Sort the turns by start time
-    std::sort(spk_turns.begin(), spk_turns.end());
-    // Merge overlapping intervals in interval tree
-    std::vector<Turn> merged_turns;
-    double prev_end = -1;
-    for (auto &turn : spk_turns) {
-      if (prev_end < 0) {
-        prev_end = turn.end;
-        merged_turns.push_back(turn);
-      } else {
-        if (turn.start <= prev_end) {
-          prev_end = std::max(prev_end, turn.end);
-          merged_turns.back().end = prev_end;
-        } else {
-          prev_end = turn.end;
-          merged_turns.push_back(turn);
-        }
-      }
+  auto by_speaker = [](const Turn &a, const Turn &b) {
+    int order = a.spk.compare(b.spk);
+    return (order != 0) ? (order < 0) : (a.start < b.start);
+  };
+  // Sort the turns by speaker and start time, unless they already are.
+  if (!std::is_sorted(turns.begin(), turns.end(), by_speaker))
+    std::sort(turns.begin(), turns.end(), by_speaker);
+  // Merge overlapping turns of the same speaker in place. Merged turns are
+  // compacted at the front of the list, and `last` is the one being extended.
+  size_t last = 0;
+  for (size_t i = 1; i < turns.size(); ++i) {
+    if (turns[i].spk == turns[last].spk && turns[i].start <= turns[last].end) {
+      turns[last].end = std::max(turns[last].end, turns[i].end);
+    } else if (++last != i) {
+      turns[last] = std::move(turns[i]);
     }
-    // Add merged turns to new list
-    new_turns.insert(new_turns.end(), merged_turns.begin(), merged_turns.end());
   }
-  // Replace the old list with the new list
-  turns.swap(new_turns);
+  if (!turns.empty()) turns.erase(turns.begin() + last + 1, turns.end());
 }
 
 void TurnList::build_speaker_index() {
@@ -111,13 +99,65 @@ void TurnList::build_speaker_index() {
 
 int TurnList::size() { return turns.size(); }
 
-void TurnList::map_labels(std::map<std::string, std::string> &label_map) {
-  std::string old_label, new_label;
+Segments TurnList::to_segments() const {
+  Segments segments;
+  segments.start.reserve(turns.size());
+  segments.end.reserve(turns.size());
+  segments.spk.reserve(turns.size());
   for (auto &turn : turns) {
-    old_label = turn.spk;
-    new_label = label_map.find(old_label)->second;
-    turn.spk = new_label;
+    auto it = forward_index.find(turn.spk);
+    segments.push_back(turn.start, turn.end, it == forward_index.end() ? 0 : it->second);
   }
+  for (auto &it : reverse_index) segments.speakers.push_back(it.second);
+  return segments;
+}
+
+Segments TurnList::merged_segments(bool index_speakers) const {
+  // Visit the turns by speaker and start time, as merge_same_speaker_turns
+  // sorts them, through a permutation so that the list itself is untouched.
+  auto by_speaker = [this](size_t a, size_t b) {
+    int order = turns[a].spk.compare(turns[b].spk);
+    return (order != 0) ? (order < 0) : (turns[a].start < turns[b].start);
+  };
+  std::vector<size_t> order(turns.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (!std::is_sorted(order.begin(), order.end(), by_speaker))
+    std::sort(order.begin(), order.end(), by_speaker);
+
+  // Overlapping turns of the same speaker extend the last segment. Speakers
+  // come in sorted order, so their indices match build_speaker_index.
+  Segments segments;
+  segments.start.reserve(turns.size());
+  segments.end.reserve(turns.size());
+  segments.spk.reserve(turns.size());
+  const std::string *spk = nullptr;
+  for (size_t i : order) {
+    const Turn &turn = turns[i];
+    bool same_speaker = spk != nullptr && turn.spk == *spk;
+    if (same_speaker && turn.start <= segments.end.back()) {
+      segments.end.back() = std::max(segments.end.back(), turn.end);
+      continue;
+    }
+    if (!same_speaker) {
+      spk = &turn.spk;
+      if (index_speakers) segments.speakers.push_back(turn.spk);
+    }
+    segments.push_back(turn.start, turn.end, index_speakers ? segments.speakers.size() - 1 : 0);
+  }
+  return segments;
+}
+
+void Segments::push_back(double start_, double end_, int spk_) {
+  start.push_back(start_);
+  end.push_back(end_);
+  spk.push_back(spk_);
+}
+
+size_t Segments::size() const { return start.size(); }
+
+SegmentView Segments::view() const {
+  return SegmentView(start.data(), end.data(), spk.data(), start.size(),
+                     speakers.empty() ? nullptr : speakers.data(), speakers.size());
 }
 
 bool Token::operator<(const Token &other) const {
@@ -125,35 +165,18 @@ bool Token::operator<(const Token &other) const {
     // case 1: timestamps are different
     return (timestamp < other.timestamp);
   } else if (type != other.type) {
-    // case 2: timestamps are same but types are different
-    return (type.compare(other.type) < 0);
+    // case 2: timestamps are same but types are different ("end" < "start")
+    return (type < other.type);
   } else {
     // case 3: timestamps and types are same, but system is different
-    if (type == START) {
+    if (type == START_TOKEN) {
       // case 3a: start token -> UEM < ref < hyp
-      return (system.compare(other.system) > 0);
+      return (system > other.system);
     } else {
       // case 3b: end token -> hyp < ref < UEM
-      return (system.compare(other.system) < 0);
-    }
-  }
-}
-
-Region::~Region() {
-  std::vector<std::string>().swap(ref_spk);
-  std::vector<std::string>().swap(hyp_spk);
-}
-
-double Region::duration() { return (end - start); }
-
-int Region::num_correct() {
-  int N_correct = 0;
-  for (auto &ref : ref_spk) {
-    if (std::count(hyp_spk.begin(), hyp_spk.end(), ref) > 0) {
-      N_correct += 1;
+      return (system < other.system);
     }
   }
-  return N_correct;
 }
 
 }  // end namespace spyder
@@ -30,19 +30,17 @@
 
 namespace spyder {
 
-// Some strings used during DER computation.
-const std::string START = "start";
-const std::string END = "end";
-const std::string REF = "ref";
-const std::string HYP = "hyp";
-const std::string UEM = "uem";
-
 // Strings defining region types to evaluate.
 const std::string ALL = "all";
 const std::string SINGLE = "single";
 const std::string OVERLAP = "overlap";
 const std::string NONOVERLAP = "nonoverlap";
 
+// Strings defining speaker mapping algorithms (see solve_mapping).
+const std::string HUNGARIAN = "hungarian";
+const std::string GREEDY = "greedy";
+const std::string AUCTION = "auction";
+
 // Stores speaker turns as provided in the input reference and hypothesis.
 class Turn {
  public:
@@ -55,6 +53,50 @@ class Turn {
   bool operator<(const Turn &other) const;
 };
 
+// A read-only columnar view over the turns of a single recording. Turns are
+// stored as parallel arrays of start times, end times and speaker indices,
+// where each index refers to an entry of `speakers`. The view does not own
+// any memory; it may point into a `Segments` buffer or into a memory-mapped
+// segment file (see segment_file.h).
+class SegmentView {
+ public:
+  const double *start;
+  const double *end;
+  const int *spk;
+  size_t size;
+  // speaker labels, indexed by the values in `spk` (may be null for UEM)
+  const std::string *speakers;
+  int num_speakers;
+  SegmentView()
+      : start(nullptr), end(nullptr), spk(nullptr), size(0), speakers(nullptr), num_speakers(0) {}
+  SegmentView(const double *start, const double *end, const int *spk, size_t size,
+              const std::string *speakers, int num_speakers)
+      : start(start),
+        end(end),
+        spk(spk),
+        size(size),
+        speakers(speakers),
+        num_speakers(num_speakers) {}
+};
+
+// Owning columnar storage for the turns of a single recording.
+class Segments {
+ public:
+  std::vector<double> start;
+  std::vector<double> end;
+  std::vector<int> spk;
+  std::vector<std::string> speakers;
+
+  void push_back(double start, double end, int spk);
+
+  // Returns total number of segments
+  size_t size() const;
+
+  // Returns a view over the segments. The view is invalidated if the
+  // segments are modified.
+  SegmentView view() const;
+};
+
 class TurnList {
  private:
   // check input (used in constructor)
@@ -76,7 +118,8 @@ class TurnList {
   TurnList(std::vector<Turn> turns);
   ~TurnList();
 
-  // Merge overlapping turns from the same speaker in the list of turns.
+  // Merge overlapping turns from the same speaker in the list of turns. The
+  // turns are merged in place, and end up sorted by speaker and start time.
   void merge_same_speaker_turns();
 
   // Build index of speakers. Each speaker is mapped to a natural number, i.e.,
@@ -87,21 +130,35 @@ class TurnList {
   // Returns total number of turns
   int size();
 
-  // map speaker labels using provided mapping
-  // \param label_map, a mapping from old label to new label
-  void map_labels(std::map<std::string, std::string> &label_map);
+  // Convert the turns to columnar segments. Speakers are encoded with the
+  // speaker index, so build_speaker_index() must be called first. If the index
+  // has not been built (e.g. for UEM turns), all segments get speaker 0.
+  Segments to_segments() const;
+
+  // Convert the turns to columnar segments with same-speaker turns merged and
+  // speakers indexed, as merge_same_speaker_turns, build_speaker_index and
+  // to_segments would, but without modifying the list, so that a list can be
+  // scored by several threads at once.
+  // \param index_speakers: whether to index the speakers. If not (e.g. for UEM
+  //   turns), all segments get speaker 0, as with to_segments.
+  Segments merged_segments(bool index_speakers = true) const;
 };
 
+// Token types and systems. The numeric values define the order of tokens
+// that share the same timestamp (see Token::operator<).
+enum TokenType { END_TOKEN = 0, START_TOKEN = 1 };
+enum TokenSystem { HYP_TOKEN = 0, REF_TOKEN = 1, UEM_TOKEN = 2 };
+
 // Denotes a timestamp (or boundary marker).
 class Token {
  public:
-  std::string type;
-  std::string system;
-  std::string spk;
   double timestamp;
+  int type;
+  int system;
+  int spk;
   Token() {}
-  Token(std::string type, std::string system, std::string spk, double timestamp)
-      : type(type), system(system), spk(spk), timestamp(timestamp) {}
+  Token(int type, int system, int spk, double timestamp)
+      : timestamp(timestamp), type(type), system(system), spk(spk) {}
   ~Token() {}
 
   // Overload less than operator to enable sorting on timestamp, type, and system.
@@ -113,26 +170,6 @@ class Token {
   bool operator<(const Token &other) const;
 };
 
-// Each "region" is a homogeneous segment, i.e., no speaker change happens
-// within a region, in either the reference or the hypothesis.
-class Region {
- public:
-  double start;
-  double end;
-  std::vector<std::string> ref_spk;
-  std::vector<std::string> hyp_spk;
-  Region(double start, double end, std::vector<std::string> ref_spk,
-         std::vector<std::string> hyp_spk)
-      : start(start), end(end), ref_spk(ref_spk), hyp_spk(hyp_spk) {}
-  ~Region();
-
-  // region duration
-  double duration();
-
-  // number of correct speakers in region
-  int num_correct();
-};
-
 }  // end namespace spyder
 
 #endif
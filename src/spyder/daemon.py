@@ -0,0 +1,388 @@
+"""
+Long-lived scoring daemon.
+
+The daemon listens on a Unix domain socket and scores DER jobs for clients on
+the same machine, which saves the Python import, extension load and RTTM
+parsing of each call. Files given by path are parsed once and kept in memory,
+keyed on their path and modification time, and jobs are run on a shared pool
+of worker threads (the native scoring releases the GIL).
+
+Messages are JSON objects, one per line, in both directions. A request has an
+"op" field: "ping" returns the daemon status, and "score" scores `ref` against
+`hyp` (and `uem`), each given either as the path of an RTTM (UEM) file or as
+turns, with the same options as DER(). Responses have an "ok" field, and either
+the results or an "error" message.
+"""
+import json
+import os
+import socket
+import socketserver
+import stat
+import tempfile
+import threading
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
+import click
+
+from .cache import decode_metrics, encode_metrics
+from .der import (
+    DERMetrics,
+    _DER_any,
+    _summarize,
+    get_uem_turns,
+    read_rttm_turns,
+    read_uem_turns,
+)
+
+__all__ = ["ScoringDaemon", "DaemonClient", "connect_daemon", "default_socket_path"]
+
+
+def default_socket_path():
+    """
+    Socket path of the daemon: $SPYDER_DAEMON if it is set, otherwise a path in
+    $XDG_RUNTIME_DIR, or in a per-user directory (mode 0700) of the temporary
+    directory.
+    """
+    path = os.environ.get("SPYDER_DAEMON")
+    if path:
+        return path
+    runtime_dir = os.environ.get("XDG_RUNTIME_DIR")
+    if runtime_dir:
+        return os.path.join(runtime_dir, "spyder.sock")
+    return os.path.join(_private_socket_dir(), "daemon.sock")
+
+
+def _private_socket_dir():
+    return os.path.join(tempfile.gettempdir(), f"spyder-{os.getuid()}")
+
+
+def _owned_by_user(path, kind):
+    """
+    Whether `path` is a file of type `kind` (e.g. stat.S_ISSOCK) owned by the
+    current user, so that clients never send their data to another user's socket.
+    """
+    try:
+        st = os.lstat(path)
+    except OSError:
+        return False
+    return kind(st.st_mode) and st.st_uid == os.getuid()
+
+
+def _make_private_socket_dir():
+    """
+    Create the per-user socket directory in the temporary directory, readable by
+    the current user only. Another user may have created it first, so an existing
+    directory must be owned by the current user.
+    """
+    dirname = _private_socket_dir()
+    try:
+        os.mkdir(dirname, 0o700)
+    except FileExistsError:
+        if not _owned_by_user(dirname, stat.S_ISDIR):
+            raise RuntimeError(
+                f"{dirname} is not a directory owned by the current user"
+            )
+
+
+class _FileCache:
+    """
+    Parsed RTTM and UEM files, keyed on path and modification time, with least
+    recently used files evicted beyond `max_files`.
+    """
+
+    def __init__(self, max_files=64):
+        self.max_files = max_files
+        self.files = OrderedDict()
+        self.lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    def get(self, path, parse):
+        stat = os.stat(path)
+        key = (path, parse.__name__, stat.st_mtime_ns, stat.st_size)
+        with self.lock:
+            if key in self.files:
+                self.files.move_to_end(key)
+                self.hits += 1
+                return self.files[key]
+        turns = parse(path)
+        with self.lock:
+            self.misses += 1
+            self.files[key] = turns
+            while len(self.files) > self.max_files:
+                self.files.popitem(last=False)
+        return turns
+
+
+class _Handler(socketserver.StreamRequestHandler):
+    def handle(self):
+        for line in self.rfile:
+            try:
+                response = self.server.process(json.loads(line))
+            except Exception as e:
+                response = {"ok": False, "error": f"{type(e).__name__}: {e}"}
+            self.wfile.write(json.dumps(response).encode() + b"\n")
+            self.wfile.flush()
+
+
+class ScoringDaemon(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    """
+    Scoring server on a Unix domain socket. Each connection is served by its own
+    thread, and the scoring jobs of all connections run on a shared pool of
+    `num_workers` threads.
+
+    Args:
+        path (str): Socket path (see default_socket_path).
+        num_workers (int): Number of worker threads (0 means all available cores).
+        max_cached_files (int): Number of parsed files kept in memory.
+    """
+
+    daemon_threads = True
+
+    def __init__(self, path=None, num_workers=0, max_cached_files=64):
+        self.path = path or default_socket_path()
+        if os.path.dirname(self.path) == _private_socket_dir():
+            _make_private_socket_dir()
+        if os.path.lexists(self.path):
+            if connect_daemon(self.path) is not None:
+                raise RuntimeError(f"A daemon is already listening on {self.path}")
+            os.unlink(self.path)
+        self.pool = ThreadPoolExecutor(num_workers or os.cpu_count())
+        self.files = _FileCache(max_cached_files)
+        self.num_jobs = 0
+        self.lock = threading.Lock()
+        # Only the current user may connect.
+        umask = os.umask(0o077)
+        try:
+            super().__init__(self.path, _Handler)
+        finally:
+            os.umask(umask)
+
+    def process(self, request):
+        op = request.get("op", "score")
+        if op == "ping":
+            return {
+                "ok": True,
+                "num_jobs": self.num_jobs,
+                "cached_files": len(self.files.files),
+                "cache_hits": self.files.hits,
+                "cache_misses": self.files.misses,
+            }
+        if op == "score":
+            return {"ok": True, **self.pool.submit(self._score, request).result()}
+        raise ValueError(f"Unknown op: {op}")
+
+    def _load(self, turns, parse):
+        if isinstance(turns, str):
+            # Scoring may add missing recordings to the dict, so it gets a copy.
+            return dict(self.files.get(turns, parse))
+        if isinstance(turns, dict):
+            return {reco_id: [tuple(t) for t in v] for reco_id, v in turns.items()}
+        return [tuple(t) for t in turns]
+
+    def _score(self, request):
+        with self.lock:
+            self.num_jobs += 1
+        ref = self._load(request["ref"], read_rttm_turns)
+        hyp = self._load(request["hyp"], read_rttm_turns)
+        uem = request.get("uem")
+        uem = (
+            get_uem_turns(ref, hyp) if uem is None else self._load(uem, read_uem_turns)
+        )
+        # Per-recording results are always returned, and summarized by the client.
+        metrics = _DER_any(
+            ref,
+            hyp,
+            uem,
+            True,
+            request.get("skip_missing", False),
+            request.get("regions", "all"),
+            request.get("collar", 0.0),
+            False,
+            False,
+            None,
+            request.get("global_mapping", False),
+            False,
+            request.get("num_threads", 1),
+        )
+        if isinstance(metrics, dict):
+            metrics.pop("Overall")
+            return {
+                "results": [
+                    [reco_id, encode_metrics(m)] for reco_id, m in metrics.items()
+                ]
+            }
+        return {"metrics": encode_metrics(metrics)}
+
+    def server_close(self):
+        super().server_close()
+        self.pool.shutdown()
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+
+
+class DaemonClient:
+    """
+    Client of a running ScoringDaemon.
+
+    Args:
+        path (str): Socket path (see default_socket_path).
+        timeout (float): Socket timeout in seconds (None means no timeout).
+    """
+
+    def __init__(self, path=None, timeout=None):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(timeout)
+        try:
+            self.sock.connect(path or default_socket_path())
+        except OSError:
+            self.sock.close()
+            raise
+        self.file = self.sock.makefile("rwb")
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def request(self, message):
+        self.file.write(json.dumps(message).encode() + b"\n")
+        self.file.flush()
+        line = self.file.readline()
+        if not line:
+            raise ConnectionError("The daemon closed the connection")
+        response = json.loads(line)
+        if not response.pop("ok"):
+            raise RuntimeError(response["error"])
+        return response
+
+    def ping(self):
+        """
+        Return the daemon status (number of jobs and file cache statistics).
+        """
+        return self.request({"op": "ping"})
+
+    def score(
+        self,
+        ref,
+        hyp,
+        uem=None,
+        per_file=False,
+        skip_missing=False,
+        regions="all",
+        collar=0.0,
+        print_speaker_map=False,
+        verbose=False,
+        global_mapping=False,
+        num_threads=1,
+    ):
+        """
+        Compute DER on the daemon, with the same inputs and results as DER(). The
+        inputs are either paths of RTTM (UEM) files, which the daemon parses and
+        caches, or turns (dict of recording id to list of turns, or list of turns
+        of a single recording).
+        """
+        response = self.request(
+            {
+                "op": "score",
+                "ref": _encode_turns(ref),
+                "hyp": _encode_turns(hyp),
+                "uem": None if uem is None else _encode_turns(uem),
+                "skip_missing": skip_missing,
+                "regions": regions,
+                "collar": collar,
+                "global_mapping": global_mapping,
+                "num_threads": num_threads,
+            }
+        )
+        if "metrics" in response:
+            metrics = DERMetrics(decode_metrics(response["metrics"]))
+            if verbose:
+                print(metrics)
+            return metrics
+        results = {
+            reco_id: DERMetrics(decode_metrics(m)) for reco_id, m in response["results"]
+        }
+        return _summarize(
+            results, per_file, regions, print_speaker_map, verbose, global_mapping
+        )
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
+
+
+def _encode_turns(turns):
+    if isinstance(turns, str):
+        # The daemon may run in another directory.
+        return os.path.abspath(turns)
+
+    def encode(turn):
+        return [turn[0] if isinstance(turn[0], str) else float(turn[0])] + [
+            float(x) for x in turn[1:]
+        ]
+
+    if isinstance(turns, dict):
+        return {reco_id: [encode(turn) for turn in v] for reco_id, v in turns.items()}
+    return [encode(turn) for turn in turns]
+
+
+def connect_daemon(path=None, timeout=None):
+    """
+    Connect to the daemon listening on `path`, or return None if none is running.
+    The socket must be owned by the current user.
+    """
+    path = path or default_socket_path()
+    if not _owned_by_user(path, stat.S_ISSOCK):
+        return None
+    try:
+        client = DaemonClient(path, timeout)
+    except OSError:
+        return None
+    try:
+        client.ping()
+    except (OSError, ValueError, RuntimeError):
+        client.close()
+        return None
+    return client
+
+
+@click.command()
+@click.option(
+    "--socket",
+    "socket_path",
+    type=click.Path(),
+    default=None,
+    help="Socket path. Default: $SPYDER_DAEMON, or a path in $XDG_RUNTIME_DIR, or in "
+    "a per-user directory of the temporary directory.",
+)
+@click.option(
+    "--num-workers",
+    "-j",
+    type=click.IntRange(min=0),
+    default=0,
+    show_default=True,
+    help="Number of worker threads (0 means all available cores).",
+)
+@click.option(
+    "--max-cached-files",
+    type=click.IntRange(min=0),
+    default=64,
+    show_default=True,
+    help="Number of parsed RTTM/UEM files kept in memory.",
+)
+def run_daemon(socket_path=None, num_workers=0, max_cached_files=64):
+    """
+    Run the scoring daemon until interrupted. DER() uses it transparently while
+    it is running.
+    """
+    server = ScoringDaemon(socket_path, num_workers, max_cached_files)
+    print(f"Listening on {server.path}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
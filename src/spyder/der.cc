@@ -26,38 +26,204 @@
 #include "der.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <numeric>
 #include <set>
+#include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "assignment.h"
 #include "float.h"
-#include "hungarian.h"
+#include "frame_grid.h"
+#include "parallel.h"
 
 namespace spyder {
 
-void compute_der_mapped(std::vector<Region> &score_regions, Metrics &metrics,
-                        std::string region_type) {
-  double miss = 0, falarm = 0, conf = 0, total_dur = 0, scored_dur = 0, dur;
-  int N_ref, N_hyp, N_correct;
-  for (auto &region : score_regions) {
-    dur = region.duration();
-    N_ref = region.ref_spk.size();
-    N_hyp = region.hyp_spk.size();
-    if (!(region_type == ALL) && !(region_type == SINGLE && N_ref == 1) &&
-        !(region_type == NONOVERLAP && N_ref <= 1) && !(region_type == OVERLAP && N_ref > 1))
-      continue;
-    N_correct = region.num_correct();
-    miss += dur * (std::max(0, N_ref - N_hyp));
-    falarm += dur * (std::max(0, N_hyp - N_ref));
-    conf += dur * (std::min(N_ref, N_hyp) - N_correct);
-    total_dur += dur * N_ref;
-    scored_dur += dur;
-  }
-  // free up memory
-  std::vector<Region>().swap(score_regions);
-
-  metrics.duration = total_dur;
+// Reset the error totals and size the speaker-level breakdown.
+static void init_errors(Metrics &metrics, int num_ref, int num_hyp) {
+  metrics.duration = metrics.miss = metrics.falarm = metrics.conf = 0;
+  metrics.sad_speech = metrics.sad_miss = metrics.sad_falarm = 0;
+  metrics.overlap.assign((size_t)num_ref * num_hyp, 0.0);
+  metrics.ref_duration.assign(num_ref, 0.0);
+  metrics.ref_miss.assign(num_ref, 0.0);
+  metrics.ref_conf.assign(num_ref, 0.0);
+  metrics.hyp_duration.assign(num_hyp, 0.0);
+  metrics.hyp_falarm.assign(num_hyp, 0.0);
+  for (auto degree : {&Metrics::degree_time, &Metrics::degree_duration, &Metrics::degree_miss,
+                      &Metrics::degree_falarm, &Metrics::degree_conf})
+    (metrics.*degree).assign(DEGREE_BINS, 0.0);
+}
+
+// Add the errors of a region with N_ref reference and N_hyp hypothesis
+// speakers to the overlap degree breakdown.
+static void add_degree_errors(Metrics &metrics, int N_ref, int N_hyp, double dur, double miss,
+                              double falarm, double conf) {
+  size_t bin = std::min(N_ref, MAX_DEGREE) * (MAX_DEGREE + 1) + std::min(N_hyp, MAX_DEGREE);
+  metrics.degree_time[bin] += dur;
+  metrics.degree_duration[bin] += dur * N_ref;
+  metrics.degree_miss[bin] += miss;
+  metrics.degree_falarm[bin] += falarm;
+  metrics.degree_conf[bin] += conf;
+}
+
+// Add a region with N_ref reference and N_hyp hypothesis speakers to the
+// speech activity errors.
+static void add_sad_errors(Metrics &metrics, int N_ref, int N_hyp, double dur) {
+  if (N_ref > 0) metrics.sad_speech += dur;
+  if (N_ref > 0 && N_hyp == 0) metrics.sad_miss += dur;
+  if (N_ref == 0 && N_hyp > 0) metrics.sad_falarm += dur;
+}
+
+// Selects the regions of a region type by their number of reference speakers.
+class RegionFilter {
+ public:
+  explicit RegionFilter(const std::string &region_type)
+      : score_all(region_type == ALL),
+        score_single(region_type == SINGLE),
+        score_nonoverlap(region_type == NONOVERLAP),
+        score_overlap(region_type == OVERLAP) {}
+
+  bool operator()(int N_ref) const {
+    return score_all || (score_single && N_ref == 1) || (score_nonoverlap && N_ref <= 1) ||
+           (score_overlap && N_ref > 1);
+  }
+
+ private:
+  bool score_all, score_single, score_nonoverlap, score_overlap;
+};
+
+// Region visitor which accumulates the errors of the scored regions into
+// `metrics`. The totals are kept in seconds until finalize_errors() is called.
+// The speaker-level breakdown is filled in the same pass. Within a region,
+// missed and confused speech are shared equally by the reference speakers
+// whose assigned hypothesis speaker is not active, and false alarm by the
+// hypothesis speakers that are not assigned to an active reference speaker.
+class ErrorAccumulator {
+ public:
+  ErrorAccumulator(const std::vector<int> &assignment, int num_hyp, Metrics &metrics,
+                   const std::string &region_type, Timeline *timeline)
+      : assignment(assignment),
+        num_hyp(num_hyp),
+        metrics(metrics),
+        is_scored(region_type),
+        timeline(timeline) {}
+
+  void operator()(double start, double end, const std::vector<int> &ref_spk,
+                  const std::vector<int> &hyp_spk) {
+    int N_ref = ref_spk.size(), N_hyp = hyp_spk.size();
+    if (!is_scored(N_ref)) return;
+    double dur = end - start;
+    int N_correct = 0;
+    for (auto &ref : ref_spk)
+      if (is_matched(ref, hyp_spk)) N_correct += 1;
+    double miss = dur * std::max(0, N_ref - N_hyp);
+    double falarm = dur * std::max(0, N_hyp - N_ref);
+    double conf = dur * (std::min(N_ref, N_hyp) - N_correct);
+    metrics.miss += miss;
+    metrics.falarm += falarm;
+    metrics.conf += conf;
+    metrics.duration += dur * N_ref;
+    add_degree_errors(metrics, N_ref, N_hyp, dur, miss, falarm, conf);
+    add_sad_errors(metrics, N_ref, N_hyp, dur);
+    if (timeline != nullptr)
+      timeline->push_back({start, end, N_ref, N_hyp, N_correct, miss, falarm, conf});
+
+    // Speaker-level breakdown
+    for (auto &ref : ref_spk) {
+      metrics.ref_duration[ref] += dur;
+      for (auto &hyp : hyp_spk) metrics.overlap[(size_t)ref * num_hyp + hyp] += dur;
+    }
+    for (auto &hyp : hyp_spk) metrics.hyp_duration[hyp] += dur;
+    if (N_ref > N_correct) {
+      double ref_miss = dur * std::max(0, N_ref - N_hyp) / (N_ref - N_correct);
+      double ref_conf = dur * (std::min(N_ref, N_hyp) - N_correct) / (N_ref - N_correct);
+      for (auto &ref : ref_spk) {
+        if (is_matched(ref, hyp_spk)) continue;
+        metrics.ref_miss[ref] += ref_miss;
+        metrics.ref_conf[ref] += ref_conf;
+      }
+    }
+    if (N_hyp > N_ref) {
+      double hyp_falarm = dur * (N_hyp - N_ref) / (N_hyp - N_correct);
+      for (auto &hyp : hyp_spk) {
+        bool matched = false;
+        for (auto &ref : ref_spk) matched = matched || assignment[ref] == hyp;
+        if (!matched) metrics.hyp_falarm[hyp] += hyp_falarm;
+      }
+    }
+  }
+
+ private:
+  // Whether the hypothesis speaker mapped to `ref` is active in the region.
+  bool is_matched(int ref, const std::vector<int> &hyp_spk) const {
+    return assignment[ref] != -1 &&
+           std::find(hyp_spk.begin(), hyp_spk.end(), assignment[ref]) != hyp_spk.end();
+  }
+
+  const std::vector<int> &assignment;
+  int num_hyp;
+  Metrics &metrics;
+  RegionFilter is_scored;
+  Timeline *timeline;
+};
+
+// Add the error totals of `part` (in seconds) to `metrics`.
+static void add_errors(Metrics &metrics, const Metrics &part) {
+  metrics.duration += part.duration;
+  metrics.miss += part.miss;
+  metrics.falarm += part.falarm;
+  metrics.conf += part.conf;
+  metrics.sad_speech += part.sad_speech;
+  metrics.sad_miss += part.sad_miss;
+  metrics.sad_falarm += part.sad_falarm;
+  auto add = [](std::vector<double> &a, const std::vector<double> &b) {
+    for (size_t i = 0; i < a.size(); ++i) a[i] += b[i];
+  };
+  add(metrics.overlap, part.overlap);
+  add(metrics.ref_duration, part.ref_duration);
+  add(metrics.ref_miss, part.ref_miss);
+  add(metrics.ref_conf, part.ref_conf);
+  add(metrics.hyp_duration, part.hyp_duration);
+  add(metrics.hyp_falarm, part.hyp_falarm);
+  add(metrics.degree_time, part.degree_time);
+  add(metrics.degree_duration, part.degree_duration);
+  add(metrics.degree_miss, part.degree_miss);
+  add(metrics.degree_falarm, part.degree_falarm);
+  add(metrics.degree_conf, part.degree_conf);
+}
+
+// Turn the accumulated error totals into rates, and compute the JER.
+static void finalize_errors(Metrics &metrics, const std::vector<int> &assignment) {
+  int num_ref = metrics.ref_duration.size(), num_hyp = metrics.hyp_duration.size();
+
+  // The intersection and union of each mapped pair of speakers follow from
+  // the overlap and speaker durations, so JER needs no second sweep.
+  double jer = 0;
+  int num_scored = 0;
+  metrics.ref_jaccard.assign(num_ref, 0.0);
+  for (int ref = 0; ref < num_ref; ++ref) {
+    if (metrics.ref_duration[ref] == 0) continue;
+    int hyp = assignment[ref];
+    if (hyp != -1) {
+      double intersection = metrics.overlap[(size_t)ref * num_hyp + hyp];
+      double union_ = metrics.ref_duration[ref] + metrics.hyp_duration[hyp] - intersection;
+      metrics.ref_jaccard[ref] = intersection / union_;
+    }
+    jer += 1 - metrics.ref_jaccard[ref];
+    num_scored += 1;
+  }
+  metrics.jer = (num_scored == 0) ? 0 : jer / num_scored;
+
+  double total_dur = metrics.duration, miss = metrics.miss, falarm = metrics.falarm,
+         conf = metrics.conf;
   if (total_dur == 0) {
     metrics.miss = 0;
     metrics.falarm = 0;
@@ -69,44 +235,1129 @@ void compute_der_mapped(std::vector<Region> &score_regions, Metrics &metrics,
     metrics.conf = conf / total_dur;
     metrics.der = (miss + falarm + conf) / total_dur;
   }
-  return;
 }
 
-Metrics compute_der(TurnList &ref, TurnList &hyp, TurnList &uem, std::string regions,
-                    float collar) {
-  // Merge overlapping segments from the same speaker.
-  ref.merge_same_speaker_turns();
-  hyp.merge_same_speaker_turns();
-  uem.merge_same_speaker_turns();
+// Map the reference and hypothesis speakers to the same labels, given their
+// accumulated costs, and fill the speaker maps and labels of `metrics`. Most
+// pairs of speakers never co-occur, so we solve the assignment on the sparse
+// co-occurrence graph, one connected component at a time (or approximately,
+// with another mapper).
+static std::vector<int> map_speakers(const CostAccumulator &cost, const SegmentView &ref,
+                                     const SegmentView &hyp, Metrics &metrics,
+                                     const std::string &mapper = HUNGARIAN) {
+  std::vector<int> assignment = solve_mapping(ref.num_speakers, hyp.num_speakers, cost.entries(),
+                                              mapper, metrics.mapping_gap);
+  metrics.mapper = mapper;
 
-  // Obtain the evaluation regions based on the UEM
-  std::vector<Region> eval_regions = get_eval_regions(ref, hyp, uem);
+  build_label_maps(ref, hyp, assignment, metrics.ref_map, metrics.hyp_map);
+  metrics.ref_speakers.assign(ref.speakers, ref.speakers + ref.num_speakers);
+  metrics.hyp_speakers.assign(hyp.speakers, hyp.speakers + hyp.num_speakers);
+  return assignment;
+}
 
-  // Map the reference and hypothesis speakers to the same labels.
-  ref.build_speaker_index();
-  hyp.build_speaker_index();
-  std::vector<std::vector<double>> cost_matrix = build_cost_matrix(ref, hyp, eval_regions);
-  HungarianAlgorithm hungarian_solver;
-  std::vector<int> assignment;
-  double cost = hungarian_solver.Solve(cost_matrix, assignment);
+// Map the speakers on the regions swept from `tokens` (see above).
+static std::vector<int> map_speakers(const std::vector<Token> &tokens, const SegmentView &ref,
+                                     const SegmentView &hyp, Metrics &metrics,
+                                     const std::string &mapper = HUNGARIAN) {
+  CostAccumulator cost(hyp.num_speakers);
+  sweep_regions(tokens, [&cost](double start, double end, const std::vector<int> &ref_spk,
+                                const std::vector<int> &hyp_spk) {
+    cost.add(end - start, ref_spk, hyp_spk);
+  });
+  return map_speakers(cost, ref, hyp, metrics, mapper);
+}
 
-  std::map<std::string, std::string> ref_map, hyp_map;
-  map_labels(ref, hyp, assignment, ref_map, hyp_map);
+// Score the regions swept from `tokens` with a speaker mapping.
+static void score_tokens(const std::vector<Token> &tokens, const std::vector<int> &assignment,
+                         int num_ref, int num_hyp, Metrics &metrics, const std::string &regions,
+                         bool timeline) {
+  if (timeline) metrics.timeline = std::make_shared<Timeline>();
+  init_errors(metrics, num_ref, num_hyp);
+  sweep_regions(tokens,
+                ErrorAccumulator(assignment, num_hyp, metrics, regions, metrics.timeline.get()));
+  finalize_errors(metrics, assignment);
+}
+
+// Compute diarization error rate of a single recording using several threads.
+// The recording is split into chunks at UEM gaps and joint silences (see
+// find_split_points), which are swept, accumulated into partial cost matrices,
+// and scored in parallel. The partial results are reduced in chunk order, so
+// the metrics match the serial path up to floating point rounding.
+static Metrics compute_der_chunked(const SegmentView &ref, const SegmentView &hyp,
+                                   const SegmentView &uem, std::string regions, float collar,
+                                   bool timeline, int num_threads, const std::string &mapper) {
+  int num_ref = ref.num_speakers, num_hyp = hyp.num_speakers;
+  // A few chunks per thread balance the load when speech is unevenly spread.
+  std::vector<double> points = find_split_points(ref, hyp, uem, 4 * num_threads);
+  size_t num_chunks = points.size() + 1;
+  std::vector<Segments> ref_chunks = split_segments(ref, points);
+  std::vector<Segments> hyp_chunks = split_segments(hyp, points);
+  std::vector<Segments> uem_chunks = split_segments(uem, points);
+  auto chunk_view = [](const Segments &chunk, const SegmentView &full) {
+    return SegmentView(chunk.start.data(), chunk.end.data(), chunk.spk.data(), chunk.size(),
+                       full.speakers, full.num_speakers);
+  };
+
+  // Sweep each chunk into its partial cost matrix.
+  std::vector<std::vector<Token>> chunk_tokens(num_chunks);
+  std::vector<CostAccumulator> partial_costs(num_chunks, CostAccumulator(num_hyp));
+  parallel_for(num_chunks, num_threads, [&](size_t c) {
+    chunk_tokens[c] = get_tokens(chunk_view(ref_chunks[c], ref), chunk_view(hyp_chunks[c], hyp),
+                                 uem_chunks[c].view());
+    sweep_regions(chunk_tokens[c], [&partial_costs, c](double start, double end,
+                                                       const std::vector<int> &ref_spk,
+                                                       const std::vector<int> &hyp_spk) {
+      partial_costs[c].add(end - start, ref_spk, hyp_spk);
+    });
+  });
+  CostAccumulator total_cost(num_hyp);
+  for (auto &partial : partial_costs) total_cost.add(partial);
+  std::vector<CostAccumulator>().swap(partial_costs);
+  Metrics metrics;
+  std::vector<int> assignment = solve_mapping(num_ref, num_hyp, total_cost.entries(), mapper,
+                                              metrics.mapping_gap, num_threads);
+  metrics.mapper = mapper;
+  build_label_maps(ref, hyp, assignment, metrics.ref_map, metrics.hyp_map);
+  metrics.ref_speakers.assign(ref.speakers, ref.speakers + ref.num_speakers);
+  metrics.hyp_speakers.assign(hyp.speakers, hyp.speakers + hyp.num_speakers);
 
-  // Obtain scoring regions based on collar
+  // The collar only shrinks the UEM, so the split points remain valid.
+  Segments collar_uem;
   if (collar != 0.0) {
-    add_collar_to_uem(uem, ref, collar);
+    collar_uem = add_collar_to_uem(uem, ref, collar);
+    uem_chunks = split_segments(collar_uem.view(), points);
+  }
+
+  // Score each chunk, and reduce the partial errors in chunk order.
+  std::vector<Metrics> partial_metrics(num_chunks);
+  std::vector<Timeline> partial_timelines(timeline ? num_chunks : 0);
+  parallel_for(num_chunks, num_threads, [&](size_t c) {
+    if (collar != 0.0)
+      chunk_tokens[c] = get_tokens(chunk_view(ref_chunks[c], ref),
+                                   chunk_view(hyp_chunks[c], hyp), uem_chunks[c].view());
+    init_errors(partial_metrics[c], num_ref, num_hyp);
+    sweep_regions(chunk_tokens[c],
+                  ErrorAccumulator(assignment, num_hyp, partial_metrics[c], regions,
+                                   timeline ? &partial_timelines[c] : nullptr));
+    std::vector<Token>().swap(chunk_tokens[c]);
+  });
+  init_errors(metrics, num_ref, num_hyp);
+  for (auto &partial : partial_metrics) add_errors(metrics, partial);
+  if (timeline) {
+    metrics.timeline = std::make_shared<Timeline>();
+    for (auto &partial : partial_timelines)
+      for (auto &region : partial.regions) metrics.timeline->push_back(region);
+  }
+  finalize_errors(metrics, assignment);
+  return metrics;
+}
+
+Metrics compute_der(const TurnList &ref, const TurnList &hyp, const TurnList &uem,
+                    std::string regions, float collar, bool timeline, int num_threads,
+                    std::string mapper) {
+  // Merge overlapping segments from the same speaker, index the reference and
+  // hypothesis speakers, and convert the turns to columnar segments. The turn
+  // lists are left as they are, so they may be shared by concurrent calls.
+  Segments ref_segments = ref.merged_segments();
+  Segments hyp_segments = hyp.merged_segments();
+  Segments uem_segments = uem.merged_segments(false);
+
+  return compute_der(ref_segments.view(), hyp_segments.view(), uem_segments.view(), regions,
+                     collar, timeline, num_threads, mapper);
+}
+
+Metrics compute_der(const SegmentView &ref, const SegmentView &hyp, const SegmentView &uem,
+                    std::string regions, float collar, bool timeline, int num_threads,
+                    std::string mapper) {
+  num_threads = resolve_num_threads(num_threads);
+  if (num_threads > 1)
+    return compute_der_chunked(ref, hyp, uem, regions, collar, timeline, num_threads, mapper);
+
+  // Sort the segment boundaries once. The evaluation regions are swept from
+  // the tokens twice (once for the mapping and once for scoring), and are
+  // never stored.
+  std::vector<Token> tokens = get_tokens(ref, hyp, uem);
+  Metrics metrics;
+  std::vector<int> assignment = map_speakers(tokens, ref, hyp, metrics, mapper);
+
+  // Obtain scoring regions based on collar. Without a collar, the regions used
+  // for the mapping are also the scoring regions.
+  if (collar != 0.0) {
+    Segments collar_uem = add_collar_to_uem(uem, ref, collar);
+    tokens = get_tokens(ref, hyp, collar_uem.view());
   }
-  eval_regions = get_eval_regions(ref, hyp, uem);
 
   // Finally, we compute the DER metrics.
+  score_tokens(tokens, assignment, ref.num_speakers, hyp.num_speakers, metrics, regions,
+               timeline);
+  return metrics;
+}
+
+// Score the frames of `grid` with a speaker mapping, the same way as
+// ErrorAccumulator scores the exact regions. The error totals only depend on
+// the speaker counts of each frame and on the overlap of each reference
+// speaker with its mapped hypothesis speaker, so they are computed with a pass
+// over the counts and word-wise ANDs of the activity bitsets. Only the shares
+// of the speaker-level breakdown visit the frames of each speaker one by one.
+static void score_frames(const FrameGrid &grid, const std::vector<int> &assignment,
+                         Metrics &metrics, const std::string &regions) {
+  int num_ref = grid.num_ref, num_hyp = grid.num_hyp;
+  size_t num_words = grid.num_words;
+  init_errors(metrics, num_ref, num_hyp);
+  std::vector<uint64_t> scored = grid.scored_frames(regions);
+  auto is_scored = [&scored](size_t f) { return (scored[f / 64] >> (f % 64)) & 1; };
+
+  // Scored frames where each reference speaker is active together with its
+  // mapped hypothesis speaker, and the number of such speakers in each frame.
+  std::vector<uint64_t> matched((size_t)num_ref * num_words, 0);
+  std::vector<int> correct_count(grid.num_frames, 0);
+  std::vector<int> ref_of_hyp(num_hyp, -1);
+  for (int ref = 0; ref < num_ref; ++ref) {
+    if (assignment[ref] == -1) continue;
+    ref_of_hyp[assignment[ref]] = ref;
+    const uint64_t *ref_row = grid.ref_row(ref), *hyp_row = grid.hyp_row(assignment[ref]);
+    uint64_t *matched_row = matched.data() + ref * num_words;
+    for (size_t w = 0; w < num_words; ++w) matched_row[w] = ref_row[w] & hyp_row[w] & scored[w];
+    for_each_frame(matched_row, num_words, [&correct_count](size_t f) { correct_count[f] += 1; });
+  }
+
+  // Error totals, with every frame counted at full length first, and the
+  // frames of other lengths corrected afterwards.
+  auto add_frame = [&](size_t f, double length) {
+    int N_ref = grid.ref_count[f], N_hyp = grid.hyp_count[f];
+    double miss = length * std::max(0, N_ref - N_hyp);
+    double falarm = length * std::max(0, N_hyp - N_ref);
+    double conf = length * (std::min(N_ref, N_hyp) - correct_count[f]);
+    metrics.miss += miss;
+    metrics.falarm += falarm;
+    metrics.conf += conf;
+    metrics.duration += length * N_ref;
+    add_degree_errors(metrics, N_ref, N_hyp, length, miss, falarm, conf);
+    add_sad_errors(metrics, N_ref, N_hyp, length);
+  };
+  for (size_t f = 0; f < grid.num_frames; ++f)
+    if (is_scored(f)) add_frame(f, grid.frame_shift);
+  for (auto &frame : grid.short_frames)
+    if (is_scored(frame.first)) add_frame(frame.first, frame.second - grid.frame_shift);
+
+  // Speaker-level breakdown
+  for (int ref = 0; ref < num_ref; ++ref) {
+    metrics.ref_duration[ref] = grid.length(grid.ref_row(ref), scored.data());
+    for (int hyp = 0; hyp < num_hyp; ++hyp)
+      metrics.overlap[(size_t)ref * num_hyp + hyp] =
+          grid.length(grid.ref_row(ref), grid.hyp_row(hyp), scored.data());
+  }
+  for (int hyp = 0; hyp < num_hyp; ++hyp)
+    metrics.hyp_duration[hyp] = grid.length(grid.hyp_row(hyp), scored.data());
+
+  std::vector<uint64_t> unmatched(num_words);
+  for (int ref = 0; ref < num_ref; ++ref) {
+    const uint64_t *ref_row = grid.ref_row(ref), *matched_row = matched.data() + ref * num_words;
+    for (size_t w = 0; w < num_words; ++w) unmatched[w] = ref_row[w] & scored[w] & ~matched_row[w];
+    for_each_frame(unmatched.data(), num_words, [&](size_t f) {
+      int N_ref = grid.ref_count[f], N_hyp = grid.hyp_count[f], N_correct = correct_count[f];
+      double length = grid.frame_length(f);
+      metrics.ref_miss[ref] += length * std::max(0, N_ref - N_hyp) / (N_ref - N_correct);
+      metrics.ref_conf[ref] += length * (std::min(N_ref, N_hyp) - N_correct) / (N_ref - N_correct);
+    });
+  }
+  for (int hyp = 0; hyp < num_hyp; ++hyp) {
+    const uint64_t *hyp_row = grid.hyp_row(hyp);
+    int ref = ref_of_hyp[hyp];
+    for (size_t w = 0; w < num_words; ++w)
+      unmatched[w] = hyp_row[w] & scored[w] & ((ref == -1) ? ~0ULL : ~grid.ref_row(ref)[w]);
+    for_each_frame(unmatched.data(), num_words, [&](size_t f) {
+      int N_ref = grid.ref_count[f], N_hyp = grid.hyp_count[f], N_correct = correct_count[f];
+      if (N_hyp > N_ref)
+        metrics.hyp_falarm[hyp] += grid.frame_length(f) * (N_hyp - N_ref) / (N_hyp - N_correct);
+    });
+  }
+}
+
+// Bound the deviation of the errors and scored duration accumulated on `grid`
+// from their exact values. A frame without segment boundaries lies within a
+// single exact region, so only frames with boundaries contribute. For the
+// "all" regions, each boundary changes the number of errors (and the
+// reference count) by at most 1, so a frame, which is sampled at its
+// midpoint, deviates by at most half its length per boundary, for any speaker
+// mapping. The approximate mapping then maximizes the frame overlaps, as the
+// exact one does the exact overlaps, so the errors of both mappings are within
+// the bound of each other. With a collar or other region types, the mapping is
+// found on other frames than the scored ones, and the exact mapping may differ
+// from it by an amount that the frames do not bound, so the errors are left
+// unbounded (NaN). A boundary can also move a whole region in or out of the
+// scored set, so we bound the deviation of the duration by the frame length
+// times the largest reference count that can occur within the frame.
+static void bound_errors(const FrameGrid &grid, const std::string &regions, bool exact_mapping,
+                         Metrics &metrics) {
+  double error_bound = 0, duration_bound = 0;
+  if (regions == ALL) {
+    for (size_t f : grid.ref_boundaries) {
+      error_bound += grid.frame_length(f) / 2;
+      duration_bound += grid.frame_length(f) / 2;
+    }
+    for (size_t f : grid.hyp_boundaries) error_bound += grid.frame_length(f) / 2;
+  } else {
+    // Count the reference boundaries of each frame (the list is sorted).
+    const std::vector<size_t> &ref = grid.ref_boundaries;
+    for (size_t i = 0; i < ref.size();) {
+      size_t f = ref[i];
+      int ref_boundaries = 0;
+      for (; i < ref.size() && ref[i] == f; ++i) ref_boundaries += 1;
+      duration_bound += grid.frame_length(f) * (grid.ref_count[f] + ref_boundaries);
+    }
+  }
+  metrics.error_bound = exact_mapping ? error_bound : NAN;
+  metrics.duration_bound = duration_bound;
+}
+
+Metrics compute_der_approx(const TurnList &ref, const TurnList &hyp, const TurnList &uem,
+                           std::string regions, float collar, double frame_shift) {
+  Segments ref_segments = ref.merged_segments();
+  Segments hyp_segments = hyp.merged_segments();
+  Segments uem_segments = uem.merged_segments(false);
+  return compute_der_approx(ref_segments.view(), hyp_segments.view(), uem_segments.view(),
+                            regions, collar, frame_shift);
+}
+
+Metrics compute_der_approx(const SegmentView &ref, const SegmentView &hyp,
+                           const SegmentView &uem, std::string regions, float collar,
+                           double frame_shift) {
+  Metrics metrics;
+  FrameGrid grid(ref, hyp, uem, frame_shift);
+  CostAccumulator cost(hyp.num_speakers);
+  for (int i = 0; i < grid.num_ref; ++i)
+    for (int j = 0; j < grid.num_hyp; ++j) {
+      double overlap = grid.length(grid.ref_row(i), grid.hyp_row(j));
+      if (overlap > 0) cost.add(i, j, -overlap);
+    }
+  std::vector<int> assignment = map_speakers(cost, ref, hyp, metrics);
+
+  // As in compute_der, the collar only applies to the scored frames.
+  if (collar != 0.0) {
+    Segments collar_uem = add_collar_to_uem(uem, ref, collar);
+    grid = FrameGrid(ref, hyp, collar_uem.view(), frame_shift);
+  }
+  score_frames(grid, assignment, metrics, regions);
+  bound_errors(grid, regions, collar == 0.0 && regions == ALL, metrics);
+  finalize_errors(metrics, assignment);
+  return metrics;
+}
+
+// Merge two sorted lists of tokens.
+static std::vector<Token> merge_tokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+  std::vector<Token> merged(a.size() + b.size());
+  std::merge(a.begin(), a.end(), b.begin(), b.end(), merged.begin());
+  return merged;
+}
+
+std::vector<Metrics> compute_der_multi_ref(const std::vector<const TurnList *> &refs,
+                                           const TurnList &hyp, const TurnList &uem,
+                                           std::string regions, float collar, int num_threads) {
+  // Prepare the hypothesis once: its turns are merged, indexed and its
+  // boundaries sorted (together with the UEM) a single time for all the
+  // references.
+  Segments hyp_segments = hyp.merged_segments();
+  Segments uem_segments = uem.merged_segments(false);
+  SegmentView hyp_view = hyp_segments.view(), uem_view = uem_segments.view();
+  SegmentView no_segments(nullptr, nullptr, nullptr, 0, nullptr, 0);
+  std::vector<Token> hyp_tokens = get_tokens(no_segments, hyp_view, no_segments);
+  std::vector<Token> hyp_uem_tokens = merge_tokens(
+      hyp_tokens, get_tokens(no_segments, no_segments, uem_view));
+
+  // Each reference stream is sorted on its own and merged into the prepared
+  // hypothesis stream.
+  std::vector<Metrics> results(refs.size());
+  parallel_for(refs.size(), num_threads, [&](size_t r) {
+    Segments ref_segments = refs[r]->merged_segments();
+    SegmentView ref_view = ref_segments.view();
+    std::vector<Token> ref_tokens = get_tokens(ref_view, no_segments, no_segments);
+
+    std::vector<Token> tokens = merge_tokens(hyp_uem_tokens, ref_tokens);
+    std::vector<int> assignment = map_speakers(tokens, ref_view, hyp_view, results[r]);
+
+    // The collar depends on the reference, so the UEM is merged again.
+    if (collar != 0.0) {
+      Segments collar_uem = add_collar_to_uem(uem_view, ref_view, collar);
+      tokens = merge_tokens(merge_tokens(hyp_tokens, ref_tokens),
+                            get_tokens(no_segments, no_segments, collar_uem.view()));
+    }
+    score_tokens(tokens, assignment, ref_view.num_speakers, hyp_view.num_speakers, results[r],
+                 regions, false);
+  });
+  return results;
+}
+
+std::vector<Metrics> compute_der_global(const std::vector<const TurnList *> &refs,
+                                        const std::vector<const TurnList *> &hyps,
+                                        const std::vector<const TurnList *> &uems,
+                                        std::string regions, float collar, int num_threads,
+                                        bool timeline, std::string mapper) {
+  size_t num_recordings = refs.size();
+  std::vector<Segments> ref_segments(num_recordings), hyp_segments(num_recordings),
+      uem_segments(num_recordings);
+  parallel_for(num_recordings, num_threads, [&](size_t i) {
+    ref_segments[i] = refs[i]->merged_segments();
+    hyp_segments[i] = hyps[i]->merged_segments();
+    uem_segments[i] = uems[i]->merged_segments(false);
+  });
+
+  std::vector<SegmentView> ref_views, hyp_views, uem_views;
+  for (size_t i = 0; i < num_recordings; ++i) {
+    ref_views.push_back(ref_segments[i].view());
+    hyp_views.push_back(hyp_segments[i].view());
+    uem_views.push_back(uem_segments[i].view());
+  }
+  return compute_der_global(ref_views, hyp_views, uem_views, regions, collar, num_threads,
+                            timeline, mapper);
+}
+
+// Build a corpus-level speaker index from the speakers of each recording.
+// Global ids follow the sorted order of the labels, as local ids do, so the
+// local-to-global map of each recording is increasing.
+// \param views: the segments of each recording
+// \param names: the global speaker labels, indexed by global id
+// \return for each recording, the global id of each local speaker
+static std::vector<std::vector<int>> build_global_index(const std::vector<SegmentView> &views,
+                                                        std::vector<std::string> &names) {
+  std::map<std::string, int> index;
+  for (auto &view : views)
+    for (int k = 0; k < view.num_speakers; ++k) index.insert(std::make_pair(view.speakers[k], 0));
+  names.clear();
+  for (auto &it : index) {
+    it.second = names.size();
+    names.push_back(it.first);
+  }
+  std::vector<std::vector<int>> local_to_global(views.size());
+  for (size_t i = 0; i < views.size(); ++i)
+    for (int k = 0; k < views[i].num_speakers; ++k)
+      local_to_global[i].push_back(index.find(views[i].speakers[k])->second);
+  return local_to_global;
+}
+
+std::vector<Metrics> compute_der_global(const std::vector<SegmentView> &refs,
+                                        const std::vector<SegmentView> &hyps,
+                                        const std::vector<SegmentView> &uems,
+                                        std::string regions, float collar, int num_threads,
+                                        bool timeline, std::string mapper) {
+  size_t num_recordings = refs.size();
+  if (num_recordings == 0) return std::vector<Metrics>();
+  std::vector<std::string> ref_names, hyp_names;
+  std::vector<std::vector<int>> ref_global = build_global_index(refs, ref_names);
+  std::vector<std::vector<int>> hyp_global = build_global_index(hyps, hyp_names);
+  int num_ref = ref_names.size(), num_hyp = hyp_names.size();
+
+  // Accumulate the corpus-level cost matrix. Each thread sweeps a contiguous
+  // block of recordings into its own sparse partial matrix, and the partial
+  // matrices are reduced in block order, so the result does not depend on
+  // thread scheduling.
+  int num_blocks = std::min<size_t>(resolve_num_threads(num_threads), num_recordings);
+  std::vector<CostAccumulator> partial_costs(num_blocks, CostAccumulator(num_hyp));
+  parallel_for(num_blocks, num_blocks, [&](size_t b) {
+    for (size_t i = b * num_recordings / num_blocks; i < (b + 1) * num_recordings / num_blocks;
+         ++i) {
+      const std::vector<int> &ref_ids = ref_global[i], &hyp_ids = hyp_global[i];
+      CostAccumulator &cost = partial_costs[b];
+      sweep_regions(get_tokens(refs[i], hyps[i], uems[i]),
+                    [&](double start, double end, const std::vector<int> &ref_spk,
+                        const std::vector<int> &hyp_spk) {
+                      for (auto &r : ref_spk)
+                        for (auto &h : hyp_spk) cost.add(ref_ids[r], hyp_ids[h], -(end - start));
+                    });
+    }
+  });
+  CostAccumulator &total_cost = partial_costs[0];
+  for (int b = 1; b < num_blocks; ++b) total_cost.add(partial_costs[b]);
+  std::vector<CostEntry> cost = total_cost.entries();
+
+  // Solve a single assignment for the whole corpus.
+  double mapping_gap = 0;
+  std::vector<int> global_assignment =
+      solve_mapping(num_ref, num_hyp, cost, mapper, mapping_gap, num_threads);
+  std::map<std::string, std::string> ref_map, hyp_map;
+  build_label_maps(SegmentView(nullptr, nullptr, nullptr, 0, ref_names.data(), num_ref),
+                   SegmentView(nullptr, nullptr, nullptr, 0, hyp_names.data(), num_hyp),
+                   global_assignment, ref_map, hyp_map);
+
+  // Score each recording with the shared mapping.
+  std::vector<Metrics> results(num_recordings);
+  parallel_for(num_recordings, num_threads, [&](size_t i) {
+    // Translate the global assignment to the local speaker ids. The local to
+    // global maps are increasing, so hypothesis speakers are found by bisection.
+    std::vector<int> assignment(refs[i].num_speakers, -1);
+    for (int r = 0; r < refs[i].num_speakers; ++r) {
+      int h = global_assignment[ref_global[i][r]];
+      auto it = std::lower_bound(hyp_global[i].begin(), hyp_global[i].end(), h);
+      if (h != -1 && it != hyp_global[i].end() && *it == h)
+        assignment[r] = it - hyp_global[i].begin();
+    }
+
+    Metrics &metrics = results[i];
+    metrics.mapper = mapper;
+    metrics.mapping_gap = mapping_gap;
+    for (int r = 0; r < refs[i].num_speakers; ++r)
+      metrics.ref_map.insert(*ref_map.find(refs[i].speakers[r]));
+    for (int h = 0; h < hyps[i].num_speakers; ++h)
+      metrics.hyp_map.insert(*hyp_map.find(hyps[i].speakers[h]));
+    metrics.ref_speakers.assign(refs[i].speakers, refs[i].speakers + refs[i].num_speakers);
+    metrics.hyp_speakers.assign(hyps[i].speakers, hyps[i].speakers + hyps[i].num_speakers);
+
+    Segments collar_uem;
+    SegmentView uem = uems[i];
+    if (collar != 0.0) {
+      collar_uem = add_collar_to_uem(uems[i], refs[i], collar);
+      uem = collar_uem.view();
+    }
+    if (timeline) metrics.timeline = std::make_shared<Timeline>();
+    init_errors(metrics, refs[i].num_speakers, hyps[i].num_speakers);
+    sweep_regions(get_tokens(refs[i], hyps[i], uem),
+                  ErrorAccumulator(assignment, hyps[i].num_speakers, metrics, regions,
+                                   metrics.timeline.get()));
+    finalize_errors(metrics, assignment);
+  });
+  return results;
+}
+
+Metrics compute_sad(const TurnList &ref, const TurnList &hyp, const TurnList &uem,
+                    std::string regions, float collar) {
+  Segments ref_segments = ref.merged_segments();
+  Segments hyp_segments = hyp.merged_segments();
+  Segments uem_segments = uem.merged_segments(false);
+  return compute_sad(ref_segments.view(), hyp_segments.view(), uem_segments.view(), regions,
+                     collar);
+}
+
+Metrics compute_sad(const SegmentView &ref, const SegmentView &hyp, const SegmentView &uem,
+                    std::string regions, float collar) {
+  Segments collar_uem;
+  SegmentView scored_uem = uem;
+  if (collar != 0.0) {
+    collar_uem = add_collar_to_uem(uem, ref, collar);
+    scored_uem = collar_uem.view();
+  }
+  Metrics metrics(0, 0, 0, 0);
+  RegionFilter is_scored(regions);
+  sweep_regions(get_tokens(ref, hyp, scored_uem),
+                [&](double start, double end, const std::vector<int> &ref_spk,
+                    const std::vector<int> &hyp_spk) {
+                  if (is_scored(ref_spk.size()))
+                    add_sad_errors(metrics, ref_spk.size(), hyp_spk.size(), end - start);
+                });
+  return metrics;
+}
+
+double Metrics::sad_error() const {
+  return (sad_speech == 0) ? 0 : (sad_miss + sad_falarm) / sad_speech;
+}
+
+double Metrics::der_lower() const {
+  if (std::isnan(error_bound)) return NAN;
+  if ((error_bound == 0 && duration_bound == 0) || duration + duration_bound == 0) return der;
+  return std::max(0.0, der * duration - error_bound) / (duration + duration_bound);
+}
+
+double Metrics::der_upper() const {
+  if (std::isnan(error_bound)) return NAN;
+  if (error_bound == 0 && duration_bound == 0) return der;
+  if (duration <= duration_bound) return INFINITY;
+  return (der * duration + error_bound) / (duration - duration_bound);
+}
+
+BatchMetrics::BatchMetrics(std::vector<std::string> reco_ids, std::vector<Metrics> &&metrics)
+    : reco_ids(reco_ids), metrics(std::move(metrics)) {
+  if (this->reco_ids.size() != this->metrics.size())
+    throw std::invalid_argument("The number of recording ids and metrics must match");
+  for (size_t i = 0; i < this->reco_ids.size(); ++i) reco_index[this->reco_ids[i]] = i;
+  for (auto &m : this->metrics) {
+    duration.push_back(m.duration);
+    miss.push_back(m.miss);
+    falarm.push_back(m.falarm);
+    conf.push_back(m.conf);
+    der.push_back(m.der);
+    jer.push_back(m.jer);
+  }
+}
+
+size_t BatchMetrics::size() const { return reco_ids.size(); }
+
+int BatchMetrics::find(const std::string &reco_id) const {
+  auto it = reco_index.find(reco_id);
+  return (it == reco_index.end()) ? -1 : it->second;
+}
+
+Metrics BatchMetrics::overall() const {
+  double total_dur = 0, total_miss = 0, total_falarm = 0, total_conf = 0;
+  double speaker_jer = 0;
+  size_t num_speakers = 0;
+  for (size_t i = 0; i < size(); ++i) {
+    total_dur += duration[i];
+    total_miss += duration[i] * miss[i];
+    total_falarm += duration[i] * falarm[i];
+    total_conf += duration[i] * conf[i];
+    const Metrics &m = metrics[i];
+    for (size_t k = 0; k < m.ref_duration.size(); ++k) {
+      if (m.ref_duration[k] == 0) continue;
+      speaker_jer += 1 - m.ref_jaccard[k];
+      num_speakers += 1;
+    }
+  }
+  Metrics result(total_dur, 0, 0, 0);
+  if (total_dur > 0)
+    result = Metrics(total_dur, total_miss / total_dur, total_falarm / total_dur,
+                     total_conf / total_dur);
+  result.jer = (num_speakers == 0) ? 0 : speaker_jer / num_speakers;
+  for (auto &m : metrics) {
+    result.sad_speech += m.sad_speech;
+    result.sad_miss += m.sad_miss;
+    result.sad_falarm += m.sad_falarm;
+    for (size_t k = 0; k < DEGREE_BINS; ++k) {
+      result.degree_time[k] += m.degree_time[k];
+      result.degree_duration[k] += m.degree_duration[k];
+      result.degree_miss[k] += m.degree_miss[k];
+      result.degree_falarm[k] += m.degree_falarm[k];
+      result.degree_conf[k] += m.degree_conf[k];
+    }
+  }
+  return result;
+}
+
+BatchMetrics compute_der_batch(const std::vector<std::string> &reco_ids,
+                               const std::vector<const TurnList *> &refs,
+                               const std::vector<const TurnList *> &hyps,
+                               const std::vector<const TurnList *> &uems, std::string regions,
+                               float collar, bool global_mapping, int num_threads,
+                               std::string mapper) {
+  if (refs.size() != reco_ids.size() || hyps.size() != reco_ids.size() ||
+      uems.size() != reco_ids.size())
+    throw std::invalid_argument("ref, hyp and uem must have one entry per recording");
+  if (global_mapping)
+    return BatchMetrics(reco_ids,
+                        compute_der_global(refs, hyps, uems, regions, collar, num_threads,
+                                           false, mapper));
+
+  std::vector<Metrics> results(reco_ids.size());
+  parallel_for(reco_ids.size(), num_threads, [&](size_t i) {
+    results[i] = compute_der(*refs[i], *hyps[i], *uems[i], regions, collar, false, 1, mapper);
+  });
+  return BatchMetrics(reco_ids, std::move(results));
+}
+
+PairwiseMetrics compute_der_pairwise(const std::vector<std::string> &reco_ids,
+                                     const std::vector<std::vector<const TurnList *>> &systems,
+                                     const std::vector<const TurnList *> &uems, std::string regions,
+                                     float collar, int num_threads, bool per_recording) {
+  size_t num_systems = systems.size(), num_recordings = reco_ids.size();
+  if (uems.size() != num_recordings)
+    throw std::invalid_argument("uem must have one entry per recording");
+  for (auto &system : systems)
+    if (system.size() != num_recordings)
+      throw std::invalid_argument("Each system must have one entry per recording");
+
+  // Prepare each system once per recording: its tokens are sorted once as a
+  // reference and once as a hypothesis, and only merged afterwards.
+  SegmentView no_segments(nullptr, nullptr, nullptr, 0, nullptr, 0);
+  std::vector<Segments> segments(num_systems * num_recordings),
+      uem_segments(num_recordings);
+  std::vector<SegmentView> views(num_systems * num_recordings, no_segments);
+  std::vector<std::vector<Token>> ref_tokens(num_systems * num_recordings),
+      hyp_tokens(num_systems * num_recordings), uem_tokens(num_recordings);
+  parallel_for(num_recordings, num_threads, [&](size_t r) {
+    uem_segments[r] = uems[r]->merged_segments(false);
+    uem_tokens[r] = get_tokens(no_segments, no_segments, uem_segments[r].view());
+  });
+  parallel_for(num_systems * num_recordings, num_threads, [&](size_t k) {
+    const TurnList *turns = systems[k / num_recordings][k % num_recordings];
+    if (turns == nullptr) return;
+    segments[k] = turns->merged_segments();
+    views[k] = segments[k].view();
+    ref_tokens[k] = get_tokens(views[k], no_segments, no_segments);
+    hyp_tokens[k] = get_tokens(no_segments, views[k], no_segments);
+  });
+
+  // The collar depends on the reference, so the UEM is shrunk once per
+  // reference system and recording.
+  std::vector<std::vector<Token>> collar_tokens;
+  if (collar != 0.0) {
+    collar_tokens.resize(num_systems * num_recordings);
+    parallel_for(num_systems * num_recordings, num_threads, [&](size_t k) {
+      if (systems[k / num_recordings][k % num_recordings] == nullptr) return;
+      Segments collar_uem =
+          add_collar_to_uem(uem_segments[k % num_recordings].view(), views[k], collar);
+      collar_tokens[k] = get_tokens(no_segments, no_segments, collar_uem.view());
+    });
+  }
+
+  // One task per recording and ordered pair of systems. Each fills its own
+  // entry, so the reduction below does not depend on the scheduling.
+  size_t num_pairs = num_systems * num_systems;
+  std::vector<double> duration(num_recordings * num_pairs, 0.0),
+      errors(num_recordings * num_pairs, 0.0);
+  parallel_for(num_recordings * num_pairs, num_threads, [&](size_t t) {
+    size_t r = t / num_pairs, i = t % num_pairs / num_systems, j = t % num_systems;
+    size_t ref = i * num_recordings + r, hyp = j * num_recordings + r;
+    if (i == j || systems[i][r] == nullptr) return;
+
+    Metrics metrics;
+    std::vector<Token> speech = merge_tokens(ref_tokens[ref], hyp_tokens[hyp]);
+    std::vector<Token> tokens = merge_tokens(speech, uem_tokens[r]);
+    std::vector<int> assignment = map_speakers(tokens, views[ref], views[hyp], metrics);
+    if (collar != 0.0) tokens = merge_tokens(speech, collar_tokens[ref]);
+    score_tokens(tokens, assignment, views[ref].num_speakers, views[hyp].num_speakers, metrics,
+                 regions, false);
+    duration[t] = metrics.duration;
+    errors[t] = metrics.duration * metrics.der;
+  });
+
+  PairwiseMetrics result;
+  result.reco_ids = reco_ids;
+  result.num_systems = num_systems;
+  result.duration.assign(num_pairs, 0.0);
+  result.der.assign(num_pairs, 0.0);
+  std::vector<double> total_errors(num_pairs, 0.0);
+  for (size_t t = 0; t < duration.size(); ++t) {
+    result.duration[t % num_pairs] += duration[t];
+    total_errors[t % num_pairs] += errors[t];
+  }
+  for (size_t p = 0; p < num_pairs; ++p)
+    if (result.duration[p] > 0) result.der[p] = total_errors[p] / result.duration[p];
+
+  if (per_recording) {
+    result.reco_der.assign(duration.size(), 0.0);
+    for (size_t t = 0; t < duration.size(); ++t)
+      if (duration[t] > 0) result.reco_der[t] = errors[t] / duration[t];
+    result.reco_duration = std::move(duration);
+  }
+  return result;
+}
+
+// Bound, in seconds, on the overlap that the speaker mapping of a ScoringSession
+// may miss before it is solved again. It absorbs the rounding errors of the
+// incremental totals.
+static const double MAPPING_TOLERANCE = 1e-6;
+
+// Overlaps below this many seconds are left out of the cost matrix of a
+// ScoringSession, as they are what remains of pairs that no longer co-occur.
+static const double OVERLAP_TOLERANCE = 1e-9;
+
+bool ScoringSession::Span::operator==(const Span &other) const {
+  return uem == other.uem && collar == other.collar && ref == other.ref && hyp == other.hyp;
+}
+
+ScoringSession::ScoringSession(const TurnList &ref, const TurnList &hyp, const TurnList &uem,
+                       std::string regions, float collar)
+    : regions(regions), collar(collar), follow_extent(uem.turns.empty()) {
+  spans[-std::numeric_limits<double>::infinity()] = Span();
+  for (auto &turn : ref.turns) insert(true, turn.spk, turn.start, turn.end);
+  for (auto &turn : hyp.turns) insert(false, turn.spk, turn.start, turn.end);
+  for (auto &segment : uem.turns) {
+    auto last = split(segment.end);
+    for (auto it = split(segment.start); it != last; ++it) it->second.uem += 1;
+  }
+  update_extent();
+
+  // Merge equal neighbouring spans, accumulate the overlaps, and score.
+  building = false;
+  for (auto it = spans.begin(), next = std::next(it); next != spans.end(); next = std::next(it)) {
+    if (next->second == it->second)
+      spans.erase(next);
+    else
+      it = next;
+  }
+  add_spans(-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), 1,
+            true, false);
+  solve();
+}
+
+size_t ScoringSession::insert(bool is_ref, const std::string &spk, double start, double end) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (start > end) throw std::invalid_argument("start time cannot be greater than end time");
+  int k = speaker_index(is_ref, spk);
+  turns.push_back({is_ref, k, start, end});
+  (is_ref ? ref_counts : hyp_counts)[k] += 1;
+  starts.insert(start);
+  ends.insert(end);
+  double pad = is_ref ? collar : 0;
+  edit_spans(start - pad, end + pad, [&]() { update_turn(is_ref, k, start, end, 1); });
+  if (!building) {
+    update_extent();
+    check_mapping();
+  }
+  return turns.size() - 1;
+}
+
+void ScoringSession::remove(size_t id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  SessionTurn &turn = get_turn(id);
+  double pad = turn.is_ref ? collar : 0;
+  edit_spans(turn.start - pad, turn.end + pad,
+             [&]() { update_turn(turn.is_ref, turn.spk, turn.start, turn.end, -1); });
+  turn.removed = true;
+  (turn.is_ref ? ref_counts : hyp_counts)[turn.spk] -= 1;
+  starts.erase(starts.find(turn.start));
+  ends.erase(ends.find(turn.end));
+  update_extent();
+  check_mapping();
+}
+
+void ScoringSession::move(size_t id, double start, double end) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (start > end) throw std::invalid_argument("start time cannot be greater than end time");
+  SessionTurn &turn = get_turn(id);
+  bool is_ref = turn.is_ref;
+  int k = turn.spk;
+  double pad = is_ref ? collar : 0;
+  // Changes the turn between a and b by delta.
+  auto change = [&](double a, double b, int delta) {
+    if (a < b) edit_spans(a - pad, b + pad, [&]() { update_turn(is_ref, k, a, b, delta); });
+  };
+  if (start < turn.end && turn.start < end) {
+    // Only the spans between the old and new boundaries change.
+    if (start < turn.start)
+      change(start, turn.start, 1);
+    else
+      change(turn.start, start, -1);
+    if (end > turn.end)
+      change(turn.end, end, 1);
+    else
+      change(end, turn.end, -1);
+  } else {
+    change(turn.start, turn.end, -1);
+    change(start, end, 1);
+  }
+  starts.erase(starts.find(turn.start));
+  ends.erase(ends.find(turn.end));
+  starts.insert(start);
+  ends.insert(end);
+  turn.start = start;
+  turn.end = end;
+  update_extent();
+  check_mapping();
+}
+
+void ScoringSession::relabel(size_t id, const std::string &spk) {
+  std::lock_guard<std::mutex> lock(mutex);
+  SessionTurn &turn = get_turn(id);
+  int k = speaker_index(turn.is_ref, spk);
+  if (k == turn.spk) return;
+  double pad = turn.is_ref ? collar : 0;
+  edit_spans(turn.start - pad, turn.end + pad, [&]() {
+    update_turn(turn.is_ref, turn.spk, turn.start, turn.end, -1);
+    update_turn(turn.is_ref, k, turn.start, turn.end, 1);
+  });
+  std::vector<int> &counts = turn.is_ref ? ref_counts : hyp_counts;
+  counts[turn.spk] -= 1;
+  counts[k] += 1;
+  turn.spk = k;
+  check_mapping();
+}
+
+Turn ScoringSession::turn(size_t id) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (id >= turns.size() || turns[id].removed)
+    throw std::invalid_argument("Unknown turn id: " + std::to_string(id));
+  const SessionTurn &turn = turns[id];
+  return Turn((turn.is_ref ? ref_labels : hyp_labels)[turn.spk], turn.start, turn.end);
+}
+
+ScoringSession::SessionTurn &ScoringSession::get_turn(size_t id) {
+  if (id >= turns.size() || turns[id].removed)
+    throw std::invalid_argument("Unknown turn id: " + std::to_string(id));
+  return turns[id];
+}
+
+size_t ScoringSession::num_solves() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return solves;
+}
+
+Metrics ScoringSession::metrics() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  // List the speakers that have turns left, in label order, as compute_der
+  // indexes them.
+  auto live_speakers = [](const std::vector<std::string> &labels,
+                          const std::vector<int> &counts) {
+    std::vector<int> order;
+    for (size_t k = 0; k < labels.size(); ++k)
+      if (counts[k] > 0) order.push_back(k);
+    std::sort(order.begin(), order.end(),
+              [&labels](int a, int b) { return labels[a] < labels[b]; });
+    return order;
+  };
+  std::vector<int> ref_order = live_speakers(ref_labels, ref_counts);
+  std::vector<int> hyp_order = live_speakers(hyp_labels, hyp_counts);
+  int num_ref = ref_order.size(), num_hyp = hyp_order.size();
+  size_t old_num_hyp = hyp_labels.size();
+  std::vector<int> hyp_position(old_num_hyp, -1);
+  for (int j = 0; j < num_hyp; ++j) hyp_position[hyp_order[j]] = j;
+
   Metrics metrics;
-  metrics.ref_map = ref_map;
-  metrics.hyp_map = hyp_map;
-  compute_der_mapped(eval_regions, metrics, regions);
+  init_errors(metrics, num_ref, num_hyp);
+  metrics.duration = totals.duration;
+  metrics.miss = totals.miss;
+  metrics.falarm = totals.falarm;
+  metrics.conf = totals.conf;
+  metrics.sad_speech = totals.sad_speech;
+  metrics.sad_miss = totals.sad_miss;
+  metrics.sad_falarm = totals.sad_falarm;
+  for (auto degree : {&Metrics::degree_time, &Metrics::degree_duration, &Metrics::degree_miss,
+                      &Metrics::degree_falarm, &Metrics::degree_conf})
+    metrics.*degree = totals.*degree;
+  std::vector<int> mapped_to(num_ref, -1);
+  for (int i = 0; i < num_ref; ++i) {
+    int ref = ref_order[i];
+    metrics.ref_speakers.push_back(ref_labels[ref]);
+    metrics.ref_duration[i] = totals.ref_duration[ref];
+    metrics.ref_miss[i] = totals.ref_miss[ref];
+    metrics.ref_conf[i] = totals.ref_conf[ref];
+    for (int j = 0; j < num_hyp; ++j)
+      metrics.overlap[(size_t)i * num_hyp + j] =
+          totals.overlap[(size_t)ref * old_num_hyp + hyp_order[j]];
+    if (assignment[ref] != -1) mapped_to[i] = hyp_position[assignment[ref]];
+  }
+  for (int j = 0; j < num_hyp; ++j) {
+    metrics.hyp_speakers.push_back(hyp_labels[hyp_order[j]]);
+    metrics.hyp_duration[j] = totals.hyp_duration[hyp_order[j]];
+    metrics.hyp_falarm[j] = totals.hyp_falarm[hyp_order[j]];
+  }
+  build_label_maps(SegmentView(nullptr, nullptr, nullptr, 0, metrics.ref_speakers.data(), num_ref),
+                   SegmentView(nullptr, nullptr, nullptr, 0, metrics.hyp_speakers.data(), num_hyp),
+                   mapped_to, metrics.ref_map, metrics.hyp_map);
+  metrics.mapper = HUNGARIAN;
+  metrics.mapping_gap = 0;
+  finalize_errors(metrics, mapped_to);
   return metrics;
 }
 
+std::map<double, ScoringSession::Span>::iterator ScoringSession::split(double t) {
+  auto it = std::prev(spans.upper_bound(t));
+  if (it->first == t) return it;
+  return spans.emplace_hint(std::next(it), t, it->second);
+}
+
+void ScoringSession::add_spans(double lo, double hi, double sign, bool cost, bool errors) {
+  int num_hyp = hyp_labels.size();
+  ErrorAccumulator accumulate(assignment, num_hyp, totals, regions, nullptr);
+  std::vector<int> ref_spk, hyp_spk;
+  for (auto it = spans.lower_bound(lo); it != spans.end() && it->first < hi; ++it) {
+    const Span &span = it->second;
+    if (span.uem == 0) continue;
+    double start = it->first, end = std::next(it)->first;
+    // A speaker is active once, however many of its turns cover the span.
+    ref_spk.assign(span.ref.begin(), span.ref.end());
+    ref_spk.erase(std::unique(ref_spk.begin(), ref_spk.end()), ref_spk.end());
+    hyp_spk.assign(span.hyp.begin(), span.hyp.end());
+    hyp_spk.erase(std::unique(hyp_spk.begin(), hyp_spk.end()), hyp_spk.end());
+    if (cost) {
+      for (auto &i : ref_spk) {
+        for (auto &j : hyp_spk) {
+          double &w = overlap[i][j];
+          w += sign * (end - start);
+          if (std::abs(w) < OVERLAP_TOLERANCE) overlap[i].erase(j);
+        }
+        changed_rows.insert(i);
+      }
+    }
+    // The errors are linear in the length of the region, so visiting it
+    // backwards subtracts them.
+    if (errors && span.collar == 0) {
+      if (sign > 0)
+        accumulate(start, end, ref_spk, hyp_spk);
+      else
+        accumulate(end, start, ref_spk, hyp_spk);
+    }
+  }
+}
+
+void ScoringSession::edit_spans(double lo, double hi, const std::function<void()> &edit) {
+  if (building) {
+    edit();
+    return;
+  }
+  split(lo);
+  split(hi);
+  add_spans(lo, hi, -1, true, true);
+  edit();
+  add_spans(lo, hi, 1, true, true);
+
+  // Merge the spans that the edit made equal to their neighbours.
+  auto it = spans.lower_bound(lo);
+  if (it != spans.begin()) --it;
+  for (auto next = std::next(it); next != spans.end() && next->first <= hi; next = std::next(it)) {
+    if (next->second == it->second)
+      spans.erase(next);
+    else
+      it = next;
+  }
+}
+
+void ScoringSession::update_turn(bool is_ref, int spk, double start, double end, int delta) {
+  if (!(start < end)) return;
+  bool collars = is_ref && collar > 0;
+  auto last = split(end);
+  auto first = split(start);
+  std::vector<double> before, after;
+  if (collars) before = find_speaker_boundaries(spk, start, end);
+  for (auto it = first; it != last; ++it) {
+    std::vector<int> &speakers = is_ref ? it->second.ref : it->second.hyp;
+    if (delta > 0)
+      speakers.insert(std::upper_bound(speakers.begin(), speakers.end(), spk), spk);
+    else
+      speakers.erase(std::lower_bound(speakers.begin(), speakers.end(), spk));
+  }
+  if (!collars) return;
+
+  // The speaker can only start or stop speaking at other points within the
+  // turn, so only the collars around these points change.
+  after = find_speaker_boundaries(spk, start, end);
+  std::vector<double> removed, added;
+  std::set_difference(before.begin(), before.end(), after.begin(), after.end(),
+                      std::back_inserter(removed));
+  std::set_difference(after.begin(), after.end(), before.begin(), before.end(),
+                      std::back_inserter(added));
+  for (auto &t : removed) update_collar(t, -1);
+  for (auto &t : added) update_collar(t, 1);
+}
+
+std::vector<double> ScoringSession::find_speaker_boundaries(int spk, double start, double end) {
+  std::vector<double> points;
+  auto it = spans.find(start);
+  auto is_active = [spk](const Span &span) {
+    return std::binary_search(span.ref.begin(), span.ref.end(), spk);
+  };
+  bool active = is_active(std::prev(it)->second);
+  for (; it != spans.end() && it->first <= end; ++it) {
+    if (is_active(it->second) != active) points.push_back(it->first);
+    active = is_active(it->second);
+  }
+  return points;
+}
+
+void ScoringSession::update_collar(double t, int delta) {
+  auto last = split(t + collar);
+  for (auto it = split(t - collar); it != last; ++it) it->second.collar += delta;
+}
+
+void ScoringSession::update_extent() {
+  if (!follow_extent) return;
+  bool has = !starts.empty();
+  double start = has ? *starts.begin() : 0, end = has ? *ends.rbegin() : 0;
+  if (has == has_extent && start == extent_start && end == extent_end) return;
+  auto change = [this](double a, double b, int delta) {
+    if (!(a < b)) return;
+    edit_spans(a, b, [&]() {
+      auto last = split(b);
+      for (auto it = split(a); it != last; ++it) it->second.uem += delta;
+    });
+  };
+  if (has && has_extent && start < extent_end && extent_start < end) {
+    // Only move the ends of the UEM.
+    if (start < extent_start)
+      change(start, extent_start, 1);
+    else
+      change(extent_start, start, -1);
+    if (end > extent_end)
+      change(extent_end, end, 1);
+    else
+      change(end, extent_end, -1);
+  } else {
+    if (has_extent) change(extent_start, extent_end, -1);
+    if (has) change(start, end, 1);
+  }
+  has_extent = has;
+  extent_start = start;
+  extent_end = end;
+}
+
+int ScoringSession::speaker_index(bool is_ref, const std::string &spk) {
+  std::map<std::string, int> &index = is_ref ? ref_index : hyp_index;
+  auto found = index.find(spk);
+  if (found != index.end()) return found->second;
+  std::vector<std::string> &labels = is_ref ? ref_labels : hyp_labels;
+  int k = labels.size();
+  index[spk] = k;
+  labels.push_back(spk);
+  (is_ref ? ref_counts : hyp_counts).push_back(0);
+
+  // Grow the mapping and the error totals.
+  size_t num_ref = ref_labels.size(), num_hyp = hyp_labels.size();
+  if (is_ref) {
+    overlap.emplace_back();
+    assignment.push_back(-1);
+    profits.push_back(0);
+    mapped.push_back(0);
+  } else {
+    prices.push_back(0);
+  }
+  if (building) return k;
+  if (is_ref) {
+    totals.overlap.resize(num_ref * num_hyp, 0.0);
+    totals.ref_duration.push_back(0);
+    totals.ref_miss.push_back(0);
+    totals.ref_conf.push_back(0);
+  } else {
+    std::vector<double> grown(num_ref * num_hyp, 0.0);
+    for (size_t i = 0; i < num_ref; ++i)
+      std::copy(totals.overlap.begin() + i * (num_hyp - 1),
+                totals.overlap.begin() + (i + 1) * (num_hyp - 1), grown.begin() + i * num_hyp);
+    totals.overlap.swap(grown);
+    totals.hyp_duration.push_back(0);
+    totals.hyp_falarm.push_back(0);
+  }
+  return k;
+}
+
+void ScoringSession::update_profit(int ref) {
+  double profit = 0, overlap_mapped = 0;
+  for (auto &entry : overlap[ref]) {
+    profit = std::max(profit, entry.second - prices[entry.first]);
+    if (entry.first == assignment[ref]) overlap_mapped = entry.second;
+  }
+  total_profits += profit - profits[ref];
+  total_mapped += overlap_mapped - mapped[ref];
+  profits[ref] = profit;
+  mapped[ref] = overlap_mapped;
+}
+
+void ScoringSession::check_mapping() {
+  // The prices and profits remain a feasible dual solution after the edit, so
+  // they bound the overlap of any mapping (see assignment_gap).
+  for (auto &ref : changed_rows) update_profit(ref);
+  changed_rows.clear();
+  if (total_profits + total_prices - total_mapped > MAPPING_TOLERANCE) solve();
+}
+
+void ScoringSession::solve() {
+  int num_ref = ref_labels.size(), num_hyp = hyp_labels.size();
+  std::vector<CostEntry> cost;
+  for (int i = 0; i < num_ref; ++i) {
+    size_t row = cost.size();
+    for (auto &entry : overlap[i]) cost.emplace_back(i, entry.first, -entry.second);
+    std::sort(cost.begin() + row, cost.end(),
+              [](const CostEntry &a, const CostEntry &b) { return a.hyp < b.hyp; });
+  }
+  double gap;
+  std::vector<int> solved = solve_mapping(num_ref, num_hyp, cost, HUNGARIAN, gap);
+  bool changed = solves == 0 || solved != assignment;
+  assignment.swap(solved);
+  solves += 1;
+
+  // Recompute the dual solution from scratch, which also clears the rounding
+  // errors of the incremental totals.
+  prices = assignment_prices(num_ref, num_hyp, cost, assignment);
+  total_prices = std::accumulate(prices.begin(), prices.end(), 0.0);
+  profits.assign(num_ref, 0);
+  mapped.assign(num_ref, 0);
+  total_profits = total_mapped = 0;
+  for (int i = 0; i < num_ref; ++i) update_profit(i);
+  changed_rows.clear();
+
+  if (changed) {
+    init_errors(totals, num_ref, num_hyp);
+    add_spans(-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+              1, false, true);
+  }
+}
+
 }  // end namespace spyder
 
 #endif
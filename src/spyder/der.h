@@ -23,15 +23,29 @@
 #ifndef SPYDER_DER_H
 #define SPYDER_DER_H
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "containers.h"
+#include "timeline.h"
 #include "utils.h"
 
 namespace spyder {
 
+// Overlap degree from which the regions share a bin of the overlap degree
+// breakdown (see Metrics::degree_time), and the number of bins.
+const int MAX_DEGREE = 4;
+const size_t DEGREE_BINS = (MAX_DEGREE + 1) * (MAX_DEGREE + 1);
+
 // The DER metrics: missed speech, false alarm, speaker confusion (error),
-// and diarization error rate (DER).
+// and diarization error rate (DER). The Jaccard error rate (JER) is computed
+// alongside, with the same speaker mapping.
 class Metrics {
  public:
   double duration;
@@ -39,31 +53,452 @@ class Metrics {
   double falarm;
   double conf;
   double der;
+  double jer = 0;
   std::map<std::string, std::string> ref_map;
   std::map<std::string, std::string> hyp_map;
+
+  // Speaker-level breakdown of the scored regions, in seconds. Reference and
+  // hypothesis speakers are indexed in the order of `ref_speakers` and
+  // `hyp_speakers`.
+  std::vector<std::string> ref_speakers;
+  std::vector<std::string> hyp_speakers;
+  // overlap between each reference and hypothesis speaker (row-major,
+  // ref_speakers.size() x hyp_speakers.size())
+  std::vector<double> overlap;
+  // speech, missed speech and confusion of each reference speaker
+  std::vector<double> ref_duration;
+  std::vector<double> ref_miss;
+  std::vector<double> ref_conf;
+  // Jaccard index between each reference speaker and its mapped hypothesis
+  // speaker (0 if unmapped)
+  std::vector<double> ref_jaccard;
+  // speech and false alarm of each hypothesis speaker
+  std::vector<double> hyp_duration;
+  std::vector<double> hyp_falarm;
+
+  // Breakdown of the scored regions by overlap degree: their total length,
+  // reference speech, missed speech, false alarm and confusion, in seconds, for
+  // each number of reference (rows) and hypothesis (columns) speakers. Each is
+  // a row-major (MAX_DEGREE + 1) x (MAX_DEGREE + 1) matrix whose last row and
+  // column gather the regions with MAX_DEGREE or more speakers.
+  std::vector<double> degree_time = std::vector<double>(DEGREE_BINS, 0.0);
+  std::vector<double> degree_duration = std::vector<double>(DEGREE_BINS, 0.0);
+  std::vector<double> degree_miss = std::vector<double>(DEGREE_BINS, 0.0);
+  std::vector<double> degree_falarm = std::vector<double>(DEGREE_BINS, 0.0);
+  std::vector<double> degree_conf = std::vector<double>(DEGREE_BINS, 0.0);
+
+  // Speaker-agnostic speech activity (SAD) errors of the scored regions, in
+  // seconds: the time with reference speech, the part of it without hypothesis
+  // speech (missed speech), and the time with hypothesis speech but no
+  // reference speech (false alarm). They need no speaker mapping.
+  double sad_speech = 0;
+  double sad_miss = 0;
+  double sad_falarm = 0;
+
+  // time-resolved errors, only kept if requested
+  std::shared_ptr<Timeline> timeline;
+
+  // Bounds, in seconds, on the deviation of the errors (miss + false alarm +
+  // confusion) and of the scored duration from their exact values, if the
+  // metrics were approximated on a frame grid (see compute_der_approx). Both
+  // are 0 for exact metrics. error_bound is NaN if the errors cannot be bounded.
+  double error_bound = 0;
+  double duration_bound = 0;
+
+  // The speaker mapping algorithm (see solve_mapping), and an upper bound, in
+  // seconds, on the overlap between mapped speakers that it misses with
+  // respect to the optimal mapping. The gap is 0 for the exact Hungarian
+  // mapping.
+  std::string mapper = HUNGARIAN;
+  double mapping_gap = 0;
+
   Metrics() {}
   Metrics(double duration, double miss, double falarm, double conf)
       : duration(duration), miss(miss), falarm(falarm), conf(conf), der(miss + falarm + conf) {}
   ~Metrics() {}
+
+  // Returns the lower and upper bounds on the exact DER that follow from
+  // error_bound and duration_bound (the upper bound is infinite if the scored
+  // duration may be 0). Both equal `der` for exact metrics, and both are NaN if
+  // error_bound is.
+  double der_lower() const;
+  double der_upper() const;
+
+  // Returns the SAD error rate: missed speech and false alarm over the time
+  // with reference speech (0 if there is none).
+  double sad_error() const;
 };
 
-// Compute diarization error rate with mapped turn lists.
-// \param ref: a list of reference turns
-// \param hyp: a list of hypothesis turns
-// \param score_regions: a list of evaluation regions
-// \param metrics: the DER metrics
-// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
-void compute_der_mapped(std::vector<Region>& score_regions, Metrics& metrics, std::string regions);
+// Per-recording DER metrics of a set of recordings, stored column by column so
+// that they can be handed to NumPy without copying. The full metrics of each
+// recording (speaker maps, speaker-level breakdown) are kept alongside, and are
+// only converted when accessed.
+class BatchMetrics {
+ public:
+  std::vector<std::string> reco_ids;
+  std::vector<double> duration;
+  std::vector<double> miss;
+  std::vector<double> falarm;
+  std::vector<double> conf;
+  std::vector<double> der;
+  std::vector<double> jer;
+  std::vector<Metrics> metrics;
+
+  BatchMetrics() {}
+  // \param reco_ids: the recording ids
+  // \param metrics: the metrics of each recording, in the same order
+  BatchMetrics(std::vector<std::string> reco_ids, std::vector<Metrics>&& metrics);
+
+  // Returns the number of recordings
+  size_t size() const;
+
+  // Returns the position of a recording, or -1 if it is not in the batch
+  int find(const std::string& reco_id) const;
+
+  // Returns the overall metrics, with errors weighted by the scored duration of
+  // each recording, the JER averaged over all the reference speakers, and the
+  // overlap degree breakdowns and SAD errors summed.
+  Metrics overall() const;
+
+ private:
+  std::unordered_map<std::string, size_t> reco_index;
+};
 
 // Compute diarization error rate. First the lists are mapped to a common
-// label space using the Hungarian algorithm.
+// label space using the Hungarian algorithm (or an approximate mapper).
+// Same-speaker turns are merged on a copy (see TurnList::merged_segments), so
+// the turn lists are not modified and may be scored by several threads at once.
 // \param ref: a list of reference turns
 // \param hyp: a list of hypothesis turns
 // \param uem: a list of UEM segments
 // \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
 // \param collar: the collar size in seconds
-Metrics compute_der(TurnList& ref, TurnList& hyp, TurnList& uem, std::string regions = "all",
-                    float collar = 0.0);
+// \param timeline: whether to keep the time-resolved errors in Metrics::timeline
+// \param num_threads: number of threads used to score the recording (<= 0 means
+//   all hardware threads). With more than one thread, the recording is split
+//   into chunks at UEM gaps and at points where the reference and hypothesis
+//   are both silent, and the chunks are processed in parallel.
+// \param mapper: the speaker mapping algorithm: "hungarian" (exact), or
+//   "greedy" or "auction" (approximate, see solve_mapping), for hypotheses with
+//   very many speakers
+Metrics compute_der(const TurnList& ref, const TurnList& hyp, const TurnList& uem,
+                    std::string regions = "all", float collar = 0.0, bool timeline = false,
+                    int num_threads = 1, std::string mapper = "hungarian");
+
+// Compute diarization error rate on columnar segments. Same-speaker turns in
+// the reference and hypothesis must already be merged (see
+// TurnList::merge_same_speaker_turns). The segments are read in place.
+// \param ref: the reference segments
+// \param hyp: the hypothesis segments
+// \param uem: the UEM segments
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param timeline: whether to keep the time-resolved errors in Metrics::timeline
+// \param num_threads: number of threads used to score the recording (see above)
+// \param mapper: the speaker mapping algorithm (see above)
+Metrics compute_der(const SegmentView& ref, const SegmentView& hyp, const SegmentView& uem,
+                    std::string regions = "all", float collar = 0.0, bool timeline = false,
+                    int num_threads = 1, std::string mapper = "hungarian");
+
+// Compute an approximation of the diarization error rate on a grid of frames
+// (see FrameGrid) instead of the exact regions, which avoids sorting the
+// segment boundaries. The cost matrix and the errors are accumulated frame by
+// frame, and Metrics::error_bound and Metrics::duration_bound bound the
+// deviation from the exact totals. Only frames that contain a segment boundary
+// can deviate, so the bounds shrink with the frame shift. The errors are only
+// bounded for the "all" regions without a collar, where the speaker mapping
+// is found on the scored frames. Otherwise the mapping may differ from the
+// exact one when speakers overlap about equally, which the frames do not
+// bound, so Metrics::error_bound is NaN (and so are the DER bounds).
+// Same-speaker turns must already be merged.
+// \param ref: the reference segments
+// \param hyp: the hypothesis segments
+// \param uem: the UEM segments
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param frame_shift: the frame length in seconds, which trades accuracy for speed
+Metrics compute_der_approx(const SegmentView& ref, const SegmentView& hyp,
+                           const SegmentView& uem, std::string regions = "all",
+                           float collar = 0.0, double frame_shift = 0.1);
+
+// Compute an approximation of the diarization error rate on a grid of frames
+// (see above). The turn lists are not modified, as in compute_der.
+Metrics compute_der_approx(const TurnList& ref, const TurnList& hyp, const TurnList& uem,
+                           std::string regions = "all", float collar = 0.0,
+                           double frame_shift = 0.1);
+
+// Compute the speech activity (SAD) errors only (see Metrics::sad_speech). The
+// regions are swept once, without building the cost matrix or solving the
+// speaker mapping, and only the SAD fields of the metrics are filled.
+// Same-speaker turns must already be merged.
+// \param ref: the reference segments
+// \param hyp: the hypothesis segments
+// \param uem: the UEM segments
+// \param regions: the regions to compute the errors for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+Metrics compute_sad(const SegmentView& ref, const SegmentView& hyp, const SegmentView& uem,
+                    std::string regions = "all", float collar = 0.0);
+
+// Compute the speech activity (SAD) errors only (see above). The turn lists are
+// not modified, as in compute_der.
+Metrics compute_sad(const TurnList& ref, const TurnList& hyp, const TurnList& uem,
+                    std::string regions = "all", float collar = 0.0);
+
+// Compute diarization error rate of one hypothesis against several reference
+// annotations of the same recording. The hypothesis is prepared (merged,
+// indexed and its boundaries sorted) once, and merged against the sorted
+// boundaries of each reference. Each reference gets its own speaker mapping.
+// The turn lists are not modified, as in compute_der.
+// \param refs: the reference turns of each annotation
+// \param hyp: the hypothesis turns
+// \param uem: the UEM segments (with a collar, it is shrunk around the
+//   boundaries of each reference separately)
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param num_threads: number of threads, used over the references (<= 0 means
+//   all hardware threads)
+// \return the DER metrics against each reference
+std::vector<Metrics> compute_der_multi_ref(const std::vector<const TurnList*>& refs,
+                                           const TurnList& hyp, const TurnList& uem,
+                                           std::string regions = "all",
+                                           float collar = 0.0, int num_threads = 1);
+
+// Compute diarization error rate for a set of recordings with a single speaker
+// mapping shared by all of them. Speakers with the same label in different
+// recordings are the same speaker, and the mapping maximizes the overlap over
+// the whole corpus. The turn lists are not modified, as in compute_der.
+// \param refs: the reference turns of each recording
+// \param hyps: the hypothesis turns of each recording
+// \param uems: the UEM segments of each recording
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param num_threads: number of threads (<= 0 means all hardware threads)
+// \param timeline: whether to keep the time-resolved errors in Metrics::timeline
+// \param mapper: the speaker mapping algorithm (see compute_der)
+// \return the DER metrics of each recording. The speaker maps of each recording
+//   only contain its own speakers, with labels from the corpus-level mapping,
+//   and the mapping gap is the one of the corpus-level mapping.
+std::vector<Metrics> compute_der_global(const std::vector<const TurnList*>& refs,
+                                        const std::vector<const TurnList*>& hyps,
+                                        const std::vector<const TurnList*>& uems,
+                                        std::string regions = "all",
+                                        float collar = 0.0, int num_threads = 0,
+                                        bool timeline = false, std::string mapper = "hungarian");
+
+// Compute diarization error rate for a set of recordings with a single speaker
+// mapping shared by all of them, on columnar segments (see compute_der_global
+// above). Same-speaker turns must already be merged.
+std::vector<Metrics> compute_der_global(const std::vector<SegmentView>& refs,
+                                        const std::vector<SegmentView>& hyps,
+                                        const std::vector<SegmentView>& uems,
+                                        std::string regions = "all", float collar = 0.0,
+                                        int num_threads = 0, bool timeline = false,
+                                        std::string mapper = "hungarian");
+
+// Compute diarization error rate for a set of recordings, in parallel over the
+// recordings. The turn lists are not modified, as in compute_der.
+// \param reco_ids: the recording ids
+// \param refs: the reference turns of each recording
+// \param hyps: the hypothesis turns of each recording
+// \param uems: the UEM segments of each recording
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param global_mapping: whether to use a single speaker mapping for all the
+//   recordings (see compute_der_global)
+// \param num_threads: number of threads (<= 0 means all hardware threads)
+// \param mapper: the speaker mapping algorithm (see compute_der)
+BatchMetrics compute_der_batch(const std::vector<std::string>& reco_ids,
+                               const std::vector<const TurnList*>& refs,
+                               const std::vector<const TurnList*>& hyps,
+                               const std::vector<const TurnList*>& uems,
+                               std::string regions = "all",
+                               float collar = 0.0, bool global_mapping = false,
+                               int num_threads = 0, std::string mapper = "hungarian");
+
+// DER between every pair of systems scored on a set of recordings (see
+// compute_der_pairwise). Entry (i, j) of a matrix is the DER of system j with
+// system i as the reference, so the matrices are not symmetric. Matrices are
+// stored row-major, the per-recording ones one after the other.
+class PairwiseMetrics {
+ public:
+  std::vector<std::string> reco_ids;
+  size_t num_systems = 0;
+  // Scored duration (reference speech of system i) and DER over all the
+  // recordings, K x K.
+  std::vector<double> duration;
+  std::vector<double> der;
+  // The same for each recording, R x K x K (empty unless requested).
+  std::vector<double> reco_duration;
+  std::vector<double> reco_der;
+};
+
+// Compute diarization error rate between every ordered pair of K systems (e.g.
+// to compare the outputs of several diarization systems, or annotators, with
+// each other). Each system is prepared (merged, indexed and its boundaries
+// sorted, both as a reference and as a hypothesis) once per recording, and the
+// collar UEM once per reference system and recording. The scoring tasks, one
+// per ordered pair of distinct systems and recording, then only merge the
+// prepared streams, and are run in parallel. Each task gets its own speaker
+// mapping, as in compute_der. The overall DER of a pair weights its recordings
+// by their scored duration, as BatchMetrics::overall does. The diagonal is 0.
+// The turn lists are not modified, as in compute_der.
+// \param reco_ids: the recording ids
+// \param systems: the turns of each system (K) for each recording (R), with
+//   nullptr for recordings the system does not cover. Such recordings are not
+//   scored with the system as the reference, and count as empty with it as the
+//   hypothesis (as DER does without skip_missing).
+// \param uems: the UEM segments of each recording
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds, around the boundaries of the
+//   reference system
+// \param num_threads: number of threads (<= 0 means all hardware threads)
+// \param per_recording: whether to keep the matrices of each recording
+PairwiseMetrics compute_der_pairwise(const std::vector<std::string>& reco_ids,
+                                     const std::vector<std::vector<const TurnList*>>& systems,
+                                     const std::vector<const TurnList*>& uems,
+                                     std::string regions = "all",
+                                     float collar = 0.0, int num_threads = 0,
+                                     bool per_recording = false);
+
+// An editable DER computation of a single recording, for tools that rescore
+// after every correction of the reference or hypothesis (e.g. annotation
+// tools). The recording is kept as an ordered map of elementary regions
+// (between consecutive segment or collar boundaries), along with the overlap
+// of each pair of speakers and the error totals under the current speaker
+// mapping. An edit only revisits the regions of the time span it changes (plus
+// the collar around it), and subtracts their old contribution before adding
+// the new one. The mapping is kept optimal with dual prices (see
+// assignment_prices): the overlap it would miss is bounded after each edit,
+// and the mapping is only solved again, and the recording rescored, when the
+// bound is positive, i.e., when the mapping could change. Edited turns may
+// overlap turns of the same speaker; they are merged for scoring, as in
+// compute_der. The mapping is always the exact Hungarian one. The public
+// methods are serialized, so a session may be shared by several threads.
+class ScoringSession {
+ public:
+  // \param ref: the reference turns, which get the turn ids 0, 1, ...
+  // \param hyp: the hypothesis turns, which get the next turn ids
+  // \param uem: the UEM segments. If empty, the span from the earliest start
+  //   to the latest end of the turns is scored, as in DER(), and it follows the
+  //   edits.
+  // \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+  // \param collar: the collar size in seconds
+  ScoringSession(const TurnList& ref, const TurnList& hyp, const TurnList& uem,
+                 std::string regions = "all", float collar = 0.0);
+
+  // Add a turn.
+  // \param is_ref: whether the turn is a reference (or hypothesis) turn
+  // \param spk: the speaker label
+  // \param start: the start time in seconds
+  // \param end: the end time in seconds
+  // \return the id of the turn
+  size_t insert(bool is_ref, const std::string& spk, double start, double end);
+
+  // Remove a turn.
+  void remove(size_t id);
+
+  // Change the start and end times of a turn.
+  void move(size_t id, double start, double end);
+
+  // Change the speaker label of a turn.
+  void relabel(size_t id, const std::string& spk);
+
+  // Returns a turn (which must not have been removed)
+  Turn turn(size_t id) const;
+
+  // Returns the current metrics, as compute_der would return them for the
+  // current turns (up to the choice between equally good speaker mappings,
+  // and floating point rounding). Only the speakers that have turns left are
+  // listed.
+  Metrics metrics() const;
+
+  // Returns the number of times the speaker mapping was solved, including the
+  // first time
+  size_t num_solves() const;
+
+ private:
+  // A region between two consecutive boundaries.
+  struct Span {
+    // number of UEM segments and of reference collars covering the span
+    int uem = 0;
+    int collar = 0;
+    // speakers of the turns covering the span, sorted (a speaker appears once
+    // per turn, so same-speaker turns may repeat it)
+    std::vector<int> ref, hyp;
+    bool operator==(const Span& other) const;
+  };
+
+  struct SessionTurn {
+    bool is_ref;
+    int spk;
+    double start, end;
+    bool removed = false;
+  };
+
+  // Returns the span starting at `t`, splitting the one that contains it.
+  std::map<double, Span>::iterator split(double t);
+  // Add (sign = 1) or subtract (sign = -1) the contribution of the spans in
+  // [lo, hi) to the overlaps and error totals.
+  void add_spans(double lo, double hi, double sign, bool cost, bool errors);
+  // Change the spans in [lo, hi): their contribution is subtracted, they are
+  // changed by `edit` (which may split them further), and their contribution
+  // is added back. Equal neighbouring spans are then merged.
+  void edit_spans(double lo, double hi, const std::function<void()>& edit);
+  // Add or remove (delta = 1 or -1) a turn of a speaker, with its collars.
+  void update_turn(bool is_ref, int spk, double start, double end, int delta);
+  // Returns the points in [start, end] where reference speaker `spk` starts or
+  // stops speaking.
+  std::vector<double> find_speaker_boundaries(int spk, double start, double end);
+  // Add or remove the collar around a reference boundary.
+  void update_collar(double t, int delta);
+  // Make the UEM follow the extent of the turns, if no UEM was given.
+  void update_extent();
+  // Returns a turn that has not been removed.
+  SessionTurn& get_turn(size_t id);
+  // Returns the index of a speaker label, adding it if needed.
+  int speaker_index(bool is_ref, const std::string& spk);
+  // Check the bound on the overlap that the mapping misses after an edit, and
+  // solve the mapping again if it is positive.
+  void check_mapping();
+  // Solve the mapping, and rescore the whole recording if it changed.
+  void solve();
+  // Recompute the dual profit and the mapped overlap of a reference speaker.
+  void update_profit(int ref);
+
+  // serializes the edits and reads of concurrent threads
+  mutable std::mutex mutex;
+  std::string regions;
+  double collar;
+  // Whether the spans are still being built (they are only scored once the
+  // constructor has added all the turns).
+  bool building = true;
+  std::map<double, Span> spans;
+  std::vector<SessionTurn> turns;
+
+  // If no UEM was given, the UEM is the extent of the turns.
+  bool follow_extent;
+  std::multiset<double> starts, ends;
+  bool has_extent = false;
+  double extent_start = 0, extent_end = 0;
+
+  // speaker labels and their number of turns
+  std::vector<std::string> ref_labels, hyp_labels;
+  std::map<std::string, int> ref_index, hyp_index;
+  std::vector<int> ref_counts, hyp_counts;
+
+  // overlap of each pair of speakers on the UEM (row of each reference speaker)
+  std::vector<std::unordered_map<int, double>> overlap;
+  std::vector<int> assignment;
+  // dual prices of the hypothesis speakers, and profits of the reference
+  // speakers (see assignment_gap), and the overlap of each mapped pair
+  std::vector<double> prices, profits, mapped;
+  double total_prices = 0, total_profits = 0, total_mapped = 0;
+  std::set<int> changed_rows;
+  size_t solves = 0;
+
+  // error totals in seconds under the current mapping
+  Metrics totals;
+};
 
 }  // end namespace spyder
 
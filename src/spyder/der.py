@@ -4,9 +4,42 @@ import click
 import numpy as np
 from tabulate import tabulate
 
-from _spyder import Metrics, Turn, TurnList, compute_der
+from .cache import ResultCache
+from _spyder import (
+    Metrics,
+    ScoringSession,
+    ScoringStream,
+    SegmentFile,
+    Turn,
+    TurnList,
+    compute_der,
+    compute_der_approx,
+    compute_der_batch,
+    compute_der_global,
+    compute_der_multi_ref,
+    compute_der_pairwise,
+    compute_der_segment_files,
+    compute_sad,
+    is_segment_file,
+    read_rttm,
+    read_uem,
+    rttm_to_segment_file,
+    segment_file_to_rttm,
+)
 
-__all__ = ["compute_der_from_rttm", "DERMetrics", "DER"]
+__all__ = [
+    "compute_der_from_rttm",
+    "convert_segment_file",
+    "DERMetrics",
+    "DERSession",
+    "DERStream",
+    "DER",
+    "DER_approx",
+    "DER_matrix",
+    "DER_multi_reference",
+    "SAD",
+    "SADMetrics",
+]
 
 
 class DERMetrics:
@@ -16,8 +49,34 @@ class DERMetrics:
         self.falarm = metrics.falarm
         self.conf = metrics.conf
         self.der = metrics.der
+        self.jer = metrics.jer
         self.ref_map = metrics.ref_map
         self.hyp_map = metrics.hyp_map
+        self.ref_speakers = metrics.ref_speakers
+        self.hyp_speakers = metrics.hyp_speakers
+        self.overlap = metrics.overlap
+        self.ref_duration = metrics.ref_duration
+        self.ref_miss = metrics.ref_miss
+        self.ref_conf = metrics.ref_conf
+        self.ref_jaccard = metrics.ref_jaccard
+        self.hyp_duration = metrics.hyp_duration
+        self.hyp_falarm = metrics.hyp_falarm
+        self.degree_time = metrics.degree_time
+        self.degree_duration = metrics.degree_duration
+        self.degree_miss = metrics.degree_miss
+        self.degree_falarm = metrics.degree_falarm
+        self.degree_conf = metrics.degree_conf
+        self.sad_speech = metrics.sad_speech
+        self.sad_miss = metrics.sad_miss
+        self.sad_falarm = metrics.sad_falarm
+        self.sad_error = metrics.sad_error
+        self.timeline = metrics.timeline
+        self.error_bound = metrics.error_bound
+        self.duration_bound = metrics.duration_bound
+        self.der_lower = metrics.der_lower
+        self.der_upper = metrics.der_upper
+        self.mapper = metrics.mapper
+        self.mapping_gap = metrics.mapping_gap
 
     def __repr__(self):
         return (
@@ -30,16 +89,136 @@ class DERMetrics:
         )
 
 
-def _DER(ref, hyp, uem, regions="all", collar=0.0):
+class SADMetrics:
+    """
+    Speech activity (SAD) metrics: the scored time with reference speech
+    (`duration`), and the missed speech, false alarm and their sum (`error`) as
+    fractions of it.
+    """
+
+    def __init__(self, metrics):
+        self.duration = metrics.sad_speech
+        self.miss = metrics.sad_miss / self.duration if self.duration > 0 else 0.0
+        self.falarm = metrics.sad_falarm / self.duration if self.duration > 0 else 0.0
+        self.error = metrics.sad_error
+
+    def __repr__(self):
+        return (
+            "SADMetrics("
+            f"duration={self.duration:.2f},"
+            f"miss={self.miss:.2%},"
+            f"falarm={self.falarm:.2%},"
+            f"error={self.error:.2%})"
+        )
+
+
+def _DER(
+    ref,
+    hyp,
+    uem,
+    regions="all",
+    collar=0.0,
+    timeline=False,
+    num_threads=1,
+    mapper="hungarian",
+):
     ref_turns = TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref])
     hyp_turns = TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp])
     uem_turns = TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem])
     metrics = DERMetrics(
-        compute_der(ref_turns, hyp_turns, uem_turns, regions=regions, collar=collar)
+        compute_der(
+            ref_turns,
+            hyp_turns,
+            uem_turns,
+            regions=regions,
+            collar=collar,
+            timeline=timeline,
+            num_threads=num_threads,
+            mapper=mapper,
+        )
+    )
+    return metrics
+
+
+def _DER_cached(
+    ref,
+    hyp,
+    uem,
+    regions="all",
+    collar=0.0,
+    cache=None,
+    timeline=False,
+    num_threads=1,
+    mapper="hungarian",
+):
+    """
+    Compute DER for a single recording, serving it from the result cache
+    if the recording was already scored with the same inputs and options.
+    Timelines and approximate mappings are not cached, so recordings are always
+    rescored if one is requested.
+    """
+    if cache is None or timeline or mapper != "hungarian":
+        return _DER(
+            ref,
+            hyp,
+            uem,
+            regions=regions,
+            collar=collar,
+            timeline=timeline,
+            num_threads=num_threads,
+            mapper=mapper,
+        )
+    key = cache.key(ref, hyp, uem, regions, collar)
+    metrics = cache.get(key)
+    if metrics is not None:
+        return DERMetrics(metrics)
+    metrics = _DER(
+        ref, hyp, uem, regions=regions, collar=collar, num_threads=num_threads
     )
+    cache.put(key, metrics)
     return metrics
 
 
+def _DER_global(
+    ref_turns,
+    hyp_turns,
+    uem_turns,
+    reco_ids,
+    regions="all",
+    collar=0.0,
+    timeline=False,
+    num_threads=1,
+    mapper="hungarian",
+):
+    """
+    Compute DER for a set of recordings with a single speaker mapping, which is
+    found on the speaker overlaps accumulated over all of them. The speaker labels
+    are assumed to be global, i.e. the same label denotes the same speaker in
+    every recording.
+    """
+
+    def to_turn_list(turns):
+        return TurnList([Turn(turn[0], turn[1], turn[2]) for turn in turns])
+
+    refs = [to_turn_list(ref_turns[reco_id]) for reco_id in reco_ids]
+    hyps = [to_turn_list(hyp_turns[reco_id]) for reco_id in reco_ids]
+    uems = [
+        TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem_turns[reco_id]])
+        for reco_id in reco_ids
+    ]
+    results = compute_der_global(
+        refs,
+        hyps,
+        uems,
+        regions=regions,
+        collar=collar,
+        timeline=timeline,
+        num_threads=num_threads,
+        mapper=mapper,
+    )
+    return [DERMetrics(metrics) for metrics in results]
+
+
 def _DER_multi(
     ref_turns: dict,
     hyp_turns: dict,
@@ -50,9 +229,14 @@ def _DER_multi(
     collar=0.0,
     print_speaker_map=False,
     verbose=True,
+    cache=None,
+    global_mapping=False,
+    timeline=False,
+    num_threads=1,
+    batch=False,
+    mapper="hungarian",
 ):
-    all_metrics = []
-    speaker_maps = {}
+    reco_ids = []
     for reco_id in ref_turns:
         if reco_id not in hyp_turns:
             if skip_missing:
@@ -63,25 +247,189 @@ def _DER_multi(
                 continue
             else:
                 hyp_turns[reco_id] = []
-        metrics = _DER(
-            ref_turns[reco_id],
-            hyp_turns[reco_id],
-            uem_turns[reco_id],
+        reco_ids.append(reco_id)
+
+    if batch:
+        return _DER_batch(
+            ref_turns,
+            hyp_turns,
+            uem_turns,
+            reco_ids,
+            per_file=per_file,
             regions=regions,
             collar=collar,
+            print_speaker_map=print_speaker_map,
+            verbose=verbose,
+            global_mapping=global_mapping,
+            num_threads=num_threads,
+            mapper=mapper,
         )
-        all_metrics.append(
-            [
-                reco_id,
-                metrics.duration,
-                metrics.miss,
-                metrics.falarm,
-                metrics.conf,
-                metrics.der,
-            ]
+
+    if global_mapping:
+        # The shared mapping depends on every recording, so per-recording
+        # results cannot be served from the cache.
+        results = _DER_global(
+            ref_turns,
+            hyp_turns,
+            uem_turns,
+            reco_ids,
+            regions=regions,
+            collar=collar,
+            timeline=timeline,
+            num_threads=num_threads,
+            mapper=mapper,
         )
-        speaker_maps[reco_id] = {"ref": metrics.ref_map, "hyp": metrics.hyp_map}
+    else:
+        results = [
+            _DER_cached(
+                ref_turns[reco_id],
+                hyp_turns[reco_id],
+                uem_turns[reco_id],
+                regions=regions,
+                collar=collar,
+                cache=cache,
+                timeline=timeline,
+                num_threads=num_threads,
+                mapper=mapper,
+            )
+            for reco_id in reco_ids
+        ]
 
+    return _summarize(
+        dict(zip(reco_ids, results)),
+        per_file,
+        regions,
+        print_speaker_map,
+        verbose,
+        global_mapping,
+    )
+
+
+def _DER_batch(
+    ref_turns,
+    hyp_turns,
+    uem_turns,
+    reco_ids,
+    per_file=False,
+    regions="all",
+    collar=0.0,
+    print_speaker_map=False,
+    verbose=True,
+    global_mapping=False,
+    num_threads=1,
+    mapper="hungarian",
+):
+    """
+    Compute DER for a set of recordings, and return the results as a BatchMetrics,
+    which holds the per-recording metrics as NumPy arrays (`reco_ids`, `duration`,
+    `miss`, `falarm`, `conf`, `der`, `jer`) instead of a dict of DERMetrics. The
+    full metrics of a recording, with its speaker maps, are only converted when
+    accessed with `batch[reco_id]` or `batch[i]`.
+    """
+
+    def to_turn_list(turns):
+        return TurnList([Turn(turn[0], turn[1], turn[2]) for turn in turns])
+
+    results = compute_der_batch(
+        [str(reco_id) for reco_id in reco_ids],
+        [to_turn_list(ref_turns[reco_id]) for reco_id in reco_ids],
+        [to_turn_list(hyp_turns[reco_id]) for reco_id in reco_ids],
+        [
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem_turns[reco_id]])
+            for reco_id in reco_ids
+        ],
+        regions=regions,
+        collar=collar,
+        global_mapping=global_mapping,
+        num_threads=num_threads,
+        mapper=mapper,
+    )
+    if verbose:
+        overall = results.overall
+        rows = [
+            ["Overall", overall.duration]
+            + [overall.miss, overall.falarm, overall.conf, overall.der, overall.jer]
+        ]
+        if per_file:
+            columns = [results.reco_ids, results.duration, results.miss]
+            columns += [results.falarm, results.conf, results.der, results.jer]
+            rows = [list(row) for row in zip(*columns)] + rows
+        speaker_maps = None
+        if print_speaker_map:
+            speaker_maps = {
+                reco_id: {"ref": results[i].ref_map, "hyp": results[i].hyp_map}
+                for i, reco_id in enumerate(results.reco_ids)
+            }
+        _print_metrics(rows, len(results), regions, speaker_maps)
+    return results
+
+
+def _DER_segment_files(
+    ref_path,
+    hyp_path,
+    uem_path=None,
+    per_file=False,
+    skip_missing=False,
+    regions="all",
+    collar=0.0,
+    print_speaker_map=False,
+    verbose=True,
+    global_mapping=False,
+):
+    """
+    Compute DER between two binary segment files. The segments are scored
+    directly from the memory-mapped files.
+    """
+    results = compute_der_segment_files(
+        SegmentFile(ref_path),
+        SegmentFile(hyp_path),
+        uem_path,
+        skip_missing=skip_missing,
+        regions=regions,
+        collar=collar,
+        global_mapping=global_mapping,
+    )
+    results = {reco_id: DERMetrics(metrics) for reco_id, metrics in results}
+    return _summarize(
+        results, per_file, regions, print_speaker_map, verbose, global_mapping
+    )
+
+
+# Breakdowns of the errors by overlap degree, as (N_ref x N_hyp) matrices.
+_DEGREE_FIELDS = (
+    "degree_time",
+    "degree_duration",
+    "degree_miss",
+    "degree_falarm",
+    "degree_conf",
+)
+_TOTAL_FIELDS = (
+    "sad_speech",
+    "sad_miss",
+    "sad_falarm",
+    "error_bound",
+    "duration_bound",
+)
+
+
+def _summarize(
+    results, per_file, regions, print_speaker_map, verbose, global_mapping=False
+):
+    """
+    Aggregate per-recording results into the overall DER and JER, and print them
+    if `verbose` is set. The overall JER is the average over the reference speakers
+    of all recordings, and the overlap degree breakdowns are summed. The mapping
+    gaps are summed too, unless the recordings share a `global_mapping`, whose gap
+    each of them reports. Per-recording results are returned as they are, so they
+    keep their speaker maps and speaker-level breakdown.
+    """
+    all_metrics = [
+        [reco_id, m.duration, m.miss, m.falarm, m.conf, m.der, m.jer]
+        for reco_id, m in results.items()
+    ]
+    speaker_maps = {
+        reco_id: {"ref": m.ref_map, "hyp": m.hyp_map} for reco_id, m in results.items()
+    }
     total_duration = sum([x[1] for x in all_metrics])
     total_miss = sum([x[1] * x[2] for x in all_metrics])  # duration*miss
     total_falarm = sum([x[1] * x[3] for x in all_metrics])  # duration*falarm
@@ -91,33 +439,270 @@ def _DER_multi(
     falarm = total_falarm / total_duration
     conf = total_conf / total_duration
     der = miss + falarm + conf
-    all_metrics.append(["Overall", total_duration, miss, falarm, conf, der])
+    speaker_jer = [
+        1 - np.asarray(m.ref_jaccard)[np.asarray(m.ref_duration) > 0]
+        for m in results.values()
+    ]
+    speaker_jer = np.concatenate(speaker_jer) if speaker_jer else np.zeros(0)
+    jer = speaker_jer.mean() if len(speaker_jer) > 0 else 0.0
+    all_metrics.append(["Overall", total_duration, miss, falarm, conf, der, jer])
 
     selected_metrics = all_metrics if per_file else [all_metrics[-1]]
     if verbose:
-        print(f"Evaluated {len(all_metrics)} recordings on `{regions}` regions.")
-        if print_speaker_map:
-            from pprint import pprint
+        _print_metrics(
+            selected_metrics,
+            len(all_metrics),
+            regions,
+            speaker_maps if print_speaker_map else None,
+        )
+    overall = Metrics(*all_metrics[-1][1:5])
+    overall.jer = jer
+    for m in results.values():
+        overall.mapper = m.mapper
+    gaps = [m.mapping_gap for m in results.values()]
+    overall.mapping_gap = max(gaps, default=0.0) if global_mapping else sum(gaps)
+    for field in _DEGREE_FIELDS:
+        values = [np.asarray(getattr(m, field)) for m in results.values()]
+        if values:
+            setattr(overall, field, np.sum(values, axis=0))
+    # SAD errors, and the bounds of approximate results, add up over recordings.
+    for field in _TOTAL_FIELDS:
+        setattr(overall, field, sum(getattr(m, field) for m in results.values()))
+    overall = DERMetrics(overall)
+    if per_file:
+        return {**results, "Overall": overall}
+    return {"Overall": overall}
 
-            print("Speaker map:")
-            pprint(speaker_maps, width=1)
-        print("DER metrics:")
-        print(
-            tabulate(
-                selected_metrics,
-                headers=[
-                    "Recording",
-                    "Duration (s)",
-                    "Miss.",
-                    "F.Alarm.",
-                    "Conf.",
-                    "DER",
-                ],
-                tablefmt="fancy_grid",
-                floatfmt=[None, ".2f", ".2%", ".2%", ".2%", ".2%"],
+
+def _print_metrics(selected_metrics, num_evaluated, regions, speaker_maps=None):
+    print(f"Evaluated {num_evaluated} recordings on `{regions}` regions.")
+    if speaker_maps is not None:
+        from pprint import pprint
+
+        print("Speaker map:")
+        pprint(speaker_maps, width=1)
+    print("DER metrics:")
+    print(
+        tabulate(
+            selected_metrics,
+            headers=[
+                "Recording",
+                "Duration (s)",
+                "Miss.",
+                "F.Alarm.",
+                "Conf.",
+                "DER",
+                "JER",
+            ],
+            tablefmt="fancy_grid",
+            floatfmt=[None, ".2f", ".2%", ".2%", ".2%", ".2%", ".2%"],
+        )
+    )
+
+
+class DERStream:
+    """
+    Score recordings as they are produced. Recordings are added one at a time
+    (or from an iterator of `(reco_id, ref, hyp, uem)` items with `update()`),
+    and are scored on a native pool of worker threads. Adding a recording blocks
+    while `max_pending` recordings are waiting to be scored, so memory stays
+    bounded however many recordings are streamed. The running corpus metrics
+    can be queried at any time with `stats()`.
+
+    Per-recording results are only kept if `per_file` is set, in which case
+    they grow with the number of recordings.
+
+    Example:
+        with DERStream(collar=0.25) as stream:
+            stream.update(generate_hypotheses())
+            print(stream.stats())
+    """
+
+    def __init__(
+        self,
+        regions="all",
+        collar=0.0,
+        per_file=False,
+        num_threads=0,
+        max_pending=0,
+        verbose=False,
+    ):
+        self.regions = regions
+        self.per_file = per_file
+        self.verbose = verbose
+        self._stream = ScoringStream(
+            regions=regions,
+            collar=collar,
+            num_threads=num_threads,
+            max_pending=max_pending,
+            keep_results=per_file,
+        )
+        self._results = {}
+        self._summary = None
+
+    def add(self, reco_id, ref, hyp, uem=None):
+        """
+        Queue a recording for scoring. If `uem` is None, the union of ref and
+        hyp is scored, as in DER().
+        """
+        if hyp is None:
+            hyp = []
+        if self.per_file:
+            # reserve the slot, so that results are kept in the order they are added
+            self._results[reco_id] = None
+        if uem is None:
+            uem = get_uem_turns(list(ref), list(hyp))
+        self._stream.push(
+            reco_id,
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref]),
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem]),
+        )
+        self._collect()
+
+    def update(self, items):
+        """
+        Queue the recordings of an iterator of `(reco_id, ref, hyp, uem)` items.
+        Items are pulled from the iterator only as fast as they are scored.
+        """
+        for reco_id, ref, hyp, uem in items:
+            self.add(reco_id, ref, hyp, uem)
+        return self
+
+    def stats(self):
+        """
+        Running corpus metrics (DERMetrics) over the recordings scored so far.
+        """
+        return DERMetrics(self._stream.stats())
+
+    @property
+    def num_scored(self):
+        return self._stream.num_scored
+
+    @property
+    def num_pending(self):
+        return self._stream.num_pending
+
+    def _collect(self):
+        for reco_id, metrics in self._stream.pop_results():
+            self._results[reco_id] = DERMetrics(metrics)
+
+    def close(self):
+        """
+        Wait for the queued recordings, and return the results in the same form
+        as DER(): {recording_id: DERMetrics} and the overall metrics if `per_file`
+        is set, otherwise {"Overall": DERMetrics}.
+        """
+        if self._summary is not None:
+            return self._summary
+        self._stream.close()
+        self._collect()
+        if self.per_file:
+            self._summary = _summarize(
+                self._results, True, self.regions, False, self.verbose
             )
+        else:
+            overall = self.stats()
+            if self.verbose:
+                row = [
+                    "Overall",
+                    overall.duration,
+                    overall.miss,
+                    overall.falarm,
+                    overall.conf,
+                    overall.der,
+                    overall.jer,
+                ]
+                _print_metrics([row], self.num_scored, self.regions)
+            self._summary = {"Overall": overall}
+        return self._summary
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        if exc_type is None:
+            self.close()
+
+
+class DERSession:
+    """
+    Rescore a single recording as its turns are edited, e.g. in an annotation
+    tool that shows the DER after every correction. An edit only revisits the
+    time span it changes (and the collar around it), and the speaker mapping is
+    only solved again when the edit could change it, so edits take time
+    proportional to the edited span rather than to the recording.
+
+    The turns get ids in input order, reference turns first; `insert()` returns
+    the id of a new turn. If `uem` is None, the span from the earliest start to
+    the latest end of the current turns is scored, as in DER().
+
+    Example:
+        session = DERSession(ref, hyp, collar=0.25)
+        turn_id = session.insert("hyp", "2", 10.5, 12.0)
+        session.move(turn_id, 10.4, 12.0)
+        print(session.metrics)
+    """
+
+    def __init__(self, ref, hyp, uem=None, regions="all", collar=0.0):
+        self._session = ScoringSession(
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref]),
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem or []]),
+            regions=regions,
+            collar=collar,
         )
-    return {m[0]: DERMetrics(Metrics(*m[1:-1])) for m in selected_metrics}
+
+    def insert(self, system, speaker, start, end):
+        """
+        Add a turn to the reference (`system="ref"`) or hypothesis
+        (`system="hyp"`), and return its id.
+        """
+        if system not in ("ref", "hyp"):
+            raise ValueError(f"system must be 'ref' or 'hyp', got {system!r}")
+        return self._session.insert(system == "ref", speaker, start, end)
+
+    def delete(self, turn_id):
+        """Remove a turn."""
+        self._session.remove(turn_id)
+
+    def move(self, turn_id, start, end):
+        """Change the start and end times of a turn."""
+        self._session.move(turn_id, start, end)
+
+    def relabel(self, turn_id, speaker):
+        """Change the speaker label of a turn."""
+        self._session.relabel(turn_id, speaker)
+
+    def turn(self, turn_id):
+        """The current (speaker, start, end) of a turn."""
+        return self._session.turn(turn_id)
+
+    @property
+    def metrics(self):
+        """Current DERMetrics of the recording."""
+        return DERMetrics(self._session.metrics())
+
+    @property
+    def num_solves(self):
+        """Number of times the speaker mapping was solved."""
+        return self._session.num_solves
+
+
+def read_rttm_turns(path):
+    """
+    Read an RTTM file into a dict of recording id to list of (speaker, start, end).
+    gzip and zstd compressed files are decompressed while they are parsed.
+    """
+    return defaultdict(list, read_rttm(path))
+
+
+def read_uem_turns(path):
+    """
+    Read a UEM file into a dict of recording id to list of (start, end).
+    gzip and zstd compressed files are decompressed while they are parsed.
+    """
+    return defaultdict(list, read_uem(path))
 
 
 def get_uem_turns(ref_turns, hyp_turns):
@@ -144,7 +729,7 @@ def get_uem_turns(ref_turns, hyp_turns):
 
 def DER(
     ref,
-    hyp,
+    hyp=None,
     uem=None,
     per_file=False,
     skip_missing=False,
@@ -152,6 +737,14 @@ def DER(
     collar=0.0,
     print_speaker_map=False,
     verbose=False,
+    cache_dir=None,
+    cache_size=1 << 30,
+    global_mapping=False,
+    timeline=False,
+    num_threads=1,
+    batch=False,
+    daemon=None,
+    mapper="hungarian",
 ):
     """
     Compute DER between ref and hyp.
@@ -159,9 +752,13 @@ def DER(
         - list of tuples: list of turns of single recording
         - dict: {recording_id: list of turns}
         - list of ndarrays: list of numpy arrays; each array contains turns of a recording
+        - str: path of an RTTM file (and of a UEM file for `uem`)
+    If `hyp` is None, `ref` is instead an iterable (e.g. a generator) of
+    `(recording_id, ref_turns, hyp_turns, uem_turns)` items, which are scored as they
+    are produced with bounded memory (see DERStream). `uem_turns` may be None.
 
     Args:
-        ref (dict or list): Reference turns.
+        ref (dict or list or iterable): Reference turns, or an iterable of recordings.
         hyp (dict or list): Hypothesis turns.
         uem (dict or list): UEM turns. If None, we will use the union of ref and hyp.
         per_file (bool): If True, return DER for each file. Otherwise, return overall DER.
@@ -174,6 +771,43 @@ def DER(
                 i.e. single speaker regions and silence regions.
         collar (float): Collar size in seconds.
         verbose (bool): If True, print DER for each file.
+        cache_dir (str): If given, per-recording results are cached in this directory,
+            and recordings whose turns and scoring options are unchanged are served
+            from the cache instead of being rescored.
+        cache_size (int): Size cap of the result cache in bytes.
+        global_mapping (bool): If True, find a single speaker mapping for all recordings
+            instead of one per recording. This assumes that speaker labels are shared
+            across recordings (e.g. speaker identification on a corpus). The cache is
+            not used in this mode.
+        timeline (bool): If True, each per-recording result has a `timeline` attribute
+            that gives the DER of arbitrary time windows (`timeline.window(t0, t1)`) and
+            DER curves over sliding windows (`timeline.sliding_window(length, hop)`).
+            The scored regions are available as a NumPy structured array in
+            `timeline.regions`.
+        num_threads (int): Number of threads used to score each recording (0 means all
+            available cores). Long recordings are split into chunks at UEM gaps and at
+            points where both ref and hyp are silent, and the chunks are processed in
+            parallel. With `global_mapping`, recordings are processed in parallel instead.
+            When streaming recordings, it is the number of worker threads.
+        batch (bool): If True and `ref` and `hyp` hold several recordings, return a
+            `BatchMetrics` instead of a dict. It holds the per-recording metrics as NumPy
+            arrays (`reco_ids`, `duration`, `miss`, `falarm`, `conf`, `der`, `jer`) and
+            the overall metrics (`overall`), and the full metrics of a recording are only
+            built when accessed (`batch[reco_id]`). Recordings are scored in parallel
+            with `num_threads` threads. The cache is not used in this mode.
+        daemon (bool or str): Whether to score on a running scoring daemon (see
+            `spyder-daemon`). By default (None), the daemon is used if one is listening
+            on the default socket, and jobs it cannot run (`timeline`, `batch`,
+            `cache_dir` or an approximate `mapper`) are scored locally. A str is taken
+            as the socket path. RTTM files given by path are parsed once by the daemon
+            and kept in memory.
+        mapper (str): Speaker mapping algorithm. 'hungarian' finds the optimal mapping.
+            'greedy' (pairs speakers by decreasing overlap) and 'auction' (ε-auction) are
+            approximate but take near-linear time in the number of co-occurring speaker
+            pairs, for hypotheses with thousands of speakers or corpus-level mappings.
+            Each result reports its `mapper` and `mapping_gap`, a bound in seconds on the
+            overlap between mapped speakers missed with respect to the optimal mapping.
+            Not used when streaming recordings.
 
     Returns:
         dict: {recording_id: DERMetrics} if per_file is True, otherwise {overall: DERMetrics}.
@@ -186,8 +820,108 @@ def DER(
             - ref_map: Speaker map from reference to common labels.
             - hyp_map: Speaker map from hypothesis to common labels.
     """
+    if hyp is None:
+        stream = DERStream(
+            regions=regions,
+            collar=collar,
+            per_file=per_file,
+            num_threads=num_threads,
+            verbose=verbose,
+        )
+        return stream.update(ref).close()
+    if (
+        daemon is not False
+        and cache_dir is None
+        and not timeline
+        and not batch
+        and mapper == "hungarian"
+        and _daemon_supports(ref, hyp, uem)
+    ):
+        from .daemon import connect_daemon
+
+        client = connect_daemon(daemon if isinstance(daemon, str) else None)
+        if client is not None:
+            with client:
+                return client.score(
+                    ref,
+                    hyp,
+                    uem,
+                    per_file,
+                    skip_missing,
+                    regions,
+                    collar,
+                    print_speaker_map,
+                    verbose,
+                    global_mapping,
+                    num_threads,
+                )
+    if isinstance(ref, str):
+        ref = read_rttm_turns(ref)
+    if isinstance(hyp, str):
+        hyp = read_rttm_turns(hyp)
+    if isinstance(uem, str):
+        uem = read_uem_turns(uem)
     if uem is None:
         uem = get_uem_turns(ref, hyp)
+    cache = ResultCache(cache_dir, cache_size) if cache_dir is not None else None
+    try:
+        metrics = _DER_any(
+            ref,
+            hyp,
+            uem,
+            per_file,
+            skip_missing,
+            regions,
+            collar,
+            print_speaker_map,
+            verbose,
+            cache,
+            global_mapping,
+            timeline,
+            num_threads,
+            batch,
+            mapper,
+        )
+    finally:
+        if cache is not None:
+            cache.close()
+    return metrics
+
+
+def _daemon_supports(ref, hyp, uem):
+    """
+    Whether the inputs can be sent to the daemon: paths, dicts of turns, or the
+    turns of a single recording.
+    """
+
+    def supported(turns):
+        return (
+            isinstance(turns, (str, dict))
+            or isinstance(turns, (list, tuple))
+            and len(turns) > 0
+            and np.ndim(turns[-1]) == 1
+        )
+
+    return supported(ref) and supported(hyp) and (uem is None or supported(uem))
+
+
+def _DER_any(
+    ref,
+    hyp,
+    uem,
+    per_file,
+    skip_missing,
+    regions,
+    collar,
+    print_speaker_map,
+    verbose,
+    cache,
+    global_mapping=False,
+    timeline=False,
+    num_threads=1,
+    batch=False,
+    mapper="hungarian",
+):
     if isinstance(ref, dict) and isinstance(hyp, dict):
         assert isinstance(uem, dict), "UEM must be dict if ref and hyp are dict"
         metrics = _DER_multi(
@@ -200,6 +934,12 @@ def DER(
             collar,
             print_speaker_map,
             verbose,
+            cache,
+            global_mapping,
+            timeline,
+            num_threads,
+            batch,
+            mapper,
         )
     elif np.ndim(ref[-1]) == 2 and np.ndim(hyp[-1]) == 2:
         # the first dimension is the number of utterances
@@ -224,11 +964,19 @@ def DER(
             collar,
             print_speaker_map,
             verbose,
+            cache,
+            global_mapping,
+            timeline,
+            num_threads,
+            batch,
+            mapper,
         )
     elif np.ndim(ref[-1]) == 1 and np.ndim(hyp[-1]) == 1:
         assert isinstance(uem, list), "UEM must be list if ref and hyp are list"
         # only one utterance
-        metrics = _DER(ref, hyp, uem, regions, collar)
+        metrics = _DER_cached(
+            ref, hyp, uem, regions, collar, cache, timeline, num_threads, mapper
+        )
         if verbose:
             print(metrics)
     else:
@@ -236,6 +984,317 @@ def DER(
     return metrics
 
 
+def DER_multi_reference(
+    refs, hyp, uem=None, regions="all", collar=0.0, num_threads=1, verbose=False
+):
+    """
+    Compute DER of a single recording against several reference annotations (e.g.
+    from independent annotators), in one call. The hypothesis is prepared once, and
+    merged against each reference; each reference gets its own speaker mapping.
+
+    Args:
+        refs (list or dict): Reference turns of each annotation, as a list, or as a
+            dict keyed by annotator.
+        hyp (list): Hypothesis turns.
+        uem (list): UEM turns. If None, we will use the union of all refs and hyp.
+        regions (str): Regions to evaluate (see DER).
+        collar (float): Collar size in seconds, around the boundaries of each reference.
+        num_threads (int): Number of threads, used over the references (0 means all
+            available cores).
+        verbose (bool): If True, print the DER against each reference.
+
+    Returns:
+        dict: {annotator: DERMetrics} with the list index or dict key of each reference,
+        plus "min", the metrics against the reference with the lowest DER, and "mean",
+        the metrics (duration, miss, falarm, conf, der, jer) averaged over references.
+    """
+    keys = list(refs) if isinstance(refs, dict) else list(range(len(refs)))
+    ref_turns = [refs[key] for key in keys]
+    if uem is None:
+        uem = get_uem_turns([turn for turns in ref_turns for turn in turns], hyp)
+    results = compute_der_multi_ref(
+        [
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in turns])
+            for turns in ref_turns
+        ],
+        TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+        TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem]),
+        regions=regions,
+        collar=collar,
+        num_threads=num_threads,
+    )
+    results = {key: DERMetrics(metrics) for key, metrics in zip(keys, results)}
+
+    best = min(keys, key=lambda key: results[key].der)
+    mean = Metrics(
+        *[
+            np.mean([getattr(results[key], field) for key in keys])
+            for field in ["duration", "miss", "falarm", "conf"]
+        ]
+    )
+    mean.jer = np.mean([results[key].jer for key in keys])
+    results["min"] = results[best]
+    results["mean"] = DERMetrics(mean)
+    if verbose:
+        rows = [
+            [key, m.duration, m.miss, m.falarm, m.conf, m.der, m.jer]
+            for key, m in results.items()
+        ]
+        _print_metrics(rows, 1, regions)
+    return results
+
+
+def DER_matrix(
+    systems, uem=None, per_file=False, regions="all", collar=0.0, num_threads=0
+):
+    """
+    Compute DER between every pair of systems (e.g. the outputs of several diarization
+    systems, or several annotations), in one call. Each system is prepared once per
+    recording, and the scoring of all the pairs and recordings is spread over
+    `num_threads` threads. Entry (i, j) of the DER matrix is the DER of system j with
+    system i as the reference, as given by `DER(systems[i], systems[j])` (with one
+    speaker mapping per recording and pair), so the matrix is not symmetric. The
+    diagonal is 0.
+
+    Args:
+        systems (list or dict): Turns of each system, as a list, or as a dict keyed by
+            system name (in which case rows and columns follow the order of the keys).
+            Each system is a dict {recording_id: list of turns} or the path of an RTTM
+            file. A recording missing from a system is not scored with that system as
+            the reference, and is scored as empty with it as the hypothesis.
+        uem (dict or str): UEM turns. If None, we will use the union of all systems.
+        per_file (bool): If True, return the DER matrix of each recording as well.
+        regions (str): Regions to evaluate (see DER).
+        collar (float): Collar size in seconds, around the boundaries of the reference
+            system.
+        num_threads (int): Number of threads (0 means all available cores).
+
+    Returns:
+        ndarray: the K x K DER matrix if per_file is False. Otherwise, a dict
+        {recording_id: ndarray} with the DER matrix of each recording, plus "Overall",
+        the DER matrix over all the recordings (errors weighted by the scored duration
+        of each recording, as in DER).
+    """
+    keys = list(systems) if isinstance(systems, dict) else list(range(len(systems)))
+    system_turns = [
+        read_rttm_turns(systems[key]) if isinstance(systems[key], str) else systems[key]
+        for key in keys
+    ]
+    if isinstance(uem, str):
+        uem = read_uem_turns(uem)
+    reco_ids = list(
+        dict.fromkeys(reco_id for turns in system_turns for reco_id in turns)
+    )
+    if uem is None:
+        uem = {}
+        for reco_id in reco_ids:
+            turns = [t for s in system_turns for t in s.get(reco_id, [])]
+            uem[reco_id] = (
+                [(min(t[1] for t in turns), max(t[2] for t in turns))] if turns else []
+            )
+
+    def to_turn_list(turns):
+        return TurnList([Turn(turn[0], turn[1], turn[2]) for turn in turns])
+
+    results = compute_der_pairwise(
+        [str(reco_id) for reco_id in reco_ids],
+        [
+            [
+                to_turn_list(turns[reco_id]) if reco_id in turns else None
+                for reco_id in reco_ids
+            ]
+            for turns in system_turns
+        ],
+        [
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem.get(reco_id, [])])
+            for reco_id in reco_ids
+        ],
+        regions=regions,
+        collar=collar,
+        num_threads=num_threads,
+        per_recording=per_file,
+    )
+    if not per_file:
+        return results.der
+    matrices = dict(zip(reco_ids, results.reco_der))
+    matrices["Overall"] = results.der
+    return matrices
+
+
+def DER_approx(
+    ref,
+    hyp,
+    uem=None,
+    frame_shift=0.1,
+    per_file=False,
+    skip_missing=False,
+    regions="all",
+    collar=0.0,
+    verbose=False,
+):
+    """
+    Compute an approximation of DER between ref and hyp, for quick checks such as
+    monitoring a model during training. The turns are rasterized onto a grid of
+    frames of `frame_shift` seconds, and the speaker mapping and errors are computed
+    on the frames instead of the exact regions. Only frames that contain a turn
+    boundary can be scored differently from the exact regions, which gives
+    guaranteed bounds on the exact DER (`der_lower` and `der_upper`) for the `all`
+    regions without a collar. Otherwise the speaker mapping is found on other
+    frames than the scored ones, and may differ from the exact mapping by an amount
+    that the frames do not bound, so both bounds (and `error_bound`) are NaN.
+    Larger frames are faster to score, and give wider bounds.
+
+    Args:
+        ref (dict or list or str): Reference turns (see DER).
+        hyp (dict or list or str): Hypothesis turns.
+        uem (dict or list or str): UEM turns. If None, we will use the union of ref
+            and hyp.
+        frame_shift (float): Frame length in seconds.
+        per_file (bool): If True, return the metrics of each recording as well.
+        skip_missing (bool): If True, skip recordings missing in the hypothesis.
+        regions (str): Regions to evaluate (see DER).
+        collar (float): Collar size in seconds.
+        verbose (bool): If True, print the DER and its bounds.
+
+    Returns:
+        DERMetrics for a single recording, otherwise a dict as returned by DER. Besides
+        the usual metrics, each DERMetrics has `der_lower` and `der_upper`, and the
+        bounds on the errors and scored duration (`error_bound` and `duration_bound`,
+        in seconds) from which they follow.
+    """
+    if isinstance(ref, str):
+        ref = read_rttm_turns(ref)
+    if isinstance(hyp, str):
+        hyp = read_rttm_turns(hyp)
+    if isinstance(uem, str):
+        uem = read_uem_turns(uem)
+    if uem is None:
+        uem = get_uem_turns(ref, hyp)
+
+    def score(ref, hyp, uem):
+        return DERMetrics(
+            compute_der_approx(
+                TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref]),
+                TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+                TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem]),
+                regions=regions,
+                collar=collar,
+                frame_shift=frame_shift,
+            )
+        )
+
+    if not isinstance(ref, dict):
+        metrics = score(ref, hyp, uem)
+        if verbose:
+            print(metrics, _format_bounds(metrics))
+        return metrics
+
+    results = {}
+    for reco_id in ref:
+        if reco_id not in hyp and skip_missing:
+            continue
+        results[reco_id] = score(ref[reco_id], hyp.get(reco_id, []), uem[reco_id])
+    # The bounds of the recordings add up to bounds on the overall totals.
+    summary = _summarize(results, per_file, regions, False, verbose)
+    overall = summary["Overall"]
+    if verbose:
+        print(f"Overall DER {_format_bounds(overall)}")
+    return summary
+
+
+def _format_bounds(metrics):
+    if np.isnan(metrics.der_lower):
+        return "bounds: none (collar or regions other than 'all')"
+    return f"bounds: [{metrics.der_lower:.2%}, {metrics.der_upper:.2%}]"
+
+
+def SAD(
+    ref,
+    hyp,
+    uem=None,
+    per_file=False,
+    skip_missing=False,
+    regions="all",
+    collar=0.0,
+    verbose=False,
+):
+    """
+    Compute speaker-agnostic speech activity (SAD) metrics between ref and hyp:
+    missed speech (reference speech without hypothesis speech) and false alarm
+    (hypothesis speech without reference speech), as fractions of the reference
+    speech time. The same metrics come with every DER result (`sad_speech`,
+    `sad_miss`, `sad_falarm` in seconds, and `sad_error`); this function skips the
+    speaker mapping, so it is faster when only the SAD metrics are needed.
+
+    Args:
+        ref (dict or list or str): Reference turns (see DER).
+        hyp (dict or list or str): Hypothesis turns.
+        uem (dict or list or str): UEM turns. If None, we will use the union of ref
+            and hyp.
+        per_file (bool): If True, return the metrics of each recording as well.
+        skip_missing (bool): If True, skip recordings missing in the hypothesis.
+        regions (str): Regions to evaluate (see DER).
+        collar (float): Collar size in seconds.
+        verbose (bool): If True, print the metrics.
+
+    Returns:
+        SADMetrics for a single recording, otherwise a dict {recording_id: SADMetrics}
+        (if per_file is True) with the overall metrics under "Overall".
+    """
+    if isinstance(ref, str):
+        ref = read_rttm_turns(ref)
+    if isinstance(hyp, str):
+        hyp = read_rttm_turns(hyp)
+    if isinstance(uem, str):
+        uem = read_uem_turns(uem)
+    if uem is None:
+        uem = get_uem_turns(ref, hyp)
+
+    def score(ref, hyp, uem):
+        return compute_sad(
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in ref]),
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in hyp]),
+            TurnList([Turn("dummy", turn[0], turn[1]) for turn in uem]),
+            regions=regions,
+            collar=collar,
+        )
+
+    if not isinstance(ref, dict):
+        metrics = SADMetrics(score(ref, hyp, uem))
+        if verbose:
+            print(metrics)
+        return metrics
+
+    results = {}
+    for reco_id in ref:
+        if reco_id not in hyp and skip_missing:
+            continue
+        results[reco_id] = score(ref[reco_id], hyp.get(reco_id, []), uem[reco_id])
+    overall = Metrics(0, 0, 0, 0)
+    for field in ("sad_speech", "sad_miss", "sad_falarm"):
+        setattr(overall, field, sum(getattr(m, field) for m in results.values()))
+    summary = {reco_id: SADMetrics(m) for reco_id, m in results.items()}
+    summary["Overall"] = SADMetrics(overall)
+    if verbose:
+        rows = [
+            [reco_id, m.duration, m.miss, m.falarm, m.error]
+            for reco_id, m in summary.items()
+        ]
+        print(f"Evaluated {len(results)} recordings on `{regions}` regions.")
+        print("SAD metrics:")
+        print(
+            tabulate(
+                rows if per_file else rows[-1:],
+                headers=["Recording", "Speech (s)", "Miss.", "F.Alarm.", "Error"],
+                tablefmt="fancy_grid",
+                floatfmt=[None, ".2f", ".2%", ".2%", ".2%"],
+            )
+        )
+    if per_file:
+        return summary
+    return {"Overall": summary["Overall"]}
+
+
 @click.command()
 @click.argument("ref_rttm", nargs=1, type=click.Path(exists=True))
 @click.argument("hyp_rttm", nargs=1, type=click.Path(exists=True))
@@ -291,6 +1350,29 @@ def DER(
     show_default=True,
     help="Print speaker mapping for reference and hypothesis speakers.",
 )
+@click.option(
+    "--cache-dir",
+    type=click.Path(file_okay=False),
+    default=None,
+    help="Cache per-recording results in this directory. Recordings whose ref, hyp, "
+    "UEM and scoring options are unchanged are not rescored.",
+)
+@click.option(
+    "--cache-size",
+    type=click.IntRange(min=1),
+    default=1024,
+    show_default=True,
+    help="Size cap of the result cache in MB.",
+)
+@click.option(
+    "--global-mapping",
+    "-g",
+    is_flag=True,
+    default=False,
+    show_default=True,
+    help="Use a single speaker mapping for all recordings, for speaker labels that are "
+    "shared across the corpus.",
+)
 def compute_der_from_rttm(
     ref_rttm,
     hyp_rttm,
@@ -300,46 +1382,75 @@ def compute_der_from_rttm(
     regions="all",
     collar=0.0,
     print_speaker_map=False,
+    cache_dir=None,
+    cache_size=1024,
+    global_mapping=False,
     verbose=True,
 ):
-    ref_turns = defaultdict(list)
-    hyp_turns = defaultdict(list)
-
-    with open(ref_rttm, "r") as f:
-        for line in f:
-            parts = line.strip().split()
-            spk = parts[7]
-            start = float(parts[3])
-            end = start + float(parts[4])
-            ref_turns[parts[1]].append((spk, start, end))
-
-    with open(hyp_rttm, "r") as f:
-        for line in f:
-            parts = line.strip().split()
-            spk = parts[7]
-            start = float(parts[3])
-            end = start + float(parts[4])
-            hyp_turns[parts[1]].append((spk, start, end))
-
-    uem_turns = defaultdict(list)
+    if is_segment_file(ref_rttm) or is_segment_file(hyp_rttm):
+        if not (is_segment_file(ref_rttm) and is_segment_file(hyp_rttm)):
+            raise click.UsageError(
+                "REF_RTTM and HYP_RTTM must both be RTTM files or both be segment files"
+            )
+        _DER_segment_files(
+            ref_rttm,
+            hyp_rttm,
+            uem,
+            per_file,
+            skip_missing,
+            regions,
+            collar,
+            print_speaker_map,
+            verbose,
+            global_mapping,
+        )
+        return
+
+    ref_turns = read_rttm_turns(ref_rttm)
+    hyp_turns = read_rttm_turns(hyp_rttm)
     if uem is not None:
-        with open(uem, "r") as f:
-            for line in f:
-                parts = line.strip().split()
-                start = float(parts[2])
-                end = float(parts[3])
-                uem_turns[parts[0]].append((start, end))
+        uem_turns = read_uem_turns(uem)
     else:
         uem_turns = get_uem_turns(ref_turns, hyp_turns)
 
-    _DER_multi(
-        ref_turns,
-        hyp_turns,
-        uem_turns,
-        per_file,
-        skip_missing,
-        regions,
-        collar,
-        print_speaker_map,
-        verbose,
-    )
+    cache = None
+    if cache_dir is not None:
+        cache = ResultCache(cache_dir, cache_size * (1 << 20))
+    try:
+        _DER_multi(
+            ref_turns,
+            hyp_turns,
+            uem_turns,
+            per_file,
+            skip_missing,
+            regions,
+            collar,
+            print_speaker_map,
+            verbose,
+            cache,
+            global_mapping,
+        )
+    finally:
+        if cache is not None:
+            cache.close()
+
+
+@click.command()
+@click.argument("input_path", nargs=1, type=click.Path(exists=True))
+@click.argument("output_path", nargs=1, type=click.Path())
+@click.option(
+    "--no-merge",
+    is_flag=True,
+    default=False,
+    show_default=True,
+    help="Do not merge overlapping turns of the same speaker when writing a segment file.",
+)
+def convert_segment_file(input_path, output_path, no_merge=False):
+    """
+    Convert between RTTM and binary segment files. If INPUT_PATH is an RTTM
+    file, it is written as a segment file to OUTPUT_PATH, and vice versa.
+    """
+    if is_segment_file(input_path):
+        segment_file_to_rttm(input_path, output_path)
+    else:
+        rttm_to_segment_file(input_path, output_path, merge=not no_merge)
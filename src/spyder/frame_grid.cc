@@ -0,0 +1,219 @@
+// spyder/frame_grid.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_FRAME_GRID_CC
+#define SPYDER_FRAME_GRID_CC
+
+#include "frame_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+namespace spyder {
+
+// Set the bits [first, last) of a bitset.
+static void set_bits(uint64_t *bits, size_t first, size_t last) {
+  for (size_t f = first; f < last;) {
+    size_t w = f / 64, offset = f % 64;
+    size_t count = std::min<size_t>(64 - offset, last - f);
+    uint64_t mask = (count == 64) ? ~0ULL : ((1ULL << count) - 1) << offset;
+    bits[w] |= mask;
+    f += count;
+  }
+}
+
+FrameGrid::FrameGrid(const SegmentView &ref, const SegmentView &hyp, const SegmentView &uem,
+                     double frame_shift)
+    : frame_shift(frame_shift), num_frames(0), num_ref(ref.num_speakers),
+      num_hyp(hyp.num_speakers) {
+  if (!(frame_shift > 0)) throw std::invalid_argument("Frame shift must be positive");
+
+  // Sort and merge the UEM segments, and cut each of them into frames.
+  std::vector<std::pair<double, double>> scored;
+  for (size_t k = 0; k < uem.size; ++k)
+    if (uem.start[k] < uem.end[k]) scored.push_back(std::make_pair(uem.start[k], uem.end[k]));
+  std::sort(scored.begin(), scored.end());
+  std::vector<std::pair<double, double>> segments;
+  for (auto &segment : scored) {
+    if (!segments.empty() && segment.first <= segments.back().second)
+      segments.back().second = std::max(segments.back().second, segment.second);
+    else
+      segments.push_back(segment);
+  }
+  std::vector<size_t> first_frame, segment_frames;
+  for (auto &segment : segments) {
+    double length = segment.second - segment.first;
+    size_t n = std::max<size_t>(1, (size_t)std::ceil(length / frame_shift - 1e-9));
+    double last_length = length - (n - 1) * frame_shift;
+    first_frame.push_back(num_frames);
+    segment_frames.push_back(n);
+    num_frames += n;
+    if (last_length != frame_shift)
+      short_frames.push_back(std::make_pair(num_frames - 1, last_length));
+  }
+  num_words = (num_frames + 63) / 64;
+
+  // Frame times are computed from the start of their UEM segment, so that
+  // rounding errors do not accumulate along the recording.
+  auto midpoint = [&](size_t u, size_t i) {
+    double start = segments[u].first + i * frame_shift;
+    if (i + 1 < segment_frames[u]) return start + frame_shift / 2;
+    return (start + segments[u].second) / 2;
+  };
+  // First frame of UEM segment u whose midpoint is at or after t.
+  auto first_frame_after = [&](size_t u, double t) {
+    double offset = std::ceil((t - segments[u].first) / frame_shift - 0.5);
+    size_t n = segment_frames[u];
+    size_t i = (offset <= 0) ? 0 : std::min(n, (size_t)offset);
+    while (i < n && midpoint(u, i) < t) ++i;
+    while (i > 0 && midpoint(u, i - 1) >= t) --i;
+    return i;
+  };
+  // UEM segments are sorted and disjoint, so those that end after t follow
+  // the first one.
+  auto segment_after = [&](double t) {
+    return std::upper_bound(segments.begin(), segments.end(), t,
+                            [](double t, const std::pair<double, double> &segment) {
+                              return t < segment.second;
+                            }) -
+           segments.begin();
+  };
+
+  auto rasterize = [&](const SegmentView &turns, int num_speakers, std::vector<uint64_t> &active,
+                       std::vector<int> &count, std::vector<size_t> &boundaries) {
+    active.assign(num_speakers * num_words, 0);
+    // The counts are accumulated as differences, and summed up at the end.
+    count.assign(num_frames + 1, 0);
+    for (size_t k = 0; k < turns.size; ++k) {
+      double start = turns.start[k], end = turns.end[k];
+      for (size_t u = segment_after(start); u < segments.size() && segments[u].first < end; ++u) {
+        size_t first = first_frame[u] + first_frame_after(u, start);
+        size_t last = first_frame[u] + first_frame_after(u, end);
+        if (first >= last) continue;
+        set_bits(active.data() + turns.spk[k] * num_words, first, last);
+        count[first] += 1;
+        count[last] -= 1;
+      }
+      for (double t : {start, end}) {
+        size_t u = segment_after(t);
+        if (u == segments.size() || !(segments[u].first < t)) continue;
+        size_t i = std::min(segment_frames[u] - 1,
+                            (size_t)std::floor((t - segments[u].first) / frame_shift));
+        double frame_start = segments[u].first + i * frame_shift;
+        double frame_end = (i + 1 == segment_frames[u]) ? segments[u].second
+                                                        : frame_start + frame_shift;
+        if (t > frame_start && t < frame_end) boundaries.push_back(first_frame[u] + i);
+      }
+    }
+    for (size_t f = 1; f < num_frames; ++f) count[f] += count[f - 1];
+    count.resize(num_frames);
+    std::sort(boundaries.begin(), boundaries.end());
+  };
+  rasterize(ref, num_ref, ref_active, ref_count, ref_boundaries);
+  rasterize(hyp, num_hyp, hyp_active, hyp_count, hyp_boundaries);
+}
+
+std::vector<uint64_t> FrameGrid::scored_frames(const std::string &regions) const {
+  std::vector<uint64_t> scored(num_words, 0);
+  if (regions == ALL) {
+    set_bits(scored.data(), 0, num_frames);
+    return scored;
+  }
+  for (size_t f = 0; f < num_frames; ++f) {
+    int N_ref = ref_count[f];
+    if ((regions == SINGLE && N_ref == 1) || (regions == NONOVERLAP && N_ref <= 1) ||
+        (regions == OVERLAP && N_ref > 1))
+      scored[f / 64] |= 1ULL << (f % 64);
+  }
+  return scored;
+}
+
+double FrameGrid::length(const uint64_t *a, const uint64_t *b, const uint64_t *c) const {
+  // One loop per number of bitsets, so that each of them is a plain
+  // popcount loop.
+  uint64_t count = 0;
+  if (b == nullptr)
+    for (size_t w = 0; w < num_words; ++w) count += __builtin_popcountll(a[w]);
+  else if (c == nullptr)
+    for (size_t w = 0; w < num_words; ++w) count += __builtin_popcountll(a[w] & b[w]);
+  else
+    for (size_t w = 0; w < num_words; ++w) count += __builtin_popcountll(a[w] & b[w] & c[w]);
+  double total = count * frame_shift;
+  for (auto &frame : short_frames) {
+    size_t w = frame.first / 64;
+    uint64_t word = a[w] & (b == nullptr ? ~0ULL : b[w]) & (c == nullptr ? ~0ULL : c[w]);
+    if ((word >> (frame.first % 64)) & 1) total += frame.second - frame_shift;
+  }
+  return total;
+}
+
+FrameLabels rasterize_turns(const SegmentView &turns, double frame_shift, double duration,
+                            bool packed) {
+  if (duration <= 0)
+    for (size_t k = 0; k < turns.size; ++k) duration = std::max(duration, turns.end[k]);
+  double uem_start = 0.0, uem_end = duration;
+  SegmentView uem(&uem_start, &uem_end, nullptr, 1, nullptr, 0);
+  SegmentView no_segments;
+  FrameGrid grid(turns, no_segments, uem, frame_shift);
+
+  // The grid holds a bitset over the frames for each speaker, which is
+  // transposed to rows of speakers.
+  FrameLabels labels;
+  labels.num_frames = grid.num_frames;
+  labels.speakers.assign(turns.speakers, turns.speakers + turns.num_speakers);
+  labels.packed = packed;
+  size_t row_bytes = labels.row_bytes();
+  labels.data.assign(labels.num_frames * row_bytes, 0);
+  for (int spk = 0; spk < grid.num_ref; ++spk) {
+    uint8_t *column = labels.data.data() + (packed ? spk / 8 : spk);
+    uint8_t bit = packed ? 0x80 >> (spk % 8) : 1;
+    for_each_frame(grid.ref_row(spk), grid.num_words,
+                   [&](size_t f) { column[f * row_bytes] |= bit; });
+  }
+  return labels;
+}
+
+std::vector<FrameLabels> rasterize_turns(const std::vector<const TurnList *> &turns,
+                                         double frame_shift,
+                                         const std::vector<double> &durations, bool packed,
+                                         int num_threads) {
+  if (!durations.empty() && durations.size() != turns.size())
+    throw std::invalid_argument("durations must have one entry per recording");
+  if (!(frame_shift > 0)) throw std::invalid_argument("Frame shift must be positive");
+  std::vector<FrameLabels> labels(turns.size());
+  parallel_for(turns.size(), num_threads, [&](size_t i) {
+    Segments segments = turns[i]->merged_segments();
+    labels[i] = rasterize_turns(segments.view(), frame_shift,
+                                durations.empty() ? 0.0 : durations[i], packed);
+  });
+  return labels;
+}
+
+}  // end namespace spyder
+
+#endif
@@ -0,0 +1,148 @@
+// spyder/frame_grid.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_FRAME_GRID_H
+#define SPYDER_FRAME_GRID_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "containers.h"
+
+namespace spyder {
+
+// The reference and hypothesis speakers active on a grid of frames, for
+// approximate scoring (see compute_der_approx). Each UEM segment is cut into
+// frames of `frame_shift` seconds (the last one may be shorter), and a speaker
+// is active in a frame if it is active at the frame midpoint. The activity of
+// each speaker is a bitset over the frames, so that overlaps between speakers
+// are word-wise ANDs and popcounts, and the number of active speakers in each
+// frame is kept alongside. The frames that contain a segment boundary are also
+// kept, since only those can be scored differently from the exact regions.
+class FrameGrid {
+ public:
+  // \param ref: the reference segments (same-speaker turns merged)
+  // \param hyp: the hypothesis segments (same-speaker turns merged)
+  // \param uem: the UEM segments
+  // \param frame_shift: the frame length in seconds (must be positive)
+  FrameGrid(const SegmentView& ref, const SegmentView& hyp, const SegmentView& uem,
+            double frame_shift);
+
+  double frame_shift;
+  size_t num_frames;
+  // number of 64-bit words in the bitset of each speaker
+  size_t num_words;
+  int num_ref;
+  int num_hyp;
+  // speaker activity bitsets (num_ref x num_words and num_hyp x num_words)
+  std::vector<uint64_t> ref_active;
+  std::vector<uint64_t> hyp_active;
+  // number of reference and hypothesis speakers active in each frame
+  std::vector<int> ref_count;
+  std::vector<int> hyp_count;
+  // frames at the end of UEM segments whose length differs from frame_shift,
+  // and their length (sorted)
+  std::vector<std::pair<size_t, double>> short_frames;
+  // frame of each segment boundary that falls strictly inside a frame, sorted
+  std::vector<size_t> ref_boundaries;
+  std::vector<size_t> hyp_boundaries;
+
+  // Returns the activity bitset of a reference or hypothesis speaker
+  const uint64_t* ref_row(int spk) const { return ref_active.data() + spk * num_words; }
+  const uint64_t* hyp_row(int spk) const { return hyp_active.data() + spk * num_words; }
+
+  // Returns the length of a frame in seconds
+  double frame_length(size_t f) const {
+    auto it = std::lower_bound(short_frames.begin(), short_frames.end(), std::make_pair(f, 0.0));
+    return (it != short_frames.end() && it->first == f) ? it->second : frame_shift;
+  }
+
+  // Returns the bitset of the frames scored for a region type (e.g. "single"),
+  // which only depends on the number of reference speakers in each frame.
+  std::vector<uint64_t> scored_frames(const std::string& regions) const;
+
+  // Returns the total length of the frames set in all of the given bitsets
+  // (null bitsets are ignored).
+  double length(const uint64_t* a, const uint64_t* b = nullptr,
+                const uint64_t* c = nullptr) const;
+};
+
+// Call `visit(f)` for each frame f set in a bitset, in increasing order.
+// \param bits: the bitset
+// \param num_words: the number of 64-bit words in the bitset
+// \param visit: the frame visitor
+template <typename Visitor>
+void for_each_frame(const uint64_t* bits, size_t num_words, Visitor&& visit) {
+  for (size_t w = 0; w < num_words; ++w) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+      visit(w * 64 + __builtin_ctzll(word));
+  }
+}
+
+// Frame-level speaker activity of a recording, e.g. as targets for training
+// diarization models. Frame f covers [f * frame_shift, (f + 1) * frame_shift)
+// (the last one may be shorter), and a speaker is active in a frame if it is
+// active at the frame midpoint, as in FrameGrid.
+class FrameLabels {
+ public:
+  size_t num_frames = 0;
+  // speaker labels, in the order of the label columns
+  std::vector<std::string> speakers;
+  // whether the labels are bit-packed
+  bool packed = false;
+  // the labels, frame by frame: one byte (0 or 1) per speaker, or if packed,
+  // one bit per speaker from the most significant bit of each byte (as
+  // numpy.packbits along the speaker axis)
+  std::vector<uint8_t> data;
+
+  // Returns the number of bytes per frame
+  size_t row_bytes() const { return packed ? (speakers.size() + 7) / 8 : speakers.size(); }
+};
+
+// Rasterize the turns of a recording into frame-level labels.
+// \param turns: the segments (same-speaker turns merged)
+// \param frame_shift: the frame length in seconds (must be positive)
+// \param duration: the length of the recording in seconds; turns are cut at it.
+//   If not positive, the end of the last turn is used.
+// \param packed: whether to pack the labels of 8 speakers in a byte
+FrameLabels rasterize_turns(const SegmentView& turns, double frame_shift, double duration = 0.0,
+                            bool packed = false);
+
+// Rasterize the turns of several recordings (see above), in parallel over the
+// recordings. The turn lists are not modified (see TurnList::merged_segments).
+// \param turns: the turns of each recording
+// \param frame_shift: the frame length in seconds
+// \param durations: the length of each recording (see above), or empty to use
+//   the end of the last turn of each recording
+// \param packed: whether to pack the labels of 8 speakers in a byte
+// \param num_threads: number of threads (<= 0 means all hardware threads)
+std::vector<FrameLabels> rasterize_turns(const std::vector<const TurnList*>& turns,
+                                         double frame_shift,
+                                         const std::vector<double>& durations = {},
+                                         bool packed = false, int num_threads = 0);
+
+}  // end namespace spyder
+
+#endif
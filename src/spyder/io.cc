@@ -0,0 +1,130 @@
+// spyder/io.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_IO_CC
+#define SPYDER_IO_CC
+
+#include "io.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "line_reader.h"
+
+namespace spyder {
+
+std::vector<Turn>& Corpus::operator[](const std::string& reco_id) {
+  auto it = index.find(reco_id);
+  if (it != index.end()) return turns[it->second];
+  index.insert(std::pair<std::string, size_t>(reco_id, recordings.size()));
+  recordings.push_back(reco_id);
+  turns.push_back(std::vector<Turn>());
+  return turns.back();
+}
+
+int Corpus::find(const std::string& reco_id) const {
+  auto it = index.find(reco_id);
+  return (it == index.end()) ? -1 : it->second;
+}
+
+size_t Corpus::size() const { return recordings.size(); }
+
+// Split a line into whitespace-separated fields.
+static void split_fields(const std::string& line, std::vector<std::string>& fields) {
+  fields.clear();
+  std::istringstream stream(line);
+  std::string field;
+  while (stream >> field) fields.push_back(field);
+}
+
+// Parse a floating point field, reporting the location on failure.
+static double parse_time(const std::string& field, const std::string& path, int line_num) {
+  char* end;
+  double value = std::strtod(field.c_str(), &end);
+  if (end == field.c_str() || *end != '\0')
+    throw std::runtime_error(path + ":" + std::to_string(line_num) + ": invalid time '" + field +
+                             "'");
+  return value;
+}
+
+Corpus read_rttm(const std::string& path) {
+  LineReader in(path);
+  if (!in.is_open()) throw std::runtime_error("could not open RTTM file: " + path);
+
+  Corpus corpus;
+  std::string line;
+  std::vector<std::string> fields;
+  int line_num = 0;
+  while (in.getline(line)) {
+    line_num += 1;
+    split_fields(line, fields);
+    if (fields.empty() || fields[0][0] == '#') continue;
+    if (fields.size() < 8)
+      throw std::runtime_error(path + ":" + std::to_string(line_num) +
+                               ": expected at least 8 fields");
+    double start = parse_time(fields[3], path, line_num);
+    double duration = parse_time(fields[4], path, line_num);
+    corpus[fields[1]].push_back(Turn(fields[7], start, start + duration));
+  }
+  return corpus;
+}
+
+Corpus read_uem(const std::string& path) {
+  LineReader in(path);
+  if (!in.is_open()) throw std::runtime_error("could not open UEM file: " + path);
+
+  Corpus corpus;
+  std::string line;
+  std::vector<std::string> fields;
+  int line_num = 0;
+  while (in.getline(line)) {
+    line_num += 1;
+    split_fields(line, fields);
+    if (fields.empty() || fields[0][0] == '#') continue;
+    if (fields.size() < 4)
+      throw std::runtime_error(path + ":" + std::to_string(line_num) + ": expected 4 fields");
+    double start = parse_time(fields[2], path, line_num);
+    double end = parse_time(fields[3], path, line_num);
+    corpus[fields[0]].push_back(Turn("dummy", start, end));
+  }
+  return corpus;
+}
+
+void write_rttm(const Corpus& corpus, const std::string& path) {
+  FILE* out = fopen(path.c_str(), "w");
+  if (out == nullptr) throw std::runtime_error("could not open RTTM file: " + path);
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    for (auto& turn : corpus.turns[i]) {
+      fprintf(out, "SPEAKER %s 1 %.3f %.3f <NA> <NA> %s <NA> <NA>\n",
+              corpus.recordings[i].c_str(), turn.start, turn.end - turn.start, turn.spk.c_str());
+    }
+  }
+  fclose(out);
+}
+
+}  // end namespace spyder
+
+#endif
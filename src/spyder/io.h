@@ -0,0 +1,79 @@
+// spyder/io.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_IO_H
+#define SPYDER_IO_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "containers.h"
+
+namespace spyder {
+
+// Turns of a set of recordings, grouped by recording id. Recordings are kept
+// in the order in which they first appear in the input.
+class Corpus {
+ private:
+  std::unordered_map<std::string, size_t> index;
+
+ public:
+  // recording ids
+  std::vector<std::string> recordings;
+
+  // list of turns for each recording
+  std::vector<std::vector<Turn>> turns;
+
+  // Returns the turns of a recording, adding the recording if it is new.
+  std::vector<Turn>& operator[](const std::string& reco_id);
+
+  // Returns the index of a recording, or -1 if it is not present.
+  int find(const std::string& reco_id) const;
+
+  // Returns total number of recordings
+  size_t size() const;
+};
+
+// RTTM and UEM files may be gzip or zstd compressed (detected from their
+// content), and are then decompressed while they are parsed.
+
+// Read an RTTM file. Each line has the format:
+//   SPEAKER <reco_id> <channel> <start> <duration> <NA> <NA> <spk> <NA> <NA>
+// \param path: path to the RTTM file
+// \return the turns grouped by recording
+Corpus read_rttm(const std::string& path);
+
+// Read a UEM file. Each line has the format:
+//   <reco_id> <channel> <start> <end>
+// \param path: path to the UEM file
+// \return the UEM segments grouped by recording
+Corpus read_uem(const std::string& path);
+
+// Write turns to an RTTM file.
+// \param corpus: the turns grouped by recording
+// \param path: path to the output RTTM file
+void write_rttm(const Corpus& corpus, const std::string& path);
+
+}  // end namespace spyder
+
+#endif
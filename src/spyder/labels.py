@@ -0,0 +1,71 @@
+"""
+Frame-level speaker labels, e.g. as targets for training diarization models.
+
+Turns are rasterized natively onto frames of a fixed shift, with the same
+midpoint rule as the approximate scoring (a speaker is active in a frame if it
+is active at the frame midpoint). RTTM files are parsed and rasterized without
+building Python turns, so data preparation shares the ingestion path of
+scoring, and recordings are processed in parallel.
+"""
+from _spyder import Turn, TurnList, rasterize_rttm, rasterize_turns
+
+__all__ = ["frame_labels"]
+
+
+def frame_labels(turns, frame_shift=0.01, duration=None, packed=False, num_threads=0):
+    """
+    Rasterize speaker turns into a [frames x speakers] label matrix per recording.
+    Frame f covers [f * frame_shift, (f + 1) * frame_shift), and a speaker is active
+    in it if one of its turns covers the frame midpoint. Speakers are sorted by label.
+
+    Args:
+        turns (dict or list or str): Turns of a recording (list of (speaker, start,
+            end)), a dict {recording_id: list of turns}, or the path of an RTTM file
+            (possibly gzip or zstd compressed).
+        frame_shift (float): Frame length in seconds.
+        duration (float or dict): Length of the recording (a dict {recording_id:
+            length} for several recordings) in seconds, which sets the number of
+            frames; turns are cut at it. By default, the end of the last turn.
+        packed (bool): If True, the labels of 8 speakers are packed in each byte, as
+            `numpy.packbits(labels, axis=1)` does (`numpy.unpackbits(labels, axis=1,
+            count=len(speakers))` unpacks them).
+        num_threads (int): Number of threads, used over the recordings (0 means all
+            available cores).
+
+    Returns:
+        tuple: (labels, speakers) for a single recording, where labels is a uint8
+        ndarray and speakers the speaker label of each column. Otherwise, a dict
+        {recording_id: (labels, speakers)}.
+    """
+    single = not isinstance(turns, (dict, str))
+    if not single and duration is not None and not isinstance(duration, dict):
+        raise ValueError("duration must be a dict for several recordings")
+    if isinstance(turns, str):
+        return rasterize_rttm(
+            turns,
+            frame_shift,
+            durations={str(k): v for k, v in (duration or {}).items()},
+            packed=packed,
+            num_threads=num_threads,
+        )
+
+    reco_turns = {None: turns} if single else turns
+    if duration is None:
+        durations = []
+    elif single:
+        durations = [duration]
+    else:
+        durations = [duration.get(reco_id, 0.0) for reco_id in reco_turns]
+    labels = rasterize_turns(
+        [
+            TurnList([Turn(turn[0], turn[1], turn[2]) for turn in turns])
+            for turns in reco_turns.values()
+        ],
+        frame_shift,
+        durations=durations,
+        packed=packed,
+        num_threads=num_threads,
+    )
+    if single:
+        return labels[0]
+    return dict(zip(reco_turns, labels))
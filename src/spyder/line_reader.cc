@@ -0,0 +1,274 @@
+// spyder/line_reader.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_LINE_READER_CC
+#define SPYDER_LINE_READER_CC
+
+#include "line_reader.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef SPYDER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace spyder {
+
+// Size of the blocks read from the file, and of the decompressed chunks.
+static const size_t kReadSize = 1 << 18;
+static const size_t kChunkSize = 1 << 20;
+// Number of decompressed chunks queued ahead of the parser.
+static const size_t kMaxQueuedChunks = 4;
+
+Compression detect_compression(const unsigned char* magic, size_t size) {
+  if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return GZIP_COMPRESSION;
+  if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+    return ZSTD_COMPRESSION;
+  return NO_COMPRESSION;
+}
+
+LineReader::LineReader(const std::string& path) : path(path) {
+  file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return;
+  unsigned char magic[4];
+  size_t size = fread(magic, 1, sizeof(magic), file);
+  format = detect_compression(magic, size);
+  head.assign(reinterpret_cast<char*>(magic), size);
+  producer = std::thread(&LineReader::produce, this);
+}
+
+LineReader::~LineReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+  }
+  not_full.notify_all();
+  if (producer.joinable()) producer.join();
+  if (file != nullptr) fclose(file);
+}
+
+bool LineReader::is_open() const { return file != nullptr; }
+
+Compression LineReader::compression() const { return format; }
+
+void LineReader::produce() {
+  try {
+    if (format == GZIP_COMPRESSION)
+      read_gzip();
+    else if (format == ZSTD_COMPRESSION)
+      read_zstd();
+    else
+      read_plain();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  not_empty.notify_all();
+}
+
+bool LineReader::push_chunk(std::string&& chunk) {
+  std::unique_lock<std::mutex> lock(mutex);
+  not_full.wait(lock, [this]() { return chunks.size() < kMaxQueuedChunks || closed; });
+  if (closed) return false;
+  chunks.push_back(std::move(chunk));
+  lock.unlock();
+  not_empty.notify_one();
+  return true;
+}
+
+void LineReader::read_plain() {
+  std::string chunk = std::move(head);
+  while (true) {
+    size_t size = chunk.size();
+    chunk.resize(kChunkSize);
+    size += fread(&chunk[size], 1, kChunkSize - size, file);
+    chunk.resize(size);
+    if (size == 0) break;
+    if (!push_chunk(std::move(chunk))) return;
+    chunk = std::string();
+  }
+  if (ferror(file)) throw std::runtime_error("could not read file: " + path);
+}
+
+void LineReader::read_gzip() {
+  z_stream stream = z_stream();
+  // 16 + MAX_WBITS: expect a gzip header and trailer
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    throw std::runtime_error("could not initialize zlib");
+  std::vector<unsigned char> input(kReadSize);
+  std::copy(head.begin(), head.end(), input.begin());
+  size_t input_size = head.size();
+  std::string chunk(kChunkSize, '\0');
+  size_t chunk_size = 0;
+  int ret = Z_OK;
+
+  // Inflate into `chunk`, and queue it once it is full.
+  // \return false if the reader was closed
+  auto inflate_chunk = [&]() {
+    stream.next_out = reinterpret_cast<unsigned char *>(&chunk[chunk_size]);
+    stream.avail_out = kChunkSize - chunk_size;
+    ret = inflate(&stream, Z_NO_FLUSH);
+    chunk_size = kChunkSize - stream.avail_out;
+    if (chunk_size < kChunkSize) return true;
+    if (!push_chunk(std::move(chunk))) return false;
+    chunk.assign(kChunkSize, '\0');
+    chunk_size = 0;
+    return true;
+  };
+
+  try {
+    while (true) {
+      if (input_size == 0) {
+        input_size = fread(input.data(), 1, kReadSize, file);
+        if (ferror(file)) throw std::runtime_error("could not read file: " + path);
+        if (input_size == 0) break;
+      }
+      stream.next_in = input.data();
+      stream.avail_in = input_size;
+      while (stream.avail_in > 0) {
+        // A gzip file may hold several concatenated members.
+        if (ret == Z_STREAM_END) inflateReset(&stream);
+        if (!inflate_chunk()) {
+          inflateEnd(&stream);
+          return;
+        }
+        if (ret != Z_OK && ret != Z_STREAM_END)
+          throw std::runtime_error("corrupt gzip data in " + path);
+      }
+      input_size = 0;
+    }
+    // All the input is consumed, but zlib may still hold some output.
+    while (ret != Z_STREAM_END) {
+      if (!inflate_chunk()) {
+        inflateEnd(&stream);
+        return;
+      }
+      if (ret == Z_BUF_ERROR && stream.avail_out > 0)
+        throw std::runtime_error("truncated gzip data in " + path);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        throw std::runtime_error("corrupt gzip data in " + path);
+    }
+  } catch (...) {
+    inflateEnd(&stream);
+    throw;
+  }
+  inflateEnd(&stream);
+  chunk.resize(chunk_size);
+  if (chunk_size > 0) push_chunk(std::move(chunk));
+}
+
+#ifdef SPYDER_HAVE_ZSTD
+void LineReader::read_zstd() {
+  ZSTD_DStream* stream = ZSTD_createDStream();
+  if (stream == nullptr) throw std::runtime_error("could not initialize zstd");
+  std::vector<char> input(head.begin(), head.end());
+  input.resize(kReadSize);
+  size_t input_size = head.size();
+  size_t last_ret = 0;
+  try {
+    while (true) {
+      if (input_size == 0) {
+        input_size = fread(input.data(), 1, kReadSize, file);
+        if (ferror(file)) throw std::runtime_error("could not read file: " + path);
+        if (input_size == 0) break;
+      }
+      ZSTD_inBuffer in = {input.data(), input_size, 0};
+      while (in.pos < in.size) {
+        std::string chunk(kChunkSize, '\0');
+        ZSTD_outBuffer out = {&chunk[0], kChunkSize, 0};
+        last_ret = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(last_ret))
+          throw std::runtime_error("corrupt zstd data in " + path + ": " +
+                                   ZSTD_getErrorName(last_ret));
+        chunk.resize(out.pos);
+        if (out.pos > 0 && !push_chunk(std::move(chunk))) {
+          ZSTD_freeDStream(stream);
+          return;
+        }
+      }
+      input_size = 0;
+    }
+    // A non-zero hint at the end of the input means the last frame is incomplete.
+    if (last_ret != 0) throw std::runtime_error("truncated zstd data in " + path);
+  } catch (...) {
+    ZSTD_freeDStream(stream);
+    throw;
+  }
+  ZSTD_freeDStream(stream);
+}
+#else
+void LineReader::read_zstd() {
+  throw std::runtime_error(path + " is zstd-compressed, but spyder was built without zstd " +
+                           "support (set SPYDER_WITH_ZSTD=1 when installing)");
+}
+#endif
+
+bool LineReader::next_chunk() {
+  std::unique_lock<std::mutex> lock(mutex);
+  not_empty.wait(lock, [this]() { return !chunks.empty() || done; });
+  if (chunks.empty()) {
+    if (error) std::rethrow_exception(error);
+    return false;
+  }
+  buffer = std::move(chunks.front());
+  chunks.pop_front();
+  pos = 0;
+  lock.unlock();
+  not_full.notify_one();
+  return true;
+}
+
+bool LineReader::getline(std::string& line) {
+  line.clear();
+  if (file == nullptr) return false;
+  bool found = false;
+  while (true) {
+    if (pos >= buffer.size()) {
+      if (!next_chunk()) return found || !line.empty();
+    }
+    // Lines may span chunks, so a line is assembled until its line break.
+    size_t end = buffer.find('\n', pos);
+    found = true;
+    if (end == std::string::npos) {
+      line.append(buffer, pos, std::string::npos);
+      pos = buffer.size();
+      continue;
+    }
+    line.append(buffer, pos, end - pos);
+    pos = end + 1;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    return true;
+  }
+}
+
+}  // end namespace spyder
+
+#endif
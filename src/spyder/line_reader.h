@@ -0,0 +1,104 @@
+// spyder/line_reader.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_LINE_READER_H
+#define SPYDER_LINE_READER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace spyder {
+
+// Compression formats, recognized from the magic bytes at the start of a file.
+enum Compression { NO_COMPRESSION = 0, GZIP_COMPRESSION = 1, ZSTD_COMPRESSION = 2 };
+
+// Detect the compression format of a file from its first bytes.
+// \param magic: the first bytes of the file
+// \param size: the number of bytes in `magic` (fewer than 4 if the file is short)
+Compression detect_compression(const unsigned char* magic, size_t size);
+
+// Reads the lines of a text file that may be gzip or zstd compressed. The file
+// is read and decompressed chunk by chunk on a background thread, which hands
+// the decompressed chunks to the reader through a small bounded queue, so that
+// decompression overlaps with parsing and only a few chunks are in memory at a
+// time. zstd support requires building with SPYDER_HAVE_ZSTD; otherwise
+// reading a zstd file throws an error.
+class LineReader {
+ public:
+  // \param path: path to the file, whose format is detected from its content
+  explicit LineReader(const std::string& path);
+  ~LineReader();
+
+  LineReader(const LineReader&) = delete;
+  LineReader& operator=(const LineReader&) = delete;
+
+  // Whether the file could be opened
+  bool is_open() const;
+
+  // Returns the detected compression format
+  Compression compression() const;
+
+  // Read the next line (without its line break). Errors of the background
+  // thread (e.g. corrupt compressed data) are rethrown here.
+  // \return false at the end of the file
+  bool getline(std::string& line);
+
+ private:
+  // background thread: read and decompress the file into the queue
+  void produce();
+  void read_plain();
+  void read_gzip();
+  void read_zstd();
+  // queue a decompressed chunk, waiting while the queue is full
+  // \return false if the reader was closed
+  bool push_chunk(std::string&& chunk);
+  // fetch the next chunk into `buffer`
+  // \return false at the end of the file
+  bool next_chunk();
+
+  std::string path;
+  FILE* file = nullptr;
+  Compression format = NO_COMPRESSION;
+  // bytes read ahead to detect the format
+  std::string head;
+
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full;
+  std::deque<std::string> chunks;
+  bool done = false, closed = false;
+  std::exception_ptr error;
+  std::thread producer;
+
+  // chunk being parsed, and the parsing position in it
+  std::string buffer;
+  size_t pos = 0;
+};
+
+}  // end namespace spyder
+
+#endif
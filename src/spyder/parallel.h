@@ -0,0 +1,80 @@
+// spyder/parallel.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_PARALLEL_H
+#define SPYDER_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace spyder {
+
+// Resolve a user-provided number of threads: values <= 0 mean "use all
+// hardware threads".
+inline int resolve_num_threads(int num_threads) {
+  if (num_threads > 0) return num_threads;
+  int hw = std::thread::hardware_concurrency();
+  return hw > 0 ? hw : 1;
+}
+
+// Call fn(i) for every i in [0, n) using up to num_threads threads (the
+// calling thread included). Indices are handed out one at a time in
+// increasing order, so tasks of uneven cost are balanced across threads. If
+// any call throws, the remaining indices are skipped and the first exception
+// is rethrown in the calling thread.
+template <typename F>
+void parallel_for(size_t n, int num_threads, F &&fn) {
+  num_threads = std::min<size_t>(resolve_num_threads(num_threads), n);
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < n; ++i) fn(i);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+        next = n;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker);
+  worker();
+  for (auto &thread : threads) thread.join();
+  if (error) std::rethrow_exception(error);
+}
+
+}  // end namespace spyder
+
+#endif
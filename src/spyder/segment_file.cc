@@ -0,0 +1,343 @@
+// spyder/segment_file.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_SEGMENT_FILE_CC
+#define SPYDER_SEGMENT_FILE_CC
+
+#include "segment_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+
+namespace spyder {
+
+// Round up to a multiple of 8 bytes.
+static uint64_t align8(uint64_t offset) { return (offset + 7) & ~static_cast<uint64_t>(7); }
+
+SegmentFile::SegmentFile(const std::string &path_) : path(path_), data(nullptr), data_size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("could not open segment file: " + path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SegmentFileHeader)) {
+    close(fd);
+    throw std::runtime_error("not a segment file: " + path);
+  }
+  data_size = st.st_size;
+  void *addr = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) throw std::runtime_error("could not map segment file: " + path);
+  data = static_cast<const char *>(addr);
+  header = reinterpret_cast<const SegmentFileHeader *>(data);
+
+  try {
+    if (memcmp(header->magic, SEGMENT_FILE_MAGIC, sizeof(SEGMENT_FILE_MAGIC)) != 0)
+      throw std::runtime_error("not a segment file: " + path);
+    if (header->version != SEGMENT_FILE_VERSION)
+      throw std::runtime_error("unsupported segment file version: " + path);
+    check_section(header->recording_offset, header->num_recordings, sizeof(SegmentFileRecording));
+    check_section(header->speaker_offset, header->num_speakers, sizeof(SegmentFileString));
+    check_section(header->recording_speaker_offset, header->num_recording_speakers,
+                  sizeof(uint32_t));
+    check_section(header->string_offset, header->string_size);
+    check_section(header->start_offset, header->num_segments, sizeof(double));
+    check_section(header->end_offset, header->num_segments, sizeof(double));
+    check_section(header->spk_offset, header->num_segments, sizeof(int32_t));
+
+    // The recording and speaker tables are small, so we decode them once.
+    auto strings = data + header->string_offset;
+    auto string_at = [&](uint64_t offset, uint64_t size) {
+      if (offset > header->string_size || size > header->string_size - offset)
+        throw std::runtime_error("corrupt segment file: " + path);
+      return std::string(strings + offset, size);
+    };
+    auto spk_table = reinterpret_cast<const SegmentFileString *>(data + header->speaker_offset);
+    auto reco_spk = reinterpret_cast<const uint32_t *>(data + header->recording_speaker_offset);
+    auto records = reinterpret_cast<const SegmentFileRecording *>(data + header->recording_offset);
+    auto spk = reinterpret_cast<const int32_t *>(data + header->spk_offset);
+    for (uint64_t i = 0; i < header->num_recordings; ++i) {
+      const SegmentFileRecording &rec = records[i];
+      if (rec.segment_begin > header->num_segments ||
+          rec.num_segments > header->num_segments - rec.segment_begin ||
+          rec.speaker_begin > header->num_recording_speakers ||
+          rec.num_speakers > header->num_recording_speakers - rec.speaker_begin)
+        throw std::runtime_error("corrupt segment file: " + path);
+      // Segments index the speakers of their recording, which the scorers trust.
+      for (uint64_t k = rec.segment_begin; k < rec.segment_begin + rec.num_segments; ++k)
+        if (spk[k] < 0 || (uint64_t)spk[k] >= rec.num_speakers)
+          throw std::runtime_error("corrupt segment file: " + path);
+      recording_ids.push_back(string_at(rec.name_offset, rec.name_size));
+      index.insert(std::pair<std::string, size_t>(recording_ids.back(), i));
+      std::vector<std::string> names;
+      for (uint64_t k = rec.speaker_begin; k < rec.speaker_begin + rec.num_speakers; ++k) {
+        if (reco_spk[k] >= header->num_speakers)
+          throw std::runtime_error("corrupt segment file: " + path);
+        const SegmentFileString &s = spk_table[reco_spk[k]];
+        names.push_back(string_at(s.offset, s.size));
+      }
+      speakers.push_back(names);
+    }
+  } catch (...) {
+    munmap(const_cast<char *>(data), data_size);
+    throw;
+  }
+}
+
+SegmentFile::~SegmentFile() {
+  if (data != nullptr) munmap(const_cast<char *>(data), data_size);
+}
+
+void SegmentFile::check_section(uint64_t offset, uint64_t count, uint64_t item_size) const {
+  if (offset % 8 != 0 || offset > data_size || count > (data_size - offset) / item_size)
+    throw std::runtime_error("corrupt segment file: " + path);
+}
+
+size_t SegmentFile::size() const { return recording_ids.size(); }
+
+size_t SegmentFile::num_segments() const { return header->num_segments; }
+
+bool SegmentFile::merged() const { return header->flags & SEGMENT_FILE_MERGED; }
+
+const std::vector<std::string> &SegmentFile::recordings() const { return recording_ids; }
+
+int SegmentFile::find(const std::string &reco_id) const {
+  auto it = index.find(reco_id);
+  return (it == index.end()) ? -1 : it->second;
+}
+
+SegmentView SegmentFile::view(size_t i) const {
+  auto records = reinterpret_cast<const SegmentFileRecording *>(data + header->recording_offset);
+  const SegmentFileRecording &rec = records[i];
+  auto start = reinterpret_cast<const double *>(data + header->start_offset);
+  auto end = reinterpret_cast<const double *>(data + header->end_offset);
+  auto spk = reinterpret_cast<const int32_t *>(data + header->spk_offset);
+  return SegmentView(start + rec.segment_begin, end + rec.segment_begin, spk + rec.segment_begin,
+                     rec.num_segments, speakers[i].empty() ? nullptr : speakers[i].data(),
+                     speakers[i].size());
+}
+
+Corpus SegmentFile::to_corpus() const {
+  Corpus corpus;
+  for (size_t i = 0; i < size(); ++i) {
+    SegmentView segments = view(i);
+    std::vector<Turn> &turns = corpus[recording_ids[i]];
+    for (size_t k = 0; k < segments.size; ++k)
+      turns.push_back(
+          Turn(segments.speakers[segments.spk[k]], segments.start[k], segments.end[k]));
+  }
+  return corpus;
+}
+
+bool is_segment_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(SEGMENT_FILE_MAGIC)];
+  if (!in.read(magic, sizeof(magic))) return false;
+  return memcmp(magic, SEGMENT_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+void write_segment_file(const Corpus &corpus, const std::string &path, bool merge) {
+  std::vector<SegmentFileRecording> records;
+  std::vector<SegmentFileString> spk_table;
+  std::vector<uint32_t> reco_spk;
+  std::unordered_map<std::string, uint32_t> spk_ids;
+  std::string strings;
+  std::vector<double> start, end;
+  std::vector<int32_t> spk;
+
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    TurnList turns(corpus.turns[i]);
+    if (merge) turns.merge_same_speaker_turns();
+    turns.build_speaker_index();
+    std::stable_sort(turns.turns.begin(), turns.turns.end());
+
+    SegmentFileRecording rec;
+    rec.name_offset = strings.size();
+    rec.name_size = corpus.recordings[i].size();
+    strings += corpus.recordings[i];
+
+    // Intern the speaker labels. Local speaker ids follow the speaker index.
+    rec.speaker_begin = reco_spk.size();
+    rec.num_speakers = turns.reverse_index.size();
+    for (auto &it : turns.reverse_index) {
+      auto spk_it = spk_ids.find(it.second);
+      if (spk_it == spk_ids.end()) {
+        spk_it = spk_ids.insert(std::make_pair(it.second, (uint32_t)spk_table.size())).first;
+        spk_table.push_back(SegmentFileString{strings.size(), it.second.size()});
+        strings += it.second;
+      }
+      reco_spk.push_back(spk_it->second);
+    }
+
+    rec.segment_begin = start.size();
+    rec.num_segments = turns.turns.size();
+    for (auto &turn : turns.turns) {
+      start.push_back(turn.start);
+      end.push_back(turn.end);
+      spk.push_back(turns.forward_index.find(turn.spk)->second);
+    }
+    records.push_back(rec);
+  }
+
+  // Lay out the sections.
+  SegmentFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SEGMENT_FILE_MAGIC, sizeof(SEGMENT_FILE_MAGIC));
+  header.version = SEGMENT_FILE_VERSION;
+  header.flags = merge ? SEGMENT_FILE_MERGED : 0;
+  header.num_recordings = records.size();
+  header.num_speakers = spk_table.size();
+  header.num_recording_speakers = reco_spk.size();
+  header.num_segments = start.size();
+  header.recording_offset = align8(sizeof(SegmentFileHeader));
+  header.speaker_offset =
+      align8(header.recording_offset + records.size() * sizeof(SegmentFileRecording));
+  header.recording_speaker_offset =
+      align8(header.speaker_offset + spk_table.size() * sizeof(SegmentFileString));
+  header.string_offset =
+      align8(header.recording_speaker_offset + reco_spk.size() * sizeof(uint32_t));
+  header.string_size = strings.size();
+  header.start_offset = align8(header.string_offset + strings.size());
+  header.end_offset = align8(header.start_offset + start.size() * sizeof(double));
+  header.spk_offset = align8(header.end_offset + end.size() * sizeof(double));
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("could not open segment file: " + path);
+  uint64_t pos = 0;
+  auto write_at = [&](uint64_t offset, const void *buf, size_t size) {
+    static const char zeros[8] = {0};
+    out.write(zeros, offset - pos);
+    out.write(static_cast<const char *>(buf), size);
+    pos = offset + size;
+  };
+  write_at(0, &header, sizeof(header));
+  write_at(header.recording_offset, records.data(), records.size() * sizeof(SegmentFileRecording));
+  write_at(header.speaker_offset, spk_table.data(), spk_table.size() * sizeof(SegmentFileString));
+  write_at(header.recording_speaker_offset, reco_spk.data(), reco_spk.size() * sizeof(uint32_t));
+  write_at(header.string_offset, strings.data(), strings.size());
+  write_at(header.start_offset, start.data(), start.size() * sizeof(double));
+  write_at(header.end_offset, end.data(), end.size() * sizeof(double));
+  write_at(header.spk_offset, spk.data(), spk.size() * sizeof(int32_t));
+  if (!out) throw std::runtime_error("could not write segment file: " + path);
+}
+
+void rttm_to_segment_file(const std::string &rttm_path, const std::string &path, bool merge) {
+  write_segment_file(read_rttm(rttm_path), path, merge);
+}
+
+void segment_file_to_rttm(const std::string &path, const std::string &rttm_path) {
+  write_rttm(SegmentFile(path).to_corpus(), rttm_path);
+}
+
+// Merge same-speaker segments of a recording which was stored without merging.
+static Segments merge_segments(const SegmentView &segments) {
+  std::vector<Turn> turns;
+  for (size_t k = 0; k < segments.size; ++k)
+    turns.push_back(Turn(segments.speakers[segments.spk[k]], segments.start[k], segments.end[k]));
+  TurnList turn_list(turns);
+  turn_list.merge_same_speaker_turns();
+  turn_list.build_speaker_index();
+  return turn_list.to_segments();
+}
+
+std::vector<std::pair<std::string, Metrics>> compute_der(const SegmentFile &ref,
+                                                         const SegmentFile &hyp,
+                                                         const Corpus &uem, bool skip_missing,
+                                                         std::string regions, float collar,
+                                                         bool global_mapping, int num_threads) {
+  // Collect the segments of each scored recording. The segments are scored in
+  // place, unless they still need to be merged, in which case the merged
+  // copies are kept in `buffers`.
+  std::vector<std::string> reco_ids;
+  std::vector<SegmentView> ref_views, hyp_views, uem_views;
+  std::deque<Segments> buffers;
+  for (size_t i = 0; i < ref.size(); ++i) {
+    const std::string &reco_id = ref.recordings()[i];
+    int j = hyp.find(reco_id);
+    if (j < 0 && skip_missing) continue;
+
+    SegmentView ref_segments = ref.view(i);
+    SegmentView hyp_segments = (j < 0) ? SegmentView() : hyp.view(j);
+    if (!ref.merged()) {
+      buffers.push_back(merge_segments(ref_segments));
+      ref_segments = buffers.back().view();
+    }
+    if (!hyp.merged() && j >= 0) {
+      buffers.push_back(merge_segments(hyp_segments));
+      hyp_segments = buffers.back().view();
+    }
+
+    buffers.push_back(Segments());
+    Segments &uem_segments = buffers.back();
+    int k = uem.find(reco_id);
+    if (k >= 0) {
+      TurnList uem_turns(uem.turns[k]);
+      uem_turns.merge_same_speaker_turns();
+      uem_segments = uem_turns.to_segments();
+    } else if (uem.size() == 0 && ref_segments.size + hyp_segments.size > 0) {
+      // Score over the span of the reference and hypothesis segments.
+      double start = DBL_MAX, end = -DBL_MAX;
+      for (auto segments : {ref_segments, hyp_segments}) {
+        for (size_t n = 0; n < segments.size; ++n) {
+          start = std::min(start, segments.start[n]);
+          end = std::max(end, segments.end[n]);
+        }
+      }
+      uem_segments.push_back(start, end, 0);
+    }
+
+    reco_ids.push_back(reco_id);
+    ref_views.push_back(ref_segments);
+    hyp_views.push_back(hyp_segments);
+    uem_views.push_back(uem_segments.view());
+  }
+
+  std::vector<Metrics> metrics;
+  if (global_mapping) {
+    metrics = compute_der_global(ref_views, hyp_views, uem_views, regions, collar, num_threads);
+  } else {
+    metrics.resize(reco_ids.size());
+    parallel_for(reco_ids.size(), num_threads, [&](size_t i) {
+      metrics[i] = compute_der(ref_views[i], hyp_views[i], uem_views[i], regions, collar);
+    });
+  }
+
+  std::vector<std::pair<std::string, Metrics>> results;
+  for (size_t i = 0; i < reco_ids.size(); ++i)
+    results.push_back(std::make_pair(reco_ids[i], metrics[i]));
+  return results;
+}
+
+}  // end namespace spyder
+
+#endif
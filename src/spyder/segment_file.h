@@ -0,0 +1,173 @@
+// spyder/segment_file.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_SEGMENT_FILE_H
+#define SPYDER_SEGMENT_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "containers.h"
+#include "der.h"
+#include "io.h"
+
+namespace spyder {
+
+// Binary columnar segment files.
+//
+// A segment file stores the turns of a set of recordings in a form that can be
+// memory-mapped and scored without parsing. The file consists of:
+//
+//   header | recording table | speaker table | recording speakers |
+//   string data | start times | end times | speaker ids
+//
+// The speaker table interns each speaker label once for the whole file. Each
+// recording owns a contiguous range of the columns (start/end as float64,
+// speaker as int32), sorted by start time. Speaker ids are local to the
+// recording and index its range of "recording speakers", which in turn point
+// into the speaker table; local ids follow the sorted order of the labels, as
+// in TurnList::build_speaker_index. All integers are little-endian, offsets
+// are in bytes from the start of the file, and every section is 8-byte aligned.
+
+const char SEGMENT_FILE_MAGIC[8] = {'S', 'P', 'Y', 'S', 'E', 'G', '\r', '\n'};
+const uint32_t SEGMENT_FILE_VERSION = 1;
+
+// Header flags
+// Segments have been merged with TurnList::merge_same_speaker_turns.
+const uint32_t SEGMENT_FILE_MERGED = 1;
+
+struct SegmentFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t num_recordings;
+  uint64_t num_speakers;
+  uint64_t num_recording_speakers;
+  uint64_t num_segments;
+  uint64_t recording_offset;
+  uint64_t speaker_offset;
+  uint64_t recording_speaker_offset;
+  uint64_t string_offset;
+  uint64_t string_size;
+  uint64_t start_offset;
+  uint64_t end_offset;
+  uint64_t spk_offset;
+};
+
+struct SegmentFileRecording {
+  uint64_t name_offset;
+  uint64_t name_size;
+  uint64_t segment_begin;
+  uint64_t num_segments;
+  uint64_t speaker_begin;
+  uint64_t num_speakers;
+};
+
+struct SegmentFileString {
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Read-only access to a memory-mapped segment file.
+class SegmentFile {
+ private:
+  std::string path;
+  const char *data;
+  size_t data_size;
+  const SegmentFileHeader *header;
+
+  std::vector<std::string> recording_ids;
+  std::unordered_map<std::string, size_t> index;
+  // speaker labels of each recording, indexed by local speaker id
+  std::vector<std::vector<std::string>> speakers;
+
+  // Check that `count` items of `item_size` bytes at `offset` lie in the file.
+  void check_section(uint64_t offset, uint64_t count, uint64_t item_size = 1) const;
+
+ public:
+  SegmentFile(const std::string &path);
+  ~SegmentFile();
+  SegmentFile(const SegmentFile &) = delete;
+  SegmentFile &operator=(const SegmentFile &) = delete;
+
+  // Returns total number of recordings
+  size_t size() const;
+
+  // Returns total number of segments over all recordings
+  size_t num_segments() const;
+
+  // Whether same-speaker segments have been merged
+  bool merged() const;
+
+  // recording ids, in file order
+  const std::vector<std::string> &recordings() const;
+
+  // Returns the index of a recording, or -1 if it is not present.
+  int find(const std::string &reco_id) const;
+
+  // Returns a view over the segments of the i-th recording. The view points
+  // directly into the mapped file and is valid as long as the file is open.
+  SegmentView view(size_t i) const;
+
+  // Convert the segments back to turns.
+  Corpus to_corpus() const;
+};
+
+// Check whether a file starts with the segment file magic bytes.
+bool is_segment_file(const std::string &path);
+
+// Write turns to a segment file.
+// \param corpus: the turns grouped by recording
+// \param path: path to the output segment file
+// \param merge: whether to merge same-speaker turns before writing
+void write_segment_file(const Corpus &corpus, const std::string &path, bool merge = true);
+
+// Convert an RTTM file to a segment file.
+void rttm_to_segment_file(const std::string &rttm_path, const std::string &path,
+                          bool merge = true);
+
+// Convert a segment file to an RTTM file.
+void segment_file_to_rttm(const std::string &path, const std::string &rttm_path);
+
+// Compute DER for every recording in the reference segment file.
+// \param ref: the reference segment file
+// \param hyp: the hypothesis segment file
+// \param uem: UEM segments by recording. Recordings without UEM segments are
+//   scored over the span of their reference and hypothesis segments.
+// \param skip_missing: skip recordings which are missing in the hypothesis
+// \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+// \param collar: the collar size in seconds
+// \param global_mapping: use a single speaker mapping for all recordings (see
+//   compute_der_global)
+// \param num_threads: number of threads (<= 0 means all hardware threads)
+// \return the DER metrics of each scored recording, in reference order
+std::vector<std::pair<std::string, Metrics>> compute_der(
+    const SegmentFile &ref, const SegmentFile &hyp, const Corpus &uem, bool skip_missing = false,
+    std::string regions = "all", float collar = 0.0, bool global_mapping = false,
+    int num_threads = 0);
+
+}  // end namespace spyder
+
+#endif
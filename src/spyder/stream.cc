@@ -0,0 +1,271 @@
+// spyder/stream.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_STREAM_CC
+#define SPYDER_STREAM_CC
+
+#include "stream.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "parallel.h"
+
+namespace spyder {
+
+ScoringStream::ScoringStream(std::string regions, float collar, int num_threads,
+                             int max_pending, bool keep_results)
+    : regions(regions), collar(collar), keep_results(keep_results) {
+  num_threads = resolve_num_threads(num_threads);
+  this->max_pending = (max_pending > 0) ? max_pending : 2 * num_threads;
+  for (int t = 0; t < num_threads; ++t) workers.emplace_back(&ScoringStream::work, this);
+}
+
+ScoringStream::~ScoringStream() {
+  {
+    // Recordings that are still queued are dropped.
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    closed = true;
+  }
+  not_empty.notify_all();
+  not_full.notify_all();
+  for (auto &worker : workers)
+    if (worker.joinable()) worker.join();
+}
+
+void ScoringStream::check_error() {
+  if (error) std::rethrow_exception(error);
+}
+
+void ScoringStream::push(const std::string &reco_id, const TurnList &ref, const TurnList &hyp,
+                         const TurnList &uem) {
+  std::unique_lock<std::mutex> lock(mutex);
+  not_full.wait(lock, [this]() { return queue.size() < max_pending || closed || error; });
+  check_error();
+  if (closed) throw std::runtime_error("Cannot push a recording to a closed stream");
+  queue.push_back(Item{num_pushed++, reco_id, ref, hyp, uem});
+  lock.unlock();
+  not_empty.notify_one();
+}
+
+void ScoringStream::work() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this]() { return !queue.empty() || closed; });
+    // Stop once the queue is drained, or right away after an error.
+    if (queue.empty() || error) return;
+    Item item = std::move(queue.front());
+    queue.pop_front();
+    num_busy += 1;
+    lock.unlock();
+    not_full.notify_one();
+
+    Metrics metrics;
+    std::exception_ptr item_error;
+    try {
+      metrics = compute_der(item.ref, item.hyp, item.uem, regions, collar);
+    } catch (...) {
+      item_error = std::current_exception();
+    }
+    // Free the turns before waiting for the lock.
+    item.ref.turns = std::vector<Turn>();
+    item.hyp.turns = std::vector<Turn>();
+    item.uem.turns = std::vector<Turn>();
+
+    lock.lock();
+    num_busy -= 1;
+    if (item_error) {
+      if (!error) error = item_error;
+    } else {
+      num_done += 1;
+      duration += metrics.duration;
+      miss += metrics.miss * metrics.duration;
+      falarm += metrics.falarm * metrics.duration;
+      conf += metrics.conf * metrics.duration;
+      for (size_t k = 0; k < metrics.ref_duration.size(); ++k) {
+        if (metrics.ref_duration[k] == 0) continue;
+        speaker_jer += 1 - metrics.ref_jaccard[k];
+        num_speakers += 1;
+      }
+      if (keep_results)
+        results.emplace_back(item.index, std::make_pair(item.reco_id, std::move(metrics)));
+    }
+    lock.unlock();
+    // Wake up close(), and producers waiting on an error.
+    not_full.notify_all();
+  }
+}
+
+Metrics ScoringStream::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  Metrics metrics(duration, 0, 0, 0);
+  if (duration > 0)
+    metrics = Metrics(duration, miss / duration, falarm / duration, conf / duration);
+  metrics.jer = (num_speakers == 0) ? 0 : speaker_jer / num_speakers;
+  return metrics;
+}
+
+size_t ScoringStream::num_scored() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_done;
+}
+
+size_t ScoringStream::num_pending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return queue.size() + num_busy;
+}
+
+std::vector<std::pair<std::string, Metrics>> ScoringStream::pop_results() {
+  std::vector<std::pair<size_t, std::pair<std::string, Metrics>>> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done.swap(results);
+  }
+  std::sort(done.begin(), done.end(),
+            [](const std::pair<size_t, std::pair<std::string, Metrics>> &a,
+               const std::pair<size_t, std::pair<std::string, Metrics>> &b) {
+              return a.first < b.first;
+            });
+  std::vector<std::pair<std::string, Metrics>> popped;
+  popped.reserve(done.size());
+  for (auto &it : done) popped.push_back(std::move(it.second));
+  return popped;
+}
+
+void ScoringStream::close() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this]() { return (queue.empty() && num_busy == 0) || error; });
+    closed = true;
+  }
+  not_empty.notify_all();
+  not_full.notify_all();
+  {
+    std::lock_guard<std::mutex> lock(join_mutex);
+    for (auto &worker : workers)
+      if (worker.joinable()) worker.join();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  check_error();
+}
+
+ScoringPool::ScoringPool(int num_threads) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    throw std::runtime_error(std::string("Cannot create a pipe: ") + std::strerror(errno));
+  for (int fd : fds) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  notify_read = fds[0];
+  notify_write = fds[1];
+  num_threads = resolve_num_threads(num_threads);
+  for (int t = 0; t < num_threads; ++t) workers.emplace_back(&ScoringPool::work, this);
+}
+
+ScoringPool::~ScoringPool() {
+  {
+    // Jobs that are still queued are dropped.
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    closed = true;
+  }
+  not_empty.notify_all();
+  for (auto &worker : workers)
+    if (worker.joinable()) worker.join();
+  ::close(notify_read);
+  ::close(notify_write);
+}
+
+size_t ScoringPool::submit(const TurnList &ref, const TurnList &hyp, const TurnList &uem,
+                           std::string regions, float collar) {
+  std::unique_lock<std::mutex> lock(mutex);
+  size_t job = num_submitted++;
+  queue.push_back(Job{job, ref, hyp, uem, regions, collar});
+  lock.unlock();
+  not_empty.notify_one();
+  return job;
+}
+
+bool ScoringPool::cancel(size_t job) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = std::find_if(queue.begin(), queue.end(), [job](const Job &j) { return j.job == job; });
+  if (it == queue.end()) return false;
+  queue.erase(it);
+  return true;
+}
+
+void ScoringPool::work() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this]() { return !queue.empty() || closed; });
+    if (closed) return;
+    Job job = std::move(queue.front());
+    queue.pop_front();
+    num_busy += 1;
+    lock.unlock();
+
+    PoolResult result;
+    result.job = job.job;
+    try {
+      result.metrics = compute_der(job.ref, job.hyp, job.uem, job.regions, job.collar);
+    } catch (std::exception &e) {
+      result.error = e.what();
+    } catch (...) {
+      result.error = "Unknown error";
+    }
+
+    lock.lock();
+    num_busy -= 1;
+    results.push_back(std::move(result));
+    lock.unlock();
+    // The pipe only wakes up the reader, which collects all the results, so a
+    // full pipe (EAGAIN) can be ignored.
+    char byte = 0;
+    ssize_t written = write(notify_write, &byte, 1);
+    (void)written;
+  }
+}
+
+std::vector<PoolResult> ScoringPool::pop_results() {
+  std::vector<PoolResult> done;
+  std::lock_guard<std::mutex> lock(mutex);
+  done.swap(results);
+  return done;
+}
+
+int ScoringPool::notify_fd() const { return notify_read; }
+
+size_t ScoringPool::num_pending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return queue.size() + num_busy;
+}
+
+}  // end namespace spyder
+
+#endif
@@ -0,0 +1,195 @@
+// spyder/stream.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_STREAM_H
+#define SPYDER_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "containers.h"
+#include "der.h"
+
+namespace spyder {
+
+// Scores a stream of recordings on a pool of worker threads, and keeps the
+// running corpus totals. Recordings are queued with push(), which blocks while
+// `max_pending` recordings are waiting to be scored, so that memory is bounded
+// by the queue (and, if requested, by the results that have not been popped)
+// no matter how many recordings the stream has.
+class ScoringStream {
+ public:
+  // \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+  // \param collar: the collar size in seconds
+  // \param num_threads: number of worker threads (<= 0 means all hardware threads)
+  // \param max_pending: maximum number of queued recordings (<= 0 means twice
+  //   the number of threads)
+  // \param keep_results: whether to keep the metrics of each recording until
+  //   they are popped with pop_results()
+  ScoringStream(std::string regions = "all", float collar = 0.0, int num_threads = 0,
+                int max_pending = 0, bool keep_results = false);
+  ~ScoringStream();
+
+  ScoringStream(const ScoringStream&) = delete;
+  ScoringStream& operator=(const ScoringStream&) = delete;
+
+  // Queue a recording for scoring, blocking while the queue is full. If the
+  // scoring of a previous recording failed, its exception is rethrown here.
+  void push(const std::string& reco_id, const TurnList& ref, const TurnList& hyp,
+            const TurnList& uem);
+
+  // Returns the running corpus metrics over the recordings scored so far. As
+  // in DER(), the JER is averaged over all the reference speakers.
+  Metrics stats() const;
+
+  // Returns the number of recordings scored so far
+  size_t num_scored() const;
+
+  // Returns the number of recordings queued or being scored
+  size_t num_pending() const;
+
+  // Returns the results of the recordings scored since the last call, sorted
+  // in the order in which they were pushed. Empty unless `keep_results` is set.
+  std::vector<std::pair<std::string, Metrics>> pop_results();
+
+  // Wait until all queued recordings are scored, and stop the workers. The
+  // stream accepts no more recordings afterwards.
+  void close();
+
+ private:
+  struct Item {
+    size_t index;
+    std::string reco_id;
+    TurnList ref, hyp, uem;
+  };
+
+  // worker loop: score queued recordings until the stream is closed
+  void work();
+  // rethrow the first scoring error, if any (the mutex must be held)
+  void check_error();
+
+  std::string regions;
+  float collar;
+  size_t max_pending;
+  bool keep_results;
+
+  mutable std::mutex mutex;
+  // serializes joining the workers, if several threads close the stream
+  std::mutex join_mutex;
+  std::condition_variable not_empty, not_full;
+  std::deque<Item> queue;
+  size_t num_pushed = 0, num_busy = 0;
+  bool closed = false;
+  std::exception_ptr error;
+
+  // running totals, in seconds
+  size_t num_done = 0;
+  double duration = 0, miss = 0, falarm = 0, conf = 0;
+  double speaker_jer = 0;
+  size_t num_speakers = 0;
+  std::vector<std::pair<size_t, std::pair<std::string, Metrics>>> results;
+
+  std::vector<std::thread> workers;
+};
+
+// The result of a recording scored by a ScoringPool: its metrics, or the
+// message of the error raised while scoring it.
+class PoolResult {
+ public:
+  size_t job;
+  Metrics metrics;
+  std::string error;
+};
+
+// A pool of worker threads that scores recordings submitted by several
+// clients, e.g. the concurrent requests of an asyncio service. Unlike
+// ScoringStream, the recordings are independent jobs: submit() never blocks,
+// each job gets its own result or error, and queued jobs can be cancelled.
+// Completions are signalled on a pipe (see notify_fd), which an event loop can
+// watch instead of blocking a thread on them.
+class ScoringPool {
+ public:
+  // \param num_threads: number of worker threads (<= 0 means all hardware threads)
+  explicit ScoringPool(int num_threads = 0);
+  ~ScoringPool();
+
+  ScoringPool(const ScoringPool&) = delete;
+  ScoringPool& operator=(const ScoringPool&) = delete;
+
+  // Queue a recording for scoring.
+  // \param ref: the reference turns
+  // \param hyp: the hypothesis turns
+  // \param uem: the UEM segments
+  // \param regions: the regions to compute DER for (e.g. "single", "overlap", etc.)
+  // \param collar: the collar size in seconds
+  // \return the job id, which identifies the result
+  size_t submit(const TurnList& ref, const TurnList& hyp, const TurnList& uem,
+                std::string regions = "all", float collar = 0.0);
+
+  // Remove a job from the queue, if it has not started yet.
+  // \return whether the job was removed (it then gets no result)
+  bool cancel(size_t job);
+
+  // Returns the results of the jobs completed since the last call, in the
+  // order in which they completed.
+  std::vector<PoolResult> pop_results();
+
+  // Returns a file descriptor that becomes readable whenever a job completes.
+  // Readers should drain it before calling pop_results().
+  int notify_fd() const;
+
+  // Returns the number of jobs queued or being scored
+  size_t num_pending() const;
+
+ private:
+  struct Job {
+    size_t job;
+    TurnList ref, hyp, uem;
+    std::string regions;
+    float collar;
+  };
+
+  // worker loop: score queued jobs until the pool is destroyed
+  void work();
+
+  mutable std::mutex mutex;
+  std::condition_variable not_empty;
+  std::deque<Job> queue;
+  size_t num_submitted = 0, num_busy = 0;
+  bool closed = false;
+  std::vector<PoolResult> results;
+  // read and write ends of the notification pipe
+  int notify_read = -1, notify_write = -1;
+
+  std::vector<std::thread> workers;
+};
+
+}  // end namespace spyder
+
+#endif
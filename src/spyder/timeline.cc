@@ -0,0 +1,103 @@
+// spyder/timeline.cc
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_TIMELINE_CC
+#define SPYDER_TIMELINE_CC
+
+#include "timeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace spyder {
+
+void Timeline::push_back(const ScoredRegion &region) {
+  regions.push_back(region);
+  duration.push_back(duration.back() + (region.end - region.start) * region.num_ref);
+  miss.push_back(miss.back() + region.miss);
+  falarm.push_back(falarm.back() + region.falarm);
+  conf.push_back(conf.back() + region.conf);
+}
+
+size_t Timeline::size() const { return regions.size(); }
+
+void Timeline::window(double t0, double t1, double totals[4]) const {
+  const std::vector<double> *sums[4] = {&duration, &miss, &falarm, &conf};
+  for (int k = 0; k < 4; ++k) totals[k] = 0;
+  if (!(t0 < t1)) return;
+
+  // Regions [first, last) intersect the window.
+  size_t first = std::upper_bound(regions.begin(), regions.end(), t0,
+                                  [](double t, const ScoredRegion &r) { return t < r.end; }) -
+                 regions.begin();
+  size_t last = std::lower_bound(regions.begin(), regions.end(), t1,
+                                 [](const ScoredRegion &r, double t) { return r.start < t; }) -
+                regions.begin();
+  if (first >= last) return;
+
+  // Fraction of the first and last regions that falls outside the window
+  const ScoredRegion &head_region = regions[first], &tail_region = regions[last - 1];
+  double head = (head_region.start < t0)
+                    ? (t0 - head_region.start) / (head_region.end - head_region.start)
+                    : 0;
+  double tail = (tail_region.end > t1)
+                    ? (tail_region.end - t1) / (tail_region.end - tail_region.start)
+                    : 0;
+  for (int k = 0; k < 4; ++k) {
+    const std::vector<double> &sum = *sums[k];
+    totals[k] = sum[last] - sum[first];
+    totals[k] -= head * (sum[first + 1] - sum[first]);
+    totals[k] -= tail * (sum[last] - sum[last - 1]);
+  }
+}
+
+void Timeline::sliding_window(double length, double hop, double t0, double t1,
+                              std::vector<double> &window_start,
+                              std::vector<double> &window_duration,
+                              std::vector<double> &window_miss,
+                              std::vector<double> &window_falarm,
+                              std::vector<double> &window_conf) const {
+  if (!(length > 0) || !(hop > 0))
+    throw std::invalid_argument("Window length and hop must be positive");
+  size_t num_windows = (t1 > t0) ? (size_t)std::ceil((t1 - t0) / hop) : 0;
+  window_start.resize(num_windows);
+  window_duration.resize(num_windows);
+  window_miss.resize(num_windows);
+  window_falarm.resize(num_windows);
+  window_conf.resize(num_windows);
+  double totals[4];
+  for (size_t i = 0; i < num_windows; ++i) {
+    double t = t0 + i * hop;
+    window(t, t + length, totals);
+    window_start[i] = t;
+    window_duration[i] = totals[0];
+    window_miss[i] = totals[1];
+    window_falarm[i] = totals[2];
+    window_conf[i] = totals[3];
+  }
+}
+
+}  // end namespace spyder
+
+#endif
@@ -0,0 +1,87 @@
+// spyder/timeline.h
+
+// Copyright 2023  Johns Hopkins University (Author: Desh Raj)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SPYDER_TIMELINE_H
+#define SPYDER_TIMELINE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace spyder {
+
+// A scored region, with its speaker counts and its contribution to the DER
+// errors (in seconds). The layout is fixed so that a list of regions can be
+// viewed as a NumPy structured array.
+struct ScoredRegion {
+  double start;
+  double end;
+  int num_ref;
+  int num_hyp;
+  int num_correct;
+  double miss;
+  double falarm;
+  double conf;
+};
+
+// Time-resolved errors of a scored recording. Stores the scored regions
+// together with prefix sums of their scored speech, missed speech, false alarm
+// and confusion (all weighted by the number of speakers, as in the DER), so
+// that the DER of any time window is found with two binary searches. Errors
+// are spread uniformly within a region, which is exact since no speaker
+// changes inside a region.
+class Timeline {
+ public:
+  // the scored regions, sorted and non-overlapping
+  std::vector<ScoredRegion> regions;
+  // prefix sums over the regions (size num_regions + 1, starting at 0)
+  std::vector<double> duration;
+  std::vector<double> miss;
+  std::vector<double> falarm;
+  std::vector<double> conf;
+
+  Timeline() : duration(1, 0.0), miss(1, 0.0), falarm(1, 0.0), conf(1, 0.0) {}
+
+  // Append a scored region. Regions must be added in time order.
+  void push_back(const ScoredRegion& region);
+
+  // Returns the number of scored regions
+  size_t size() const;
+
+  // Error totals (in seconds) in the window [t0, t1).
+  // \param totals: filled with the scored speech, missed speech, false alarm
+  //   and confusion, in this order
+  void window(double t0, double t1, double totals[4]) const;
+
+  // Error totals of sliding windows [t, t + length) for t = t0, t0 + hop, ...
+  // while t < t1. Each output is resized to the number of windows.
+  // \param length: the window length in seconds
+  // \param hop: the window shift in seconds
+  // \param t0, t1: the span covered by the windows
+  void sliding_window(double length, double hop, double t0, double t1,
+                      std::vector<double>& window_start, std::vector<double>& window_duration,
+                      std::vector<double>& window_miss, std::vector<double>& window_falarm,
+                      std::vector<double>& window_conf) const;
+};
+
+}  // end namespace spyder
+
+#endif
@@ -32,174 +32,166 @@
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "float.h"
 
 namespace spyder {
 
-double compute_intersection_length(Turn A, Turn B) {
-  double max_start = std::max(A.start, B.start);
-  double min_end = std::min(A.end, B.end);
-  return std::max(0.0, min_end - max_start);
-}
-
-std::vector<std::vector<double>> build_cost_matrix(TurnList &ref, TurnList &hyp) {
-  int M = ref.forward_index.size();
-  int N = hyp.forward_index.size();
-  std::vector<std::vector<double>> cost_matrix(M, std::vector<double>(N));
-
-  int i, j;
-  for (auto &ref_turn : ref.turns) {
-    for (auto &hyp_turn : hyp.turns) {
-      i = ref.forward_index.find(ref_turn.spk)->second;
-      j = hyp.forward_index.find(hyp_turn.spk)->second;
-      cost_matrix[i][j] -= compute_intersection_length(ref_turn, hyp_turn);
-    }
-  }
-  return cost_matrix;
-}
-
-std::vector<std::vector<double>> build_cost_matrix(TurnList &ref, TurnList &hyp,
-                                                   std::vector<Region> &regions) {
-  int M = ref.forward_index.size();
-  int N = hyp.forward_index.size();
-  std::vector<std::vector<double>> cost_matrix(M, std::vector<double>(N));
-
-  int i, j;
-  for (auto &region : regions) {
-    for (auto &ref_spk : region.ref_spk) {
-      for (auto &hyp_spk : region.hyp_spk) {
-        i = ref.forward_index.find(ref_spk)->second;
-        j = hyp.forward_index.find(hyp_spk)->second;
-        cost_matrix[i][j] -= region.duration();
-      }
-    }
-  }
-  return cost_matrix;
-}
-
-void map_labels(TurnList &ref, TurnList &hyp, std::vector<int> &assignment,
-                std::map<std::string, std::string> &ref_map,
-                std::map<std::string, std::string> &hyp_map) {
+void build_label_maps(const SegmentView &ref, const SegmentView &hyp,
+                      const std::vector<int> &assignment,
+                      std::map<std::string, std::string> &ref_map,
+                      std::map<std::string, std::string> &hyp_map) {
   int k = 0;
-  std::set<std::string> ref_spk_remaining = ref.speaker_set;
-  std::set<std::string> hyp_spk_remaining = hyp.speaker_set;
-  std::string ref_spk, hyp_spk;
+  std::vector<bool> ref_assigned(ref.num_speakers, false);
+  std::vector<bool> hyp_assigned(hyp.num_speakers, false);
   for (int i = 0; i < assignment.size(); ++i) {
     if (assignment[i] != -1) {
-      ref_spk = ref.reverse_index.find(i)->second;
-      hyp_spk = hyp.reverse_index.find(assignment[i])->second;
-      ref_map.insert(std::pair<std::string, std::string>(ref_spk, std::to_string(k)));
-      hyp_map.insert(std::pair<std::string, std::string>(hyp_spk, std::to_string(k)));
+      ref_map.insert(std::pair<std::string, std::string>(ref.speakers[i], std::to_string(k)));
+      hyp_map.insert(
+          std::pair<std::string, std::string>(hyp.speakers[assignment[i]], std::to_string(k)));
       k += 1;
-      ref_spk_remaining.erase(ref_spk);
-      hyp_spk_remaining.erase(hyp_spk);
+      ref_assigned[i] = true;
+      hyp_assigned[assignment[i]] = true;
     }
   }
-  for (auto &spk : ref_spk_remaining) {
-    ref_map.insert(std::pair<std::string, std::string>(spk, std::to_string(k++)));
+  // Speakers are indexed in sorted order, so the remaining speakers are also
+  // labeled in sorted order.
+  for (int i = 0; i < ref.num_speakers; ++i) {
+    if (!ref_assigned[i])
+      ref_map.insert(std::pair<std::string, std::string>(ref.speakers[i], std::to_string(k++)));
   }
-  for (auto &spk : hyp_spk_remaining) {
-    hyp_map.insert(std::pair<std::string, std::string>(spk, std::to_string(k++)));
+  for (int j = 0; j < hyp.num_speakers; ++j) {
+    if (!hyp_assigned[j])
+      hyp_map.insert(std::pair<std::string, std::string>(hyp.speakers[j], std::to_string(k++)));
   }
-  ref.map_labels(ref_map);
-  hyp.map_labels(hyp_map);
 }
 
-std::vector<Region> get_eval_regions(TurnList &ref, TurnList &hyp, TurnList &uem) {
+std::vector<Token> get_tokens(const SegmentView &ref, const SegmentView &hyp,
+                              const SegmentView &uem) {
   // Create a list of tokens combining reference, hypothesis, and UEM segments
-  std::vector<Token> tokens(2 * (ref.size() + hyp.size() + uem.size()));
+  std::vector<Token> tokens(2 * (ref.size + hyp.size + uem.size));
   int i = -1;
-  for (auto &turn : uem.turns) {
-    tokens[++i] = Token(START, UEM, turn.spk, turn.start);
-    tokens[++i] = Token(END, UEM, turn.spk, turn.end);
+  for (size_t k = 0; k < uem.size; ++k) {
+    tokens[++i] = Token(START_TOKEN, UEM_TOKEN, 0, uem.start[k]);
+    tokens[++i] = Token(END_TOKEN, UEM_TOKEN, 0, uem.end[k]);
   }
-  for (auto &turn : ref.turns) {
-    tokens[++i] = Token(START, REF, turn.spk, turn.start);
-    tokens[++i] = Token(END, REF, turn.spk, turn.end);
+  for (size_t k = 0; k < ref.size; ++k) {
+    tokens[++i] = Token(START_TOKEN, REF_TOKEN, ref.spk[k], ref.start[k]);
+    tokens[++i] = Token(END_TOKEN, REF_TOKEN, ref.spk[k], ref.end[k]);
   }
-  for (auto &turn : hyp.turns) {
-    tokens[++i] = Token(START, HYP, turn.spk, turn.start);
-    tokens[++i] = Token(END, HYP, turn.spk, turn.end);
+  for (size_t k = 0; k < hyp.size; ++k) {
+    tokens[++i] = Token(START_TOKEN, HYP_TOKEN, hyp.spk[k], hyp.start[k]);
+    tokens[++i] = Token(END_TOKEN, HYP_TOKEN, hyp.spk[k], hyp.end[k]);
   }
 
   // Sort the tokens. They will be sorted first by timestamp and then
   // by type (i.e. "end" tokens before "start"), since we overloaded
   // the Token "<" (less than) operator.
   std::sort(tokens.begin(), tokens.end());
+  return tokens;
+}
 
-  // Create list of evaluation regions
-  std::vector<Region> regions;
-  double region_start = tokens[0].timestamp;
-  std::unordered_set<std::string> ref_spk, hyp_spk;
-  bool evaluate = false;
+// Sort intervals by start time and merge the overlapping ones.
+static std::vector<std::pair<double, double>> merge_intervals(
+    std::vector<std::pair<double, double>> intervals) {
+  std::sort(intervals.begin(), intervals.end());
+  std::vector<std::pair<double, double>> merged;
+  for (auto &interval : intervals) {
+    if (!merged.empty() && interval.first <= merged.back().second)
+      merged.back().second = std::max(merged.back().second, interval.second);
+    else
+      merged.push_back(interval);
+  }
+  return merged;
+}
 
-  for (int i = 0; i < tokens.size(); ++i) {
-    // If the evaluate flag is set and the region is not empty, add it to the
-    // list of regions
-    if (evaluate && tokens[i].timestamp - region_start > DBL_EPSILON) {
-      std::vector<std::string> ref_spk_list(ref_spk.begin(), ref_spk.end());
-      std::vector<std::string> hyp_spk_list(hyp_spk.begin(), hyp_spk.end());
-      regions.push_back(Region(region_start, tokens[i].timestamp, ref_spk_list, hyp_spk_list));
-    }
+std::vector<double> find_split_points(const SegmentView &ref, const SegmentView &hyp,
+                                      const SegmentView &uem, int num_chunks) {
+  std::vector<std::pair<double, double>> speech, scored;
+  for (size_t k = 0; k < ref.size; ++k) speech.push_back(std::make_pair(ref.start[k], ref.end[k]));
+  for (size_t k = 0; k < hyp.size; ++k) speech.push_back(std::make_pair(hyp.start[k], hyp.end[k]));
+  speech = merge_intervals(speech);
+  for (size_t k = 0; k < uem.size; ++k) scored.push_back(std::make_pair(uem.start[k], uem.end[k]));
+  scored = merge_intervals(scored);
+
+  // Points strictly inside the intersection of speech and UEM are not valid.
+  std::vector<std::pair<double, double>> blocked;
+  for (size_t i = 0, j = 0; i < speech.size() && j < scored.size();) {
+    double start = std::max(speech[i].first, scored[j].first);
+    double end = std::min(speech[i].second, scored[j].second);
+    if (start < end) blocked.push_back(std::make_pair(start, end));
+    if (speech[i].second < scored[j].second)
+      ++i;
+    else
+      ++j;
+  }
 
-    // Update the list of ref and hyp speakers in the current region
-    if (tokens[i].system == REF) {
-      if (tokens[i].type == START) {
-        ref_spk.insert(tokens[i].spk);
-      } else {
-        ref_spk.erase(tokens[i].spk);
-      }
-    } else if (tokens[i].system == HYP) {
-      if (tokens[i].type == START) {
-        hyp_spk.insert(tokens[i].spk);
-      } else {
-        hyp_spk.erase(tokens[i].spk);
-      }
-    } else {
-      // If it is a UEM token, update the evaluate flag
-      evaluate = (tokens[i].type == START);
-    }
+  std::vector<double> points;
+  if (blocked.empty()) return points;
+  double span_start = blocked.front().first, span_end = blocked.back().second;
+  for (int c = 1; c < num_chunks; ++c) {
+    double point = span_start + c * (span_end - span_start) / num_chunks;
+    auto it = std::upper_bound(
+        blocked.begin(), blocked.end(), point,
+        [](double t, const std::pair<double, double> &interval) { return t < interval.second; });
+    // Snap to the next boundary of the blocked intervals, which is also a region
+    // boundary, so that no region (not even a silent one) is split.
+    point = (it->first < point) ? it->second : it->first;
+    if (point > span_start && point < span_end && (points.empty() || point > points.back()))
+      points.push_back(point);
+  }
+  return points;
+}
 
-    // Update the region start time
-    region_start = tokens[i].timestamp;
+std::vector<Segments> split_segments(const SegmentView &segments,
+                                     const std::vector<double> &points) {
+  std::vector<Segments> chunks(points.size() + 1);
+  for (size_t k = 0; k < segments.size; ++k) {
+    double start = segments.start[k], end = segments.end[k];
+    int spk = (segments.spk == nullptr) ? 0 : segments.spk[k];
+    size_t c = std::upper_bound(points.begin(), points.end(), start) - points.begin();
+    while (true) {
+      double chunk_start = (c == 0) ? start : std::max(start, points[c - 1]);
+      double chunk_end = (c == points.size()) ? end : std::min(end, points[c]);
+      if (chunk_start < chunk_end || start == end) chunks[c].push_back(chunk_start, chunk_end, spk);
+      if (c == points.size() || end <= points[c]) break;
+      ++c;
+    }
   }
-  // free up memory
-  std::vector<Token>().swap(tokens);
-  return regions;
+  return chunks;
 }
 
-void add_collar_to_uem(TurnList &uem, TurnList &ref, float collar) {
+Segments add_collar_to_uem(const SegmentView &uem, const SegmentView &ref, float collar) {
   // Create a list of tokens combining reference and UEM segments
-  std::vector<Token> tokens(4 * ref.size() + 2 * uem.size());
+  std::vector<Token> tokens(4 * ref.size + 2 * uem.size);
   int i = -1;
-  for (auto &turn : uem.turns) {
-    tokens[++i] = Token(START, UEM, turn.spk, turn.start);
-    tokens[++i] = Token(END, UEM, turn.spk, turn.end);
+  for (size_t k = 0; k < uem.size; ++k) {
+    tokens[++i] = Token(START_TOKEN, UEM_TOKEN, 0, uem.start[k]);
+    tokens[++i] = Token(END_TOKEN, UEM_TOKEN, 0, uem.end[k]);
   }
-  for (auto &turn : ref.turns) {
-    tokens[++i] = Token(END, REF, turn.spk, turn.start - collar);
-    tokens[++i] = Token(START, REF, turn.spk, turn.start + collar);
-    tokens[++i] = Token(END, REF, turn.spk, turn.end - collar);
-    tokens[++i] = Token(START, REF, turn.spk, turn.end + collar);
+  for (size_t k = 0; k < ref.size; ++k) {
+    tokens[++i] = Token(END_TOKEN, REF_TOKEN, ref.spk[k], ref.start[k] - collar);
+    tokens[++i] = Token(START_TOKEN, REF_TOKEN, ref.spk[k], ref.start[k] + collar);
+    tokens[++i] = Token(END_TOKEN, REF_TOKEN, ref.spk[k], ref.end[k] - collar);
+    tokens[++i] = Token(START_TOKEN, REF_TOKEN, ref.spk[k], ref.end[k] + collar);
   }
 
+  Segments uem_segments;
+  if (uem.size == 0) return uem_segments;
+
   // Sort the tokens. They will be sorted first by timestamp and then
   // by type (i.e. "end" tokens before "start"), since we overloaded
   // the Token "<" (less than) operator.
   std::sort(tokens.begin(), tokens.end());
 
-  std::vector<Turn> uem_turns;
-
   double region_start = tokens[0].timestamp;
-  std::unordered_set<std::string> ref_spk, hyp_spk;
-  std::string dummy_spk = uem.turns[0].spk;
   int evaluate = 0;
 
   for (int i = 0; i < tokens.size(); ++i) {
     // If it is a START token, increment the evaluate flag
-    if (tokens[i].type == START) {
+    if (tokens[i].type == START_TOKEN) {
       evaluate += 1;
       if (evaluate == 1) {
         region_start = tokens[i].timestamp;
@@ -207,15 +199,13 @@ void add_collar_to_uem(TurnList &uem, TurnList &ref, float collar) {
     } else {
       evaluate -= 1;
       if (evaluate == 0 && tokens[i].timestamp - region_start > DBL_EPSILON) {
-        uem_turns.push_back(Turn(dummy_spk, region_start, tokens[i].timestamp));
+        uem_segments.push_back(region_start, tokens[i].timestamp, 0);
       }
     }
   }
   // free up memory
   std::vector<Token>().swap(tokens);
-
-  // Replace the old list with the new list
-  uem.turns.swap(uem_turns);
+  return uem_segments;
 }
 
 }  // end namespace spyder
@@ -23,6 +23,7 @@
 #ifndef SPYDER_UTILS_H
 #define SPYDER_UTILS_H
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <string>
@@ -30,53 +31,100 @@
 #include <vector>
 
 #include "containers.h"
+#include "float.h"
 
 namespace spyder {
 
-// Compute intersection length of two turn tuples.
-// \param A: a Turn tuple
-// \param B: a Turn tuple
-double compute_intersection_length(Turn A, Turn B);
-
-// Build cost matrix given reference and hypothesis lists.
-// \param ref: a list of reference turns
-// \param hyp: a list of hypothesis turns
-std::vector<std::vector<double>> build_cost_matrix(TurnList& ref, TurnList& hyp);
-
-// Build cost matrix given reference and hypothesis lists, based on a set of
-// evaluation regions.
-// \param ref: a list of reference turns
-// \param hyp: a list of hypothesis turns
-// \param regions: a list of evaluation regions
-std::vector<std::vector<double>> build_cost_matrix(TurnList& ref, TurnList& hyp,
-                                                   std::vector<Region>& regions);
-
-// Map reference and hypothesis labels to common space based on assignment
-// vector.
-// \param ref, reference list of turns
-// \param hyp, hypothesis list of turns
+// Build the maps from reference and hypothesis labels to the common label
+// space, without relabeling any turns.
+// \param ref, reference segments
+// \param hyp, hypothesis segments
 // \param assignment, vector of assignments from ref to hyp
 // \param ref_map, map from reference labels to common labels
 // \param hyp_map, map from hypothesis labels to common labels
-void map_labels(TurnList& ref, TurnList& hyp, std::vector<int>& assignment,
-                std::map<std::string, std::string>& ref_map,
-                std::map<std::string, std::string>& hyp_map);
-
-// Compute the evaluation regions based on the reference, hypothesis, and the UEM
-// segments.
-// \param ref: a list of reference turns.
-// \param hyp: a list of hypothesis turns.
-// \param uem: a list of UEM segments.
+void build_label_maps(const SegmentView& ref, const SegmentView& hyp,
+                      const std::vector<int>& assignment,
+                      std::map<std::string, std::string>& ref_map,
+                      std::map<std::string, std::string>& hyp_map);
+
+// Build the sorted list of boundary tokens of the reference, hypothesis and UEM
+// segments, which can then be swept (possibly several times) with sweep_regions.
+// \param ref: the reference segments.
+// \param hyp: the hypothesis segments.
+// \param uem: the UEM segments.
+// \return the tokens, sorted (see Token::operator<)
+std::vector<Token> get_tokens(const SegmentView& ref, const SegmentView& hyp,
+                              const SegmentView& uem);
+
+// Sweep the evaluation regions delimited by a sorted list of tokens, calling
+// `visit(start, end, ref_spk, hyp_spk)` for each region, where ref_spk and
+// hyp_spk are the reference and hypothesis speakers active in the region. The
+// regions are not stored, so besides the tokens, memory is proportional to the
+// number of active speakers. The visitor is a template parameter so that it
+// can be inlined into the sweep.
+// \param tokens: the sorted tokens (see get_tokens).
+// \param visit: the region visitor.
+template <typename Visitor>
+void sweep_regions(const std::vector<Token>& tokens, Visitor&& visit) {
+  if (tokens.empty()) return;
+  double region_start = tokens[0].timestamp;
+  std::vector<int> ref_spk, hyp_spk;
+  bool evaluate = false;
+
+  for (auto& token : tokens) {
+    // If the evaluate flag is set and the region is not empty, visit it
+    if (evaluate && token.timestamp - region_start > DBL_EPSILON)
+      visit(region_start, token.timestamp, ref_spk, hyp_spk);
+
+    // Update the list of ref and hyp speakers in the current region
+    if (token.system == REF_TOKEN || token.system == HYP_TOKEN) {
+      std::vector<int>& active = (token.system == REF_TOKEN) ? ref_spk : hyp_spk;
+      if (token.type == START_TOKEN) {
+        active.push_back(token.spk);
+      } else {
+        auto it = std::find(active.begin(), active.end(), token.spk);
+        if (it != active.end()) active.erase(it);
+      }
+    } else {
+      // If it is a UEM token, update the evaluate flag
+      evaluate = (token.type == START_TOKEN);
+    }
+
+    // Update the region start time
+    region_start = token.timestamp;
+  }
+}
+
+// Find points at which a recording can be split into chunks that are swept
+// independently. A point is valid if it is outside the UEM, or if no reference
+// or hypothesis speaker is active at it; clipping the segments at valid points
+// leaves the evaluation regions unchanged. The points are spread evenly over
+// the evaluated span and snapped forward to the nearest point where speech
+// within the UEM starts or ends, so that no region is split.
+// \param ref: the reference segments.
+// \param hyp: the hypothesis segments.
+// \param uem: the UEM segments.
+// \param num_chunks: the desired number of chunks.
+// \return the split points, sorted (at most num_chunks - 1 of them)
+std::vector<double> find_split_points(const SegmentView& ref, const SegmentView& hyp,
+                                      const SegmentView& uem, int num_chunks);
+
+// Split segments into chunks at the given points. Segments that cross a point
+// are clipped, so chunk i holds the parts in [points[i - 1], points[i]). Speaker
+// ids are kept, so each chunk is viewed with the speaker list of `segments`.
+// \param segments: the segments to split.
+// \param points: the sorted split points.
+// \return the segments of each chunk (points.size() + 1 chunks)
+std::vector<Segments> split_segments(const SegmentView& segments,
+                                     const std::vector<double>& points);
+
+// Add reference collars to the UEM, i.e. exclude the parts of the UEM that are
+// within `collar` seconds of a reference boundary, returning the new UEM segments.
+// \param uem: the UEM segments.
+// \param ref: the reference segments.
 // \param collar: the collar size in seconds.
-// \return a list of evaluation regions
-std::vector<Region> get_eval_regions(TurnList& ref, TurnList& hyp, TurnList& uem);
-
-// Add reference collars to the UEM. This basically updates the UEM segments to exclude
-// the reference regions that are in the collar.
-// \param ref: a list of reference turns.
-// \param uem: a list of UEM segments.
-// \param collar: the collar size in seconds.
-void add_collar_to_uem(TurnList& uem, TurnList& ref, float collar = 0.0);
+// \return the UEM segments excluding the collars
+Segments add_collar_to_uem(const SegmentView& uem, const SegmentView& ref, float collar);
 
 }  // end namespace spyder
 
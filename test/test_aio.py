@@ -0,0 +1,80 @@
+from test.conftest import *
+
+import asyncio
+import gc
+import weakref
+
+import pytest
+
+from spyder.aio import AsyncScorer, DER_as_completed, DER_async, _default_scorer
+from spyder.der import *
+
+
+def test_der_async(ref_turns, hyp_turns, uem_turns):
+    for kwargs in [dict(), dict(uem=uem_turns, collar=0.2, regions="single")]:
+        expected = DER(ref_turns, hyp_turns, per_file=True, **kwargs)
+        progress = []
+        der = asyncio.run(
+            DER_async(
+                ref_turns,
+                hyp_turns,
+                per_file=True,
+                progress=lambda *args: progress.append(args),
+                **kwargs,
+            )
+        )
+        assert list(der) == list(expected)
+        for reco_id in expected:
+            assert der[reco_id].der == pytest.approx(expected[reco_id].der)
+        assert sorted(p[0] for p in progress) == sorted(ref_turns)
+        assert [p[2] for p in progress] == list(range(1, len(ref_turns) + 1))
+        assert all(p[3] == len(ref_turns) for p in progress)
+
+
+def test_der_async_concurrent(ref_turns, hyp_turns):
+    reco_id = next(iter(ref_turns))
+    expected = DER(ref_turns[reco_id], hyp_turns[reco_id])
+
+    async def score():
+        scorer = AsyncScorer(num_threads=2)
+        try:
+            return await asyncio.gather(
+                DER_async(ref_turns, hyp_turns, scorer=scorer),
+                DER_async(ref_turns[reco_id], hyp_turns[reco_id], scorer=scorer),
+            )
+        finally:
+            scorer.close()
+
+    overall, single = asyncio.run(score())
+    assert overall["Overall"].der == pytest.approx(
+        DER(ref_turns, hyp_turns)["Overall"].der
+    )
+    assert single.der == pytest.approx(expected.der)
+
+
+def test_der_as_completed(ref_turns, hyp_turns):
+    expected = DER(ref_turns, hyp_turns, per_file=True)
+
+    async def collect():
+        return [x async for x in DER_as_completed(ref_turns, hyp_turns)]
+
+    results = asyncio.run(collect())
+    assert sorted(reco_id for reco_id, _ in results) == sorted(ref_turns)
+    for reco_id, metrics in results:
+        assert metrics.der == pytest.approx(expected[reco_id].der)
+
+
+def test_default_scorer_released(ref_turns, hyp_turns):
+    # Each event loop gets its own default scorer, whose pool and threads are
+    # released with the loop.
+    pools = []
+
+    async def score():
+        await DER_async(ref_turns, hyp_turns)
+        pools.append(weakref.ref(_default_scorer()._pool))
+
+    for _ in range(2):
+        asyncio.run(score())
+    gc.collect()
+    assert len(pools) == 2
+    assert all(pool() is None for pool in pools)
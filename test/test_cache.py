@@ -0,0 +1,50 @@
+from test.conftest import *
+
+import sqlite3
+
+import numpy as np
+import pytest
+
+from spyder.cache import ResultCache
+from spyder.der import *
+
+
+def _num_entries(cache_dir):
+    db = sqlite3.connect(str(cache_dir / "results.db"))
+    return db.execute("SELECT COUNT(*) FROM results").fetchone()[0]
+
+
+def test_cached_der(tmp_path, ref_turns, hyp_turns):
+    expected = DER(ref_turns, hyp_turns, per_file=True)
+    for _ in range(2):
+        der = DER(ref_turns, hyp_turns, per_file=True, cache_dir=str(tmp_path))
+        for reco_id in expected:
+            assert der[reco_id].der == pytest.approx(expected[reco_id].der)
+            np.testing.assert_allclose(der[reco_id].overlap, expected[reco_id].overlap)
+            for field in ["sad_speech", "sad_miss", "sad_falarm"]:
+                assert getattr(der[reco_id], field) == pytest.approx(
+                    getattr(expected[reco_id], field)
+                )
+    assert _num_entries(tmp_path) == len(ref_turns)
+
+    # changing the scoring options adds new entries
+    DER(ref_turns, hyp_turns, collar=0.2, cache_dir=str(tmp_path))
+    assert _num_entries(tmp_path) == 2 * len(ref_turns)
+
+
+def test_cache_key():
+    ref = [("A", 0.0, 1.0)]
+    hyp = [("1", 0.0, 1.0)]
+    uem = [(0.0, 1.0)]
+    key = ResultCache.key(ref, hyp, uem)
+    assert key == ResultCache.key(list(ref), list(hyp), list(uem))
+    assert key != ResultCache.key(ref, [("1", 0.0, 1.5)], uem)
+    assert key != ResultCache.key(ref, hyp, uem, regions="single")
+    assert key != ResultCache.key(ref, hyp, uem, collar=0.25)
+
+
+def test_cache_eviction(tmp_path, ref_turns, hyp_turns):
+    DER(ref_turns, hyp_turns, cache_dir=str(tmp_path))
+    with ResultCache(str(tmp_path), max_size=1):
+        pass
+    assert _num_entries(tmp_path) == 0
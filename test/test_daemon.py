@@ -0,0 +1,78 @@
+from test.conftest import *
+
+import os
+import shutil
+import threading
+
+import numpy as np
+import pytest
+
+from spyder.daemon import ScoringDaemon, connect_daemon
+from spyder.der import *
+
+
+@pytest.fixture
+def daemon(tmp_path):
+    server = ScoringDaemon(str(tmp_path / "spyder.sock"), num_workers=2)
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    yield server
+    server.shutdown()
+    server.server_close()
+
+
+def test_daemon_der(daemon, ref_turns, hyp_turns, uem_turns):
+    for kwargs in [dict(), dict(uem=uem_turns, collar=0.2, regions="single")]:
+        expected = DER(ref_turns, hyp_turns, per_file=True, daemon=False, **kwargs)
+        der = DER(ref_turns, hyp_turns, per_file=True, daemon=daemon.path, **kwargs)
+        assert list(der) == list(expected)
+        for reco_id in expected:
+            assert der[reco_id].der == pytest.approx(expected[reco_id].der)
+            assert der[reco_id].jer == pytest.approx(expected[reco_id].jer)
+            assert der[reco_id].ref_map == expected[reco_id].ref_map
+            np.testing.assert_allclose(der[reco_id].overlap, expected[reco_id].overlap)
+        # The SAD errors survive the encoding, so the Overall totals add up.
+        for reco_id in expected:
+            for field in ["sad_speech", "sad_miss", "sad_falarm"]:
+                assert getattr(der[reco_id], field) == pytest.approx(
+                    getattr(expected[reco_id], field)
+                )
+        assert der["Overall"].sad_speech > 0
+
+
+def test_daemon_file_cache(daemon, tmp_path, ref_turns, hyp_turns):
+    ref_path = str(tmp_path / "ref.rttm")
+    hyp_path = str(tmp_path / "hyp.rttm")
+    shutil.copy("test/fixtures/ref.rttm", ref_path)
+    shutil.copy("test/fixtures/hyp.rttm", hyp_path)
+    expected = DER(ref_turns, hyp_turns, daemon=False)["Overall"]
+    for _ in range(3):
+        der = DER(ref_path, hyp_path, daemon=daemon.path)["Overall"]
+        assert der.der == pytest.approx(expected.der)
+    with connect_daemon(daemon.path) as client:
+        status = client.ping()
+    assert status["num_jobs"] == 3
+    assert status["cache_misses"] == 2
+    assert status["cache_hits"] == 4
+
+    # a modified file is parsed again
+    os.utime(hyp_path, ns=(0, 0))
+    DER(ref_path, hyp_path, daemon=daemon.path)
+    with connect_daemon(daemon.path) as client:
+        assert client.ping()["cache_misses"] == 3
+
+
+def test_daemon_errors(daemon):
+    with connect_daemon(daemon.path) as client:
+        with pytest.raises(RuntimeError):
+            client.request({"op": "unknown"})
+        # the connection is still usable after an error
+        assert client.ping()["num_jobs"] == 0
+
+
+def test_daemon_socket_owner(tmp_path):
+    # Only sockets owned by the current user are trusted, and regular files are not.
+    path = tmp_path / "spyder.sock"
+    path.write_text("")
+    assert connect_daemon(str(path)) is None
+    assert connect_daemon(str(tmp_path / "missing.sock")) is None
@@ -1,8 +1,12 @@
 from test.conftest import *
 
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
 import pytest
 
 from spyder.der import *
+from _spyder import Turn, TurnList, compute_der, solve_assignment
 
 
 @pytest.mark.parametrize(
@@ -24,3 +28,537 @@ def test_der_with_uem(ref_turns, hyp_turns, uem_turns):
     der = DER(ref_turns, hyp_turns, uem=uem_turns)
     assert der["Overall"].duration == pytest.approx(13.79, rel=1e-2)
     assert der["Overall"].der == pytest.approx(expected=0.0967, rel=1e-2)
+
+
+def test_der_global_mapping():
+    # Speakers A and B are mapped to x and y in the first recording, but the
+    # per-recording mapping of the second one would swap them.
+    ref = {
+        "rec1": [("A", 0.0, 10.0), ("B", 10.0, 12.0)],
+        "rec2": [("A", 0.0, 2.0), ("B", 2.0, 4.0)],
+    }
+    hyp = {
+        "rec1": [("x", 0.0, 10.0), ("y", 10.0, 12.0)],
+        "rec2": [("y", 0.0, 2.0), ("x", 2.0, 4.0)],
+    }
+    der = DER(ref, hyp, per_file=True)
+    assert der["rec2"].conf == pytest.approx(0.0)
+
+    der = DER(ref, hyp, per_file=True, global_mapping=True)
+    assert der["rec1"].der == pytest.approx(0.0)
+    assert der["rec2"].conf == pytest.approx(1.0)
+    assert der["Overall"].der == pytest.approx(4.0 / 16.0)
+
+
+def test_speaker_breakdown():
+    ref = [("A", 0.0, 2.0), ("B", 1.5, 3.5), ("A", 4.0, 5.1)]
+    hyp = [("1", 0.0, 0.8), ("2", 0.6, 2.3), ("3", 2.1, 3.9), ("1", 3.8, 5.2)]
+    metrics = DER(ref, hyp)
+    assert metrics.ref_speakers == ["A", "B"]
+    assert metrics.hyp_speakers == ["1", "2", "3"]
+    np.testing.assert_allclose(metrics.overlap, [[1.9, 1.4, 0.0], [0.0, 0.8, 1.4]])
+    np.testing.assert_allclose(metrics.ref_duration, [3.1, 2.0])
+    np.testing.assert_allclose(metrics.ref_miss, [0.25, 0.25])
+    np.testing.assert_allclose(metrics.ref_conf, [0.95, 0.35])
+    np.testing.assert_allclose(metrics.hyp_falarm, [0.3, 0.4, 0.4])
+
+
+def test_speaker_breakdown_totals(ref_turns, hyp_turns):
+    der = DER(ref_turns, hyp_turns, per_file=True, collar=0.2)
+    for reco_id in ref_turns:
+        m = der[reco_id]
+        assert m.overlap.shape == (len(m.ref_speakers), len(m.hyp_speakers))
+        assert m.ref_duration.sum() == pytest.approx(m.duration)
+        assert m.ref_miss.sum() == pytest.approx(m.miss * m.duration)
+        assert m.ref_conf.sum() == pytest.approx(m.conf * m.duration)
+        assert m.hyp_falarm.sum() == pytest.approx(m.falarm * m.duration)
+
+
+def test_speaker_breakdown_views():
+    ref = TurnList([Turn("A", 0.0, 2.0), Turn("B", 1.5, 3.5)])
+    hyp = TurnList([Turn("1", 0.0, 1.8), Turn("2", 1.6, 3.0), Turn("3", 3.0, 3.5)])
+    metrics = compute_der(ref, hyp, TurnList([Turn("dummy", 0.0, 4.0)]))
+    # The arrays are views of the metrics, which only change through the setters.
+    with pytest.raises(ValueError):
+        metrics.overlap[0, 0] = 1.0
+    with pytest.raises(ValueError):
+        metrics.ref_duration = [1.0, 2.0, 3.0]
+    with pytest.raises(ValueError):
+        metrics.degree_time = np.zeros(4)
+    metrics.ref_duration = metrics.ref_duration * 2
+    np.testing.assert_allclose(metrics.ref_duration, [4.0, 4.0])
+
+
+def test_degree_breakdown(ref_turns, hyp_turns):
+    ref = [("A", 0.0, 2.0), ("B", 1.5, 3.5), ("A", 4.0, 5.1)]
+    hyp = [("1", 0.0, 0.8), ("2", 0.6, 2.3), ("3", 2.1, 3.9), ("1", 3.8, 5.2)]
+    metrics = DER(ref, hyp)
+    expected_time = np.zeros((5, 5))
+    expected_time[0, 1:3] = [0.5, 0.1]
+    expected_time[1, 1:3] = [3.7, 0.4]
+    expected_time[2, 1] = 0.5
+    np.testing.assert_allclose(metrics.degree_time, expected_time, atol=1e-9)
+    np.testing.assert_allclose(metrics.degree_miss[2, 1], 0.5)
+    np.testing.assert_allclose(metrics.degree_falarm[:, 0], 0.0, atol=1e-9)
+
+    der = DER(ref_turns, hyp_turns, per_file=True, collar=0.2)
+    for m in der.values():
+        assert m.degree_time.shape == (5, 5)
+        assert m.degree_duration.sum() == pytest.approx(m.duration)
+        assert m.degree_miss.sum() == pytest.approx(m.miss * m.duration)
+        assert m.degree_falarm.sum() == pytest.approx(m.falarm * m.duration)
+        assert m.degree_conf.sum() == pytest.approx(m.conf * m.duration)
+    np.testing.assert_allclose(
+        der["Overall"].degree_miss,
+        sum(der[reco_id].degree_miss for reco_id in ref_turns),
+    )
+
+
+def test_sad(ref_turns, hyp_turns, uem_turns):
+    ref = [("A", 0.0, 2.0), ("B", 1.5, 3.5), ("A", 4.0, 5.1)]
+    hyp = [("1", 0.0, 0.8), ("2", 0.6, 2.3), ("3", 2.1, 3.9), ("1", 3.8, 5.2)]
+    sad = SAD(ref, hyp)
+    assert sad.duration == pytest.approx(4.6)
+    assert sad.miss == pytest.approx(0.0, abs=1e-9)
+    assert sad.falarm == pytest.approx(0.6 / 4.6)
+    metrics = DER(ref, hyp)
+    assert metrics.sad_speech == pytest.approx(4.6)
+    assert metrics.sad_error == pytest.approx(sad.error)
+
+    for kwargs in [dict(), dict(uem=uem_turns, collar=0.2, regions="single")]:
+        der = DER(ref_turns, hyp_turns, per_file=True, daemon=False, **kwargs)
+        sad = SAD(ref_turns, hyp_turns, per_file=True, **kwargs)
+        assert list(sad) == list(der)
+        for reco_id in der:
+            assert sad[reco_id].duration == pytest.approx(der[reco_id].sad_speech)
+            assert sad[reco_id].miss * sad[reco_id].duration == pytest.approx(
+                der[reco_id].sad_miss
+            )
+            assert sad[reco_id].falarm * sad[reco_id].duration == pytest.approx(
+                der[reco_id].sad_falarm
+            )
+
+
+@pytest.mark.parametrize("collar, use_uem", [(0.0, False), (0.25, True)])
+def test_der_session(ref_turns, hyp_turns, uem_turns, collar, use_uem):
+    reco_id = next(iter(ref_turns))
+    ref, hyp = list(ref_turns[reco_id]), list(hyp_turns[reco_id])
+    uem = uem_turns[reco_id] if use_uem else None
+    session = DERSession(ref, hyp, uem=uem, collar=collar)
+    turns = {i: turn for i, turn in enumerate(ref + hyp)}
+    is_ref = {i: i < len(ref) for i in turns}
+
+    def check():
+        ids = sorted(turns)
+        expected = DER(
+            [turns[i] for i in ids if is_ref[i]],
+            [turns[i] for i in ids if not is_ref[i]],
+            uem=uem,
+            collar=collar,
+            daemon=False,
+        )
+        metrics = session.metrics
+        assert metrics.der == pytest.approx(expected.der)
+        assert metrics.duration == pytest.approx(expected.duration)
+        assert metrics.ref_speakers == expected.ref_speakers
+
+    check()
+    spk, start, end = hyp[3]
+    new_id = session.insert("hyp", "new", start + 0.5, end + 2.0)
+    turns[new_id], is_ref[new_id] = ("new", start + 0.5, end + 2.0), False
+    check()
+    session.move(new_id, start, end + 1.0)
+    turns[new_id] = ("new", start, end + 1.0)
+    check()
+    session.relabel(len(ref) + 3, "new")
+    turns[len(ref) + 3] = ("new", start, end)
+    check()
+    session.delete(0)
+    del turns[0]
+    check()
+    spk, start, end = ref[1]
+    session.move(1, start - 0.3, end + 0.3)
+    turns[1] = (spk, start - 0.3, end + 0.3)
+    check()
+    assert session.turn(1) == (spk, start - 0.3, end + 0.3)
+    assert session.num_solves >= 1
+    with pytest.raises(ValueError):
+        session.turn(0)
+    with pytest.raises(ValueError):
+        session.insert("uem", "A", 0.0, 1.0)
+
+
+def test_jer():
+    ref = {
+        "uttr0": [("A", 0.0, 2.0), ("B", 1.5, 3.5), ("A", 4.0, 5.1)],
+        "uttr2": [("A", 0.0, 4.3), ("C", 6.0, 8.1), ("B", 2.0, 8.5)],
+    }
+    hyp = {
+        "uttr0": [("1", 0.0, 0.8), ("2", 0.6, 2.3), ("3", 2.1, 3.9), ("1", 3.8, 5.2)],
+        "uttr2": [("1", 0.0, 4.5), ("2", 2.5, 8.7)],
+    }
+    der = DER(ref, hyp, per_file=True)
+    np.testing.assert_allclose(der["uttr0"].ref_jaccard, [1.9 / 3.4, 1.4 / 2.4])
+    assert der["uttr0"].jer == pytest.approx(0.4289, rel=1e-3)
+    assert der["uttr2"].jer == pytest.approx(0.3830, rel=1e-3)
+    assert der["Overall"].jer == pytest.approx(0.4014, rel=1e-3)
+
+
+def test_timeline(ref_turns, hyp_turns):
+    der = DER(ref_turns, hyp_turns, per_file=True, collar=0.2, timeline=True)
+    for reco_id in ref_turns:
+        m = der[reco_id]
+        full = m.timeline.window(-1.0, 1e9)
+        assert full.duration == pytest.approx(m.duration)
+        assert full.der == pytest.approx(m.der)
+
+        # windows that split the recording add up to the whole
+        mid = 0.5 * max(turn[2] for turn in ref_turns[reco_id])
+        first, second = m.timeline.window(-1.0, mid), m.timeline.window(mid, 1e9)
+        assert first.duration + second.duration == pytest.approx(m.duration)
+        assert first.duration * first.der + second.duration * second.der == (
+            pytest.approx(m.duration * m.der)
+        )
+
+        curve = m.timeline.sliding_window(10.0, 5.0, t0=0.0, t1=100.0)
+        assert len(curve["start"]) == 20
+        np.testing.assert_allclose(curve["start"], np.arange(0.0, 100.0, 5.0))
+        assert curve["der"].shape == curve["duration"].shape
+
+
+def test_timeline_regions(ref_turns, hyp_turns):
+    der = DER(ref_turns, hyp_turns, per_file=True, timeline=True)
+    for reco_id in ref_turns:
+        m = der[reco_id]
+        regions = m.timeline.regions
+        assert len(regions) == len(m.timeline)
+        assert np.all(regions["start"] < regions["end"])
+        assert np.all(regions["end"][:-1] <= regions["start"][1:])
+        assert np.all(
+            regions["num_correct"] <= np.minimum(regions["num_ref"], regions["num_hyp"])
+        )
+        durations = (regions["end"] - regions["start"]) * regions["num_ref"]
+        assert durations.sum() == pytest.approx(m.duration)
+        assert regions["miss"].sum() == pytest.approx(m.miss * m.duration)
+        assert regions["falarm"].sum() == pytest.approx(m.falarm * m.duration)
+        assert regions["conf"].sum() == pytest.approx(m.conf * m.duration)
+        # The windows are searched on the regions, which cannot be changed.
+        with pytest.raises(ValueError):
+            regions["start"][0] = 1.0
+
+
+@pytest.mark.parametrize(
+    "collar, regions",
+    [(0.0, "all"), (0.0, "nonoverlap"), (0.2, "all"), (0.2, "single")],
+)
+def test_der_multithreaded(ref_turns, hyp_turns, uem_turns, collar, regions):
+    kwargs = dict(uem=uem_turns, per_file=True, collar=collar, regions=regions)
+    expected = DER(ref_turns, hyp_turns, timeline=True, **kwargs)
+    der = DER(ref_turns, hyp_turns, timeline=True, num_threads=4, **kwargs)
+    for reco_id in ref_turns:
+        assert der[reco_id].der == pytest.approx(expected[reco_id].der)
+        assert der[reco_id].ref_map == expected[reco_id].ref_map
+        np.testing.assert_allclose(der[reco_id].overlap, expected[reco_id].overlap)
+        np.testing.assert_array_equal(
+            der[reco_id].timeline.regions[["start", "end", "num_ref", "num_hyp"]],
+            expected[reco_id].timeline.regions[["start", "end", "num_ref", "num_hyp"]],
+        )
+
+
+@pytest.mark.parametrize("num_threads", [1, 3])
+def test_der_stream(ref_turns, hyp_turns, uem_turns, num_threads):
+    expected = DER(ref_turns, hyp_turns, uem=uem_turns, per_file=True, collar=0.2)
+    items = (
+        (reco_id, ref_turns[reco_id], hyp_turns[reco_id], uem_turns[reco_id])
+        for reco_id in ref_turns
+    )
+    der = DER(items, per_file=True, collar=0.2, num_threads=num_threads)
+    assert list(der) == list(expected)
+    for reco_id in expected:
+        assert der[reco_id].der == pytest.approx(expected[reco_id].der)
+        assert der[reco_id].jer == pytest.approx(expected[reco_id].jer)
+
+
+def test_der_stream_stats(ref_turns, hyp_turns):
+    expected = DER(ref_turns, hyp_turns)["Overall"]
+    stream = DERStream(num_threads=2, max_pending=1)
+    stream.update(
+        (reco_id, ref_turns[reco_id], hyp_turns[reco_id], None) for reco_id in ref_turns
+    )
+    assert stream.num_pending <= 3
+    der = stream.close()["Overall"]
+    assert stream.num_scored == len(ref_turns)
+    assert stream.stats().der == pytest.approx(der.der)
+    assert der.duration == pytest.approx(expected.duration)
+    assert der.der == pytest.approx(expected.der)
+    assert der.jer == pytest.approx(expected.jer)
+
+
+@pytest.mark.parametrize("global_mapping", [False, True])
+def test_der_batch(ref_turns, hyp_turns, uem_turns, global_mapping):
+    kwargs = dict(uem=uem_turns, collar=0.2, global_mapping=global_mapping)
+    expected = DER(ref_turns, hyp_turns, per_file=True, **kwargs)
+    batch = DER(ref_turns, hyp_turns, batch=True, num_threads=2, **kwargs)
+    assert len(batch) == len(ref_turns)
+    assert list(batch.reco_ids) == list(ref_turns)
+    np.testing.assert_allclose(
+        batch.der, [expected[reco_id].der for reco_id in ref_turns]
+    )
+    np.testing.assert_allclose(
+        batch.duration, [expected[reco_id].duration for reco_id in ref_turns]
+    )
+    for i, reco_id in enumerate(ref_turns):
+        assert batch[reco_id].ref_map == expected[reco_id].ref_map
+        assert batch[i].hyp_map == expected[reco_id].hyp_map
+    assert batch.overall.der == pytest.approx(expected["Overall"].der)
+    assert batch.overall.jer == pytest.approx(expected["Overall"].jer)
+
+
+@pytest.mark.parametrize("collar", [0.0, 0.2])
+def test_der_multi_reference(ref_turns, hyp_turns, collar):
+    reco_id = next(iter(ref_turns))
+    ref, hyp = ref_turns[reco_id], hyp_turns[reco_id]
+    refs = {
+        "a": ref,
+        "b": [(spk, start + 0.1, end + 0.1) for spk, start, end in ref],
+        "c": ref[::2],
+    }
+    uem = [(0.0, 100.0)]
+    der = DER_multi_reference(refs, hyp, uem=uem, collar=collar, num_threads=2)
+    for key in refs:
+        expected = DER(refs[key], hyp, uem=uem, collar=collar)
+        assert der[key].der == pytest.approx(expected.der)
+        assert der[key].ref_map == expected.ref_map
+    ders = [der[key].der for key in refs]
+    assert der["min"].der == pytest.approx(min(ders))
+    assert der["mean"].der == pytest.approx(np.mean(ders))
+
+
+@pytest.mark.parametrize("collar", [0.0, 0.2])
+def test_der_matrix(ref_turns, hyp_turns, uem_turns, collar):
+    shifted = {
+        reco_id: [(spk, start + 0.3, end + 0.3) for spk, start, end in turns]
+        for reco_id, turns in hyp_turns.items()
+    }
+    systems = {"ref": ref_turns, "hyp": hyp_turns, "shifted": shifted}
+    matrices = DER_matrix(
+        systems, uem=uem_turns, per_file=True, collar=collar, num_threads=2
+    )
+    keys = list(systems)
+    for i, a in enumerate(keys):
+        for j, b in enumerate(keys):
+            if i == j:
+                assert matrices["Overall"][i, j] == 0
+                continue
+            expected = DER(
+                systems[a], systems[b], uem=uem_turns, per_file=True, collar=collar
+            )
+            assert matrices["Overall"][i, j] == pytest.approx(expected["Overall"].der)
+            for reco_id in ref_turns:
+                assert matrices[reco_id][i, j] == pytest.approx(expected[reco_id].der)
+    der = DER_matrix([ref_turns, hyp_turns], uem=uem_turns, collar=collar)
+    assert der.shape == (2, 2)
+    assert der[0, 1] == pytest.approx(matrices["Overall"][0, 1])
+
+
+def test_der_threads(ref_turns, hyp_turns, uem_turns):
+    # Threads share the same turn lists, which compute_der does not modify.
+    reco_ids = list(ref_turns)
+    lists = {
+        reco_id: (
+            TurnList([Turn(*turn) for turn in ref_turns[reco_id]]),
+            TurnList([Turn(*turn) for turn in hyp_turns[reco_id]]),
+            TurnList([Turn("dummy", *turn) for turn in uem_turns[reco_id]]),
+        )
+        for reco_id in reco_ids
+    }
+    expected = {
+        reco_id: DER(
+            ref_turns[reco_id], hyp_turns[reco_id], uem_turns[reco_id], collar=0.2
+        )
+        for reco_id in reco_ids
+    }
+    jobs = [reco_ids[k % len(reco_ids)] for k in range(64)]
+    with ThreadPoolExecutor(8) as pool:
+        results = list(
+            pool.map(lambda reco_id: compute_der(*lists[reco_id], collar=0.2), jobs)
+        )
+    for reco_id, metrics in zip(jobs, results):
+        assert metrics.der == pytest.approx(expected[reco_id].der)
+        assert metrics.ref_map == expected[reco_id].ref_map
+
+
+def test_der_compressed_rttm(tmp_path, ref_turns, hyp_turns):
+    import gzip
+    import shutil
+
+    from spyder.der import read_rttm_turns
+
+    ref_path = str(tmp_path / "ref.rttm.gz")
+    with open("test/fixtures/ref.rttm", "rb") as f, gzip.open(ref_path, "wb") as g:
+        shutil.copyfileobj(f, g)
+    assert read_rttm_turns(ref_path) == read_rttm_turns("test/fixtures/ref.rttm")
+    expected = DER(ref_turns, hyp_turns)["Overall"]
+    der = DER(ref_path, "test/fixtures/hyp.rttm", daemon=False)["Overall"]
+    assert der.der == pytest.approx(expected.der)
+
+
+def _rttm_lines(num_lines):
+    # Enough lines to span several read blocks and decompressed chunks.
+    return "".join(
+        f"SPEAKER reco{i % 7} 1 {i * 0.5:.2f} 1.25 <NA> <NA> spk{i % 5} <NA> <NA>\n"
+        for i in range(num_lines)
+    ).encode()
+
+
+def _zstd_frame(data):
+    # A zstd frame of raw (stored) blocks, so no zstd module is needed: a header
+    # with a 4-byte content size, then blocks of at most 128 KiB, the last one
+    # flagged.
+    frame = b"\x28\xb5\x2f\xfd" + bytes([0xA0]) + len(data).to_bytes(4, "little")
+    blocks = [data[k : k + (1 << 17)] for k in range(0, len(data), 1 << 17)] or [b""]
+    for k, block in enumerate(blocks):
+        header = (len(block) << 3) | (k == len(blocks) - 1)
+        frame += header.to_bytes(3, "little") + block
+    return frame
+
+
+def test_compressed_rttm_streams(tmp_path):
+    import gzip
+
+    from spyder.der import read_rttm_turns
+
+    data = _rttm_lines(40000)
+    plain_path = tmp_path / "plain.rttm"
+    plain_path.write_bytes(data)
+    expected = read_rttm_turns(str(plain_path))
+
+    # Several gzip members, split in the middle of a line.
+    gz_path = tmp_path / "multi.rttm.gz"
+    half = len(data) // 2 + 11
+    gz_path.write_bytes(gzip.compress(data[:half]) + gzip.compress(data[half:]))
+    assert read_rttm_turns(str(gz_path)) == expected
+
+    # A last line without a trailing newline, plain and compressed.
+    no_newline = tmp_path / "no_newline.rttm"
+    no_newline.write_bytes(data.rstrip(b"\n"))
+    assert read_rttm_turns(str(no_newline)) == expected
+    no_newline_gz = tmp_path / "no_newline.rttm.gz"
+    no_newline_gz.write_bytes(gzip.compress(data.rstrip(b"\n")))
+    assert read_rttm_turns(str(no_newline_gz)) == expected
+
+    # Truncated and corrupt gzip data raise instead of returning partial turns.
+    compressed = gzip.compress(data)
+    truncated = tmp_path / "truncated.rttm.gz"
+    truncated.write_bytes(compressed[: len(compressed) // 2])
+    with pytest.raises(RuntimeError, match="truncated gzip data"):
+        read_rttm_turns(str(truncated))
+    # Flip a byte of the CRC-32 trailer, so only the integrity check catches it.
+    corrupt = tmp_path / "corrupt.rttm.gz"
+    corrupt.write_bytes(
+        compressed[:-8] + bytes([compressed[-8] ^ 0xFF]) + compressed[-7:]
+    )
+    with pytest.raises(RuntimeError, match="corrupt gzip data"):
+        read_rttm_turns(str(corrupt))
+
+
+def test_zstd_rttm(tmp_path):
+    from spyder.der import read_rttm_turns
+
+    data = _rttm_lines(40000)
+    expected = read_rttm_turns("test/fixtures/ref.rttm")
+    with open("test/fixtures/ref.rttm", "rb") as f:
+        fixture = f.read()
+    path = tmp_path / "ref.rttm.zst"
+    path.write_bytes(_zstd_frame(fixture))
+    try:
+        turns = read_rttm_turns(str(path))
+    except RuntimeError as e:
+        if "without zstd support" not in str(e):
+            raise
+        pytest.skip("spyder was built without zstd support")
+    assert turns == expected
+
+    # Several frames, split in the middle of a line, and a truncated frame.
+    plain_path = tmp_path / "plain.rttm"
+    plain_path.write_bytes(data)
+    half = len(data) // 2 + 11
+    path.write_bytes(_zstd_frame(data[:half]) + _zstd_frame(data[half:]))
+    assert read_rttm_turns(str(path)) == read_rttm_turns(str(plain_path))
+    path.write_bytes(_zstd_frame(data)[:-100])
+    with pytest.raises(RuntimeError, match="truncated zstd data"):
+        read_rttm_turns(str(path))
+
+
+@pytest.mark.parametrize("collar, regions", [(0.0, "all"), (0.2, "single")])
+def test_der_approx(ref_turns, hyp_turns, collar, regions):
+    expected = DER(ref_turns, hyp_turns, collar=collar, regions=regions)["Overall"]
+    assert expected.der_lower == expected.der_upper == expected.der
+    widths = []
+    for frame_shift in [0.1, 0.01]:
+        der = DER_approx(
+            ref_turns,
+            hyp_turns,
+            frame_shift=frame_shift,
+            collar=collar,
+            regions=regions,
+        )["Overall"]
+        assert der.der == pytest.approx(expected.der, abs=0.01)
+        # Without a collar on all regions, the mapping is found on the scored
+        # frames, and the bounds hold for the exact DER. Otherwise there are none.
+        if collar > 0 or regions != "all":
+            assert np.isnan(der.der_lower) and np.isnan(der.der_upper)
+            continue
+        assert der.der_lower <= expected.der <= der.der_upper
+        widths.append(der.der_upper - der.der_lower)
+    assert len(widths) == 0 or widths[1] < widths[0]
+
+
+def test_sparse_assignment():
+    # Speakers that never co-occur have no cost, so the assignment splits into
+    # independent components, solved on several threads.
+    rng = np.random.default_rng(0)
+    shapes = [(3, 2), (1, 1), (4, 5), (2, 2), (5, 3), (1, 2)]
+    cost = np.zeros((sum(r for r, _ in shapes), sum(h for _, h in shapes)))
+    i = j = 0
+    for num_ref, num_hyp in shapes:
+        cost[i : i + num_ref, j : j + num_hyp] = -rng.uniform(
+            0.1, 10.0, (num_ref, num_hyp)
+        )
+        i, j = i + num_ref, j + num_hyp
+    cost = cost[rng.permutation(cost.shape[0])][:, rng.permutation(cost.shape[1])]
+
+    dense = solve_assignment(cost, sparse=False)
+    for num_threads in [1, 4]:
+        sparse = solve_assignment(cost, num_threads=num_threads)
+        # The dense solution may also pair speakers that never co-occur, at no cost.
+        assert sparse == [
+            h if h >= 0 and cost[r, h] != 0 else -1 for r, h in enumerate(dense)
+        ]
+
+
+@pytest.mark.parametrize("mapper", ["greedy", "auction"])
+@pytest.mark.parametrize("global_mapping", [False, True])
+def test_der_mapper(ref_turns, hyp_turns, mapper, global_mapping):
+    # Two copies of each recording, so that a shared mapping spans several of them.
+    ref = {f"{r}-{k}": turns for r, turns in ref_turns.items() for k in range(2)}
+    hyp = {f"{r}-{k}": turns for r, turns in hyp_turns.items() for k in range(2)}
+    kwargs = dict(per_file=True, global_mapping=global_mapping, daemon=False)
+    expected = DER(ref, hyp, **kwargs)
+    der = DER(ref, hyp, mapper=mapper, **kwargs)
+    for reco_id in ref:
+        metrics, exact = der[reco_id], expected[reco_id]
+        assert metrics.mapper == mapper and exact.mapper == "hungarian"
+        assert exact.mapping_gap == 0
+        # Confusion only depends on the overlap of the mapped speakers.
+        assert metrics.der >= exact.der - 1e-9
+        missed = (metrics.der - exact.der) * exact.duration
+        assert missed <= metrics.mapping_gap + 1e-6
+    # A shared mapping has a single gap, which every recording reports.
+    gaps = [der[reco_id].mapping_gap for reco_id in ref]
+    if global_mapping:
+        assert gaps[0] == gaps[1] == der["Overall"].mapping_gap
+    else:
+        assert der["Overall"].mapping_gap == pytest.approx(sum(gaps))
+    with pytest.raises(ValueError):
+        DER(ref_turns, hyp_turns, mapper="unknown", daemon=False)
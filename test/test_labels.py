@@ -0,0 +1,53 @@
+from test.conftest import *
+
+import numpy as np
+import pytest
+
+from spyder.labels import frame_labels
+
+
+def _naive_labels(turns, frame_shift, duration):
+    # Reference implementation: a speaker is active at the frame midpoint.
+    speakers = sorted({turn[0] for turn in turns})
+    num_frames = int(np.ceil(duration / frame_shift - 1e-9))
+    labels = np.zeros((num_frames, len(speakers)), dtype=np.uint8)
+    for f in range(num_frames):
+        start = f * frame_shift
+        end = min(start + frame_shift, duration)
+        mid = start + frame_shift / 2 if f + 1 < num_frames else (start + end) / 2
+        for spk, t0, t1 in turns:
+            if t0 <= mid < t1:
+                labels[f, speakers.index(spk)] = 1
+    return labels, speakers
+
+
+def test_frame_labels():
+    turns = [("b", 0.0, 0.22), ("a", 0.1, 0.36), ("a", 0.3, 0.5), ("c", 0.42, 0.44)]
+    labels, speakers = frame_labels(turns, frame_shift=0.1, duration=0.55)
+    assert speakers == ["a", "b", "c"]
+    assert labels.dtype == np.uint8
+    assert labels.tolist() == [
+        [0, 1, 0],
+        [1, 1, 0],
+        [1, 0, 0],
+        [1, 0, 0],
+        [1, 0, 0],
+        [0, 0, 0],
+    ]
+
+
+@pytest.mark.parametrize("packed", [False, True])
+def test_frame_labels_rttm(ref_turns, packed):
+    expected = frame_labels(ref_turns, frame_shift=0.05, num_threads=2)
+    labels = frame_labels("test/fixtures/ref.rttm", frame_shift=0.05, packed=packed)
+    assert list(labels) == list(ref_turns)
+    for reco_id, turns in ref_turns.items():
+        duration = max(turn[2] for turn in turns)
+        naive, speakers = _naive_labels(turns, 0.05, duration)
+        assert expected[reco_id][1] == speakers
+        assert np.array_equal(expected[reco_id][0], naive)
+        matrix, speakers = labels[reco_id]
+        if packed:
+            assert matrix.shape[1] == (len(speakers) + 7) // 8
+            matrix = np.unpackbits(matrix, axis=1, count=len(speakers))
+        assert np.array_equal(matrix, naive)
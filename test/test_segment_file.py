@@ -0,0 +1,91 @@
+from test.conftest import *
+
+import struct
+
+import pytest
+
+from spyder.der import *
+from spyder.der import _DER_segment_files
+from _spyder import (
+    SegmentFile,
+    is_segment_file,
+    rttm_to_segment_file,
+    segment_file_to_rttm,
+)
+
+
+@pytest.fixture(scope="module")
+def segment_files(tmp_path_factory):
+    tmp_path = tmp_path_factory.mktemp("segments")
+    ref_path = str(tmp_path / "ref.seg")
+    hyp_path = str(tmp_path / "hyp.seg")
+    rttm_to_segment_file("test/fixtures/ref.rttm", ref_path)
+    rttm_to_segment_file("test/fixtures/hyp.rttm", hyp_path, merge=False)
+    return ref_path, hyp_path
+
+
+def test_segment_file_contents(ref_turns, segment_files):
+    ref_path, hyp_path = segment_files
+    assert is_segment_file(ref_path)
+    assert not is_segment_file("test/fixtures/ref.rttm")
+    ref = SegmentFile(ref_path)
+    assert ref.merged and not SegmentFile(hyp_path).merged
+    assert ref.recordings == list(ref_turns.keys())
+
+
+def test_segment_file_corrupt(tmp_path, segment_files):
+    with open(segment_files[0], "rb") as f:
+        data = f.read()
+
+    def patch(offset, value):
+        path = str(tmp_path / "corrupt.seg")
+        with open(path, "wb") as f:
+            f.write(data[:offset] + value + data[offset + len(value) :])
+        return path
+
+    # An out of range speaker id, and a segment count whose size in bytes
+    # overflows.
+    spk_offset = struct.unpack_from("<Q", data, 104)[0]
+    for path in [
+        patch(spk_offset, struct.pack("<i", 1000)),
+        patch(40, struct.pack("<Q", 2**62)),
+    ]:
+        with pytest.raises(RuntimeError, match="corrupt segment file"):
+            SegmentFile(path)
+
+
+def test_segment_file_roundtrip(tmp_path, segment_files):
+    _, hyp_path = segment_files
+    rttm_path = str(tmp_path / "hyp.rttm")
+    segment_file_to_rttm(hyp_path, rttm_path)
+    with open(rttm_path) as f:
+        roundtrip = sorted(line.split()[1:5] + [line.split()[7]] for line in f)
+    with open("test/fixtures/hyp.rttm") as f:
+        original = sorted(line.split()[1:5] + [line.split()[7]] for line in f)
+    assert len(roundtrip) == len(original)
+    for a, b in zip(roundtrip, original):
+        assert a[0] == b[0] and a[4] == b[4]
+        assert float(a[2]) == pytest.approx(float(b[2]), abs=1e-3)
+        assert float(a[3]) == pytest.approx(float(b[3]), abs=1e-3)
+
+
+@pytest.mark.parametrize(
+    "collar, regions",
+    [(0.0, "all"), (0.0, "single"), (0.0, "overlap"), (0.2, "all")],
+)
+def test_der_segment_files(ref_turns, hyp_turns, segment_files, collar, regions):
+    ref_path, hyp_path = segment_files
+    expected = DER(ref_turns, hyp_turns, collar=collar, regions=regions)
+    der = _DER_segment_files(
+        ref_path, hyp_path, collar=collar, regions=regions, verbose=False
+    )
+    assert der["Overall"].der == pytest.approx(expected["Overall"].der, rel=1e-6)
+
+
+def test_der_segment_files_with_uem(segment_files):
+    ref_path, hyp_path = segment_files
+    der = _DER_segment_files(
+        ref_path, hyp_path, uem_path="test/fixtures/ref.uem", verbose=False
+    )
+    assert der["Overall"].duration == pytest.approx(13.79, rel=1e-2)
+    assert der["Overall"].der == pytest.approx(expected=0.0967, rel=1e-2)